@@ -0,0 +1,306 @@
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <algorithm>
+#include <signal.h>
+
+#include "PrincessesAndMonsters.h"
+#include "ScenarioCorpus.h"
+#include "PairedGames.h"
+#include "OnlineStatistics.h"
+
+using namespace std;
+
+// Decides between two variants of the solver on the scenarios of a
+// corpus (see ScenarioCorpus.h):
+//
+//     ABCompare <corpus> <variant_a> <variant_b> [-t threads] [-n max_games]
+//               [-m min_games] [-l look] [-a alpha]
+//
+// A variant is a policy with parameters replaced (set_parameter), played
+// in-process,
+//
+//     sector_search
+//     sector_search:disperse_fraction=0.8,large_board=30
+//
+// or the command line of a server built from another tree (protocol in
+// PrincessesAndMonstersServer.cpp), one process per thread:
+//
+//     exec:old/PrincessesAndMonstersServer -t 1
+//
+// Both variants play every scenario with the same random walks of the
+// princesses and monsters and the same solver seed, sent to a server
+// with INIT, so the
+// difference of their scores is mostly the difference of the variants.
+// Scores are taken in scenario order whatever the number of threads.
+// Every look games, once min_games are in, the mean difference is tested
+// against 0 at level alpha, split evenly over all the looks a run of
+// max_games could make (the last one at max_games), and the run stops
+// at the first rejection.
+//
+// Build:
+//     make ABCompare
+
+
+// --------------------------------------------
+// ---------------  Variants  -----------------
+// --------------------------------------------
+
+
+class Variant {
+    public:
+        string f_spec;
+        string f_command; // of a server, empty in-process
+        string f_policy;
+        vector<pair<string, double>> f_parameters;
+
+        bool parse(const string &spec);
+        Player *make_player() const;
+};
+
+
+bool Variant::parse(const string &spec) {
+
+    f_spec = spec;
+    if (spec.compare(0, 5, "exec:") == 0) {
+        f_command = spec.substr(5);
+        return f_command.empty() == false;
+    }
+
+    size_t colon = spec.find(':');
+    f_policy = spec.substr(0, colon);
+    if (colon == string::npos)
+        return true;
+
+    size_t start = colon + 1;
+    while (start < spec.size()) {
+        size_t comma = spec.find(',', start);
+        string assignment = spec.substr(start, comma == string::npos ? string::npos : comma - start);
+        size_t eq = assignment.find('=');
+        if (eq == string::npos)
+            return false;
+        f_parameters.push_back(make_pair(assignment.substr(0, eq), atof(assignment.c_str() + eq + 1)));
+        start = comma == string::npos ? spec.size() : comma + 1;
+    }
+
+    return true;
+}
+
+
+Player *Variant::make_player() const {
+
+    if (f_command.empty() == false)
+        return new ServerPlayer(f_command);
+
+    LibraryPlayer *player = new LibraryPlayer();
+    player->f_policy = f_policy;
+    player->f_parameters = f_parameters;
+    return player;
+}
+
+
+// --------------------------------------------
+// -------------  Comparison  -----------------
+// --------------------------------------------
+
+
+// Scores of the games played so far, filled by the worker threads in
+// any order and read by the main thread in scenario order.
+class PairedResults {
+    public:
+        vector<double> f_a;
+        vector<double> f_b;
+        vector<char> f_done;
+        bool f_failed;
+        mutex f_mutex;
+        condition_variable f_ready;
+
+        PairedResults(int n): f_a(n), f_b(n), f_done(n, 0), f_failed(false) {}
+
+        void put(int i, double a, double b) {
+            lock_guard<mutex> lock(f_mutex);
+            f_a[i] = a;
+            f_b[i] = b;
+            f_done[i] = 1;
+            f_ready.notify_all();
+        }
+
+        void fail() {
+            lock_guard<mutex> lock(f_mutex);
+            f_failed = true;
+            f_ready.notify_all();
+        }
+
+        // False if a worker failed.
+        bool wait(int i, double &a, double &b) {
+            unique_lock<mutex> lock(f_mutex);
+            f_ready.wait(lock, [&] {return f_done[i] != 0 || f_failed == true;});
+            a = f_a[i];
+            b = f_b[i];
+            return f_done[i] != 0;
+        }
+};
+
+
+struct Summary {
+    RunningMoments f_moments;
+    P2Quantile f_q10;
+    P2Quantile f_q50;
+    P2Quantile f_q90;
+
+    Summary(): f_q10(0.1), f_q50(0.5), f_q90(0.9) {}
+
+    void add(double x) {
+        f_moments.add(x);
+        f_q10.add(x);
+        f_q50.add(x);
+        f_q90.add(x);
+    }
+
+    void print(const char *label) const {
+        printf("%-6s mean=%8.3f sd=%7.3f q10=%8.3f median=%8.3f q90=%8.3f\n", label, f_moments.f_mean,
+               sqrt(f_moments.variance()), f_q10.value(), f_q50.value(), f_q90.value());
+    }
+};
+
+
+int main(int argc, char **argv) {
+
+    vector<string> args;
+    int n_threads = thread::hardware_concurrency();
+    int max_games = 20000;
+    int min_games = 200;
+    int look = 100;
+    double alpha = 0.05;
+    for(int i = 1; i < argc; i++) {
+        string a = argv[i];
+        if (a == "-t" && i + 1 < argc)
+            n_threads = max(1, atoi(argv[++i]));
+        else if (a == "-n" && i + 1 < argc)
+            max_games = max(1, atoi(argv[++i]));
+        else if (a == "-m" && i + 1 < argc)
+            min_games = max(2, atoi(argv[++i]));
+        else if (a == "-l" && i + 1 < argc)
+            look = max(1, atoi(argv[++i]));
+        else if (a == "-a" && i + 1 < argc)
+            alpha = atof(argv[++i]);
+        else
+            args.push_back(a);
+    }
+
+    if (args.size() != 3) {
+        fprintf(stderr, "Usage: %s <corpus> <variant_a> <variant_b> [-t threads] [-n max_games] [-m min_games] [-l look] [-a alpha]\n", argv[0]);
+        return 1;
+    }
+
+    ScenarioCorpus corpus;
+    if (corpus.open(args[0]) == false) {
+        fprintf(stderr, "Cannot open %s\n", args[0].c_str());
+        return 1;
+    }
+
+    Variant variants[2];
+    for(int v = 0; v < 2; v++) {
+        if (variants[v].parse(args[1 + v]) == false) {
+            fprintf(stderr, "Cannot parse variant %s\n", args[1 + v].c_str());
+            return 1;
+        }
+    }
+
+    max_games = min(max_games, corpus.size());
+    min_games = min(min_games, max_games);
+    if (min_games < 2) {
+        fprintf(stderr, "Not enough scenarios in %s\n", args[0].c_str());
+        return 1;
+    }
+
+    int n_looks = 1 + (max_games - min_games + look - 1)/look;
+    double z_stop = normal_upper_quantile(alpha/(2*n_looks));
+
+    // SIGPIPE would kill the run when a server dies, a failed write is
+    // reported instead.
+    signal(SIGPIPE, SIG_IGN);
+
+    PairedResults results(max_games);
+    atomic<int> next(0);
+    atomic<bool> stop(false);
+    vector<thread> workers;
+    for(int t = 0; t < n_threads; t++) {
+        workers.push_back(thread([&] {
+            unique_ptr<Player> a(variants[0].make_player());
+            unique_ptr<Player> b(variants[1].make_player());
+            while (stop == false) {
+                int i = next++;
+                if (i >= max_games)
+                    break;
+
+                double score_a, score_b;
+                if (play_pair(corpus.scenario(i), *a, *b, score_a, score_b) == false) {
+                    fprintf(stderr, "Game %d failed\n", i);
+                    results.fail();
+                    break;
+                }
+                results.put(i, score_a, score_b);
+            }
+        }));
+    }
+
+    Summary a, b, diff;
+    int wins = 0, losses = 0;
+    double z = 0;
+    bool failed = false;
+    int n = 0;
+    while (n < max_games) {
+        double score_a, score_b;
+        if (results.wait(n, score_a, score_b) == false) {
+            failed = true;
+            break;
+        }
+
+        a.add(score_a);
+        b.add(score_b);
+        diff.add(score_a - score_b);
+        wins += score_a > score_b;
+        losses += score_a < score_b;
+        n++;
+
+        if ((n < min_games || (n - min_games) % look != 0) && n < max_games)
+            continue;
+
+        double se = diff.f_moments.standard_error();
+        z = se > 0 ? diff.f_moments.f_mean/se : 0.0;
+        printf("games=%d difference=%+.3f +- %.3f z=%+.2f\n", n, diff.f_moments.f_mean, se, z);
+        fflush(stdout);
+        if (fabs(z) > z_stop)
+            break;
+    }
+
+    stop = true;
+    for(thread &w : workers)
+        w.join();
+
+    if (failed == true)
+        return 1;
+
+    printf("A      %s\nB      %s\n", variants[0].f_spec.c_str(), variants[1].f_spec.c_str());
+    a.print("A");
+    b.print("B");
+    diff.print("A - B");
+
+    double se = diff.f_moments.standard_error();
+    printf("games=%d A better in %d, B better in %d, difference=%+.3f, 95%% interval [%+.3f, %+.3f]\n", n, wins, losses,
+           diff.f_moments.f_mean, diff.f_moments.f_mean - 1.96*se, diff.f_moments.f_mean + 1.96*se);
+
+    if (fabs(z) > z_stop)
+        printf("%s is better (|z| = %.2f > %.2f)\n", z > 0 ? "A" : "B", fabs(z), z_stop);
+    else
+        printf("no significant difference (|z| = %.2f <= %.2f)\n", fabs(z), z_stop);
+
+    return 0;
+}
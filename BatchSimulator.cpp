@@ -0,0 +1,167 @@
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <algorithm>
+
+#include "PrincessesAndMonsters.h"
+#include "ScenarioCorpus.h"
+#include "BatchSimulator.h"
+
+using namespace std;
+
+// Plays scenarios of a corpus (see ScenarioCorpus.h) in batches of
+// lockstep games (see BatchSimulator.h), one solver per game:
+//
+//     BatchSimulator <corpus> [first] [n_games] [-b batch_size] [-p policy] [-T turns_per_cell] [-l]
+//
+// Games of similar size share a batch, so the lanes of a batch end at
+// about the same turn. The solvers of a batch play their turns together
+// (PrincessesAndMonstersBatch), with -l one after the other; -b 1 -l is
+// the loop of one game at a time. With -T a game is cut off after
+// turns_per_cell*S^2 turns instead of S^3, which scores how fast the
+// princesses are brought out and not only whether they are. Prints the
+// score and length of every game, the mean score, the time spent in the
+// rules engine and in the solvers, and the games per second.
+//
+// Build:
+//     make BatchSimulator
+
+
+int main(int argc, char **argv) {
+
+    vector<string> args;
+    int batch_size = 64;
+    const char *policy = nullptr;
+    double turns_per_cell = 0;
+    bool one_by_one = false;
+    for(int i = 1; i < argc; i++) {
+        string a = argv[i];
+        if (a == "-b" && i + 1 < argc)
+            batch_size = max(1, atoi(argv[++i]));
+        else if (a == "-p" && i + 1 < argc)
+            policy = argv[++i];
+        else if (a == "-T" && i + 1 < argc)
+            turns_per_cell = atof(argv[++i]);
+        else if (a == "-l")
+            one_by_one = true;
+        else
+            args.push_back(a);
+    }
+
+    if (args.empty() == true) {
+        fprintf(stderr, "Usage: %s <corpus> [first] [n_games] [-b batch_size] [-p policy] [-T turns_per_cell] [-l]\n", argv[0]);
+        return 1;
+    }
+
+    ScenarioCorpus corpus;
+    if (corpus.open(args[0]) == false) {
+        fprintf(stderr, "Cannot open %s\n", args[0].c_str());
+        return 1;
+    }
+
+    int first = args.size() > 1 ? atoi(args[1].c_str()) : 0;
+    int n_games = args.size() > 2 ? atoi(args[2].c_str()) : corpus.size() - first;
+    n_games = max(0, min(n_games, corpus.size() - first));
+
+    vector<int> order(n_games);
+    for(int k = 0; k < n_games; k++)
+        order[k] = first + k;
+    stable_sort(order.begin(), order.end(), [&] (int a, int b) {return corpus.scenario(a).S < corpus.scenario(b).S;});
+
+    auto t0 = chrono::steady_clock::now();
+    PrincessesAndMonstersBatch turns;
+    double engine_seconds = 0;
+    double solver_seconds = 0;
+    double total_score = 0;
+    long long n_turns = 0;
+
+    for(int b0 = 0; b0 < n_games; b0 += batch_size) {
+
+        int n = min(batch_size, n_games - b0);
+        int max_K = 0, max_P = 0, max_M = 0;
+        for(int g = 0; g < n; g++) {
+            Scenario s = corpus.scenario(order[b0 + g]);
+            max_K = max(max_K, s.K);
+            max_P = max(max_P, s.n_princess_values/2);
+            max_M = max(max_M, s.n_monster_values/2);
+        }
+
+        GameBatch batch(n, max_K, max_P, max_M);
+        vector<unique_ptr<PrincessesAndMonstersSolver>> solvers(n);
+        for(int g = 0; g < n; g++) {
+            Scenario s = corpus.scenario(order[b0 + g]);
+            solvers[g].reset(new PrincessesAndMonstersSolver());
+            if (policy != nullptr && solvers[g]->set_policy(policy) == false) {
+                fprintf(stderr, "Unknown policy %s\n", policy);
+                return 1;
+            }
+            solvers[g]->set_seed((unsigned)s.seed);
+
+            string entrances(s.K, '0');
+            solvers[g]->initialize(s.S, s.princesses, s.n_princess_values, s.monsters, s.n_monster_values, s.K, &entrances[0]);
+            batch.add_game(g, s.S, s.princesses, s.n_princess_values, s.monsters, s.n_monster_values, s.K, entrances.c_str(), s.seed);
+            if (turns_per_cell > 0)
+                batch.set_turn_limit(g, max((int64_t)1, (int64_t)(turns_per_cell*s.S*s.S)));
+        }
+
+        vector<int> game_turns(n, 0);
+
+        // The inputs and moves of the active games, one row of max_K each.
+        vector<int> active;
+        vector<PrincessesAndMonstersSolver*> active_solvers;
+        vector<int> status(n*max_K), P(n), M(n);
+        string moves(n*max_K, 'X');
+        while (batch.number_of_active_games() > 0) {
+
+            auto t1 = chrono::steady_clock::now();
+            active.clear();
+            active_solvers.clear();
+            for(int g = 0; g < n; g++) {
+                if (batch.f_active[g] == 0)
+                    continue;
+
+                int a = active.size();
+                batch.status(g, &status[a*max_K], P[a], M[a]);
+                active.push_back(g);
+                active_solvers.push_back(solvers[g].get());
+            }
+
+            int n_active = active.size();
+            if (one_by_one == true) {
+                for(int a = 0; a < n_active; a++)
+                    active_solvers[a]->move(&status[a*max_K], P[a], M[a], 10000, &moves[a*max_K]);
+            } else {
+                turns.move(active_solvers.data(), n_active, status.data(), P.data(), M.data(), max_K, &moves[0]);
+            }
+
+            for(int a = 0; a < n_active; a++) {
+                batch.set_moves(active[a], &moves[a*max_K]);
+                game_turns[active[a]]++;
+            }
+            n_turns += n_active;
+
+            auto t2 = chrono::steady_clock::now();
+            batch.step();
+
+            solver_seconds += chrono::duration<double>(t2 - t1).count();
+            engine_seconds += chrono::duration<double>(chrono::steady_clock::now() - t2).count();
+        }
+
+        for(int g = 0; g < n; g++) {
+            Scenario s = corpus.scenario(order[b0 + g]);
+            printf("%d S=%d P=%d M=%d K=%d turns=%d rescued=%d killed=%d score=%.3f\n", order[b0 + g], s.S, batch.f_P[g], batch.f_M[g],
+                   s.K, game_turns[g], batch.f_rescued[g], batch.f_killed[g], batch.score(g));
+            total_score += batch.score(g);
+        }
+    }
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+    printf("games=%d mean score=%.3f game turns=%lld engine=%.3f s (%.1f ns per game turn) solvers=%.3f s games/s=%.2f\n",
+           n_games, n_games > 0 ? total_score/n_games : 0.0, n_turns, engine_seconds,
+           n_turns > 0 ? 1e9*engine_seconds/n_turns : 0.0, solver_seconds, seconds > 0 ? n_games/seconds : 0.0);
+
+    return 0;
+}
@@ -0,0 +1,652 @@
+#ifndef BATCH_SIMULATOR_H
+#define BATCH_SIMULATOR_H
+
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+// Rules engine that plays many games in lockstep. Every game is a
+// lane and all per entity state is stored structure of arrays style,
+// slot s of lane g at [s*f_n_lanes + g], so one AVX2 register holds
+// the same knight (princess, monster) of eight games. Games of a
+// batch may differ in S, P, M and K, unused slots are dead.
+//
+// A turn, as in the judge:
+//     knights make their moves,
+//     free princesses and monsters walk one cell N, E, W or S,
+//     escorted princesses stay with their knight,
+//     on a cell with knights and monsters the knights die if the
+//     monsters outnumber them, otherwise the monsters die,
+//     a free princess on a cell with a living knight joins it,
+//     the princesses escorted by a knight on a corner are rescued.
+// Rescued princesses leave the board: the knight's status drops and
+// so does P. A game ends once every living knight stands on a corner
+// (after the first turn), all knights are dead or its turn limit, S^3
+// unless set_turn_limit gave another, was played. The game is then
+// cleared from its lane, only its score is kept, so a game cut off by
+// a short limit scores the princesses rescued so far.
+//
+// The kernels have a scalar tail, which does all the work when built
+// without AVX2, and both draw the same random numbers, one xorshift32
+// step for every free princess and living monster of a game and turn,
+// so the walks of a game do not depend on the other games of the batch.
+
+
+// Direction codes of the moves, anything else stays.
+inline int32_t move_direction(char c) {
+    switch (c) {
+        case 'N': return 0;
+        case 'E': return 1;
+        case 'W': return 2;
+        case 'S': return 3;
+    }
+    return -1;
+}
+
+
+inline uint32_t xorshift32(uint32_t x) {
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return x;
+}
+
+
+// One cell in direction d (N is y - 1), clamped to the board.
+inline void walk_lane(int32_t &x, int32_t &y, int32_t d, int32_t S) {
+    x = std::max(std::min(x + (d == 1) - (d == 2), S - 1), 0);
+    y = std::max(std::min(y + (d == 3) - (d == 0), S - 1), 0);
+}
+
+
+#ifdef __AVX2__
+inline __m256i load_lanes(const int32_t *p) {return _mm256_loadu_si256((const __m256i*)p);}
+inline void store_lanes(int32_t *p, __m256i v) {_mm256_storeu_si256((__m256i*)p, v);}
+
+
+inline __m256i xorshift32_lanes(__m256i x) {
+    x = _mm256_xor_si256(x, _mm256_slli_epi32(x, 13));
+    x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 17));
+    return _mm256_xor_si256(x, _mm256_slli_epi32(x, 5));
+}
+
+
+// walk_lane for the lanes of moving (-1 for true).
+inline void walk_lanes(__m256i &x, __m256i &y, __m256i d, __m256i S, __m256i moving) {
+
+    __m256i zero = _mm256_setzero_si256();
+    __m256i one = _mm256_set1_epi32(1);
+    __m256i s_max = _mm256_sub_epi32(S, one);
+
+    // The comparisons are -1 where true.
+    __m256i nx = _mm256_add_epi32(_mm256_sub_epi32(x, _mm256_cmpeq_epi32(d, one)),
+                                  _mm256_cmpeq_epi32(d, _mm256_set1_epi32(2)));
+    __m256i ny = _mm256_add_epi32(_mm256_sub_epi32(y, _mm256_cmpeq_epi32(d, _mm256_set1_epi32(3))),
+                                  _mm256_cmpeq_epi32(d, zero));
+    nx = _mm256_max_epi32(_mm256_min_epi32(nx, s_max), zero);
+    ny = _mm256_max_epi32(_mm256_min_epi32(ny, s_max), zero);
+
+    x = _mm256_blendv_epi8(x, nx, moving);
+    y = _mm256_blendv_epi8(y, ny, moving);
+}
+#endif
+
+
+// Living knights (alive != 0) take their moves.
+inline void knight_walk_kernel(int32_t *x, int32_t *y, const int32_t *dir, const int32_t *alive, const int32_t *S, int n) {
+
+    int g = 0;
+
+    #ifdef __AVX2__
+    for(; g + 8 <= n; g += 8) {
+        __m256i vx = load_lanes(x + g);
+        __m256i vy = load_lanes(y + g);
+        __m256i dead = _mm256_cmpeq_epi32(load_lanes(alive + g), _mm256_setzero_si256());
+        walk_lanes(vx, vy, load_lanes(dir + g), load_lanes(S + g), _mm256_xor_si256(dead, _mm256_set1_epi32(-1)));
+        store_lanes(x + g, vx);
+        store_lanes(y + g, vy);
+    }
+    #endif
+
+    for(; g < n; g++) {
+        if (alive[g] != 0)
+            walk_lane(x[g], y[g], dir[g], S[g]);
+    }
+}
+
+
+// One princess slot: a random step of the free princesses (owner -1),
+// the escorted ones (owner >= 0) take the position of their knight,
+// which is at [owner*stride + g] of kx and ky.
+inline void princess_walk_kernel(int32_t *x, int32_t *y, const int32_t *owner, uint32_t *rng,
+                                 const int32_t *kx, const int32_t *ky, int stride, const int32_t *S, int n) {
+
+    int g = 0;
+
+    #ifdef __AVX2__
+    __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    for(; g + 8 <= n; g += 8) {
+        __m256i o = load_lanes(owner + g);
+        __m256i free_princess = _mm256_cmpeq_epi32(o, _mm256_set1_epi32(-1));
+        __m256i escorted = _mm256_cmpgt_epi32(o, _mm256_set1_epi32(-1));
+
+        __m256i r = load_lanes((const int32_t*)rng + g);
+        r = _mm256_blendv_epi8(r, xorshift32_lanes(r), free_princess);
+        store_lanes((int32_t*)rng + g, r);
+
+        __m256i vx = load_lanes(x + g);
+        __m256i vy = load_lanes(y + g);
+        walk_lanes(vx, vy, _mm256_srli_epi32(r, 30), load_lanes(S + g), free_princess);
+
+        if (_mm256_testz_si256(escorted, escorted) == 0) {
+            __m256i index = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_max_epi32(o, _mm256_setzero_si256()), _mm256_set1_epi32(stride)),
+                                             _mm256_add_epi32(lanes, _mm256_set1_epi32(g)));
+            vx = _mm256_mask_i32gather_epi32(vx, (const int*)kx, index, escorted, 4);
+            vy = _mm256_mask_i32gather_epi32(vy, (const int*)ky, index, escorted, 4);
+        }
+
+        store_lanes(x + g, vx);
+        store_lanes(y + g, vy);
+    }
+    #endif
+
+    for(; g < n; g++) {
+        if (owner[g] == -1) {
+            rng[g] = xorshift32(rng[g]);
+            walk_lane(x[g], y[g], rng[g] >> 30, S[g]);
+        } else if (owner[g] >= 0) {
+            x[g] = kx[owner[g]*stride + g];
+            y[g] = ky[owner[g]*stride + g];
+        }
+    }
+}
+
+
+// One monster slot: a random step of the living monsters.
+inline void monster_walk_kernel(int32_t *x, int32_t *y, const int32_t *alive, uint32_t *rng, const int32_t *S, int n) {
+
+    int g = 0;
+
+    #ifdef __AVX2__
+    for(; g + 8 <= n; g += 8) {
+        __m256i dead = _mm256_cmpeq_epi32(load_lanes(alive + g), _mm256_setzero_si256());
+
+        __m256i r = load_lanes((const int32_t*)rng + g);
+        r = _mm256_blendv_epi8(xorshift32_lanes(r), r, dead);
+        store_lanes((int32_t*)rng + g, r);
+
+        __m256i vx = load_lanes(x + g);
+        __m256i vy = load_lanes(y + g);
+        walk_lanes(vx, vy, _mm256_srli_epi32(r, 30), load_lanes(S + g), _mm256_xor_si256(dead, _mm256_set1_epi32(-1)));
+        store_lanes(x + g, vx);
+        store_lanes(y + g, vy);
+    }
+    #endif
+
+    for(; g < n; g++) {
+        if (alive[g] == 0)
+            continue;
+
+        rng[g] = xorshift32(rng[g]);
+        walk_lane(x[g], y[g], rng[g] >> 30, S[g]);
+    }
+}
+
+
+// cell = y*S + x for the lanes with mask == value, -1 for the others.
+inline void cell_kernel(const int32_t *x, const int32_t *y, const int32_t *mask, int32_t value,
+                        const int32_t *S, int32_t *cell, int n) {
+
+    int g = 0;
+
+    #ifdef __AVX2__
+    for(; g + 8 <= n; g += 8) {
+        __m256i c = _mm256_add_epi32(_mm256_mullo_epi32(load_lanes(y + g), load_lanes(S + g)), load_lanes(x + g));
+        __m256i on = _mm256_cmpeq_epi32(load_lanes(mask + g), _mm256_set1_epi32(value));
+        store_lanes(cell + g, _mm256_or_si256(c, _mm256_xor_si256(on, _mm256_set1_epi32(-1))));
+    }
+    #endif
+
+    for(; g < n; g++)
+        cell[g] = mask[g] == value ? y[g]*S[g] + x[g] : -1;
+}
+
+
+// hit[g] = 1 if cell[g] >= 0 and bit cell[g] of the occupancy bitmap
+// of lane g, words [g*words_per_lane, (g + 1)*words_per_lane), is set.
+inline void occupied_kernel(const uint32_t *bits, int words_per_lane, const int32_t *cell, int32_t *hit, int n) {
+
+    int g = 0;
+
+    #ifdef __AVX2__
+    __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i one = _mm256_set1_epi32(1);
+    for(; g + 8 <= n; g += 8) {
+        __m256i c = load_lanes(cell + g);
+        __m256i on_board = _mm256_cmpgt_epi32(c, _mm256_set1_epi32(-1));
+        __m256i index = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_add_epi32(lanes, _mm256_set1_epi32(g)),
+                                                            _mm256_set1_epi32(words_per_lane)),
+                                         _mm256_srai_epi32(c, 5));
+        __m256i words = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), (const int*)bits, index, on_board, 4);
+        __m256i bit = _mm256_and_si256(_mm256_srlv_epi32(words, _mm256_and_si256(c, _mm256_set1_epi32(31))), one);
+        store_lanes(hit + g, _mm256_and_si256(bit, on_board));
+    }
+    #endif
+
+    for(; g < n; g++) {
+        if (cell[g] < 0) {
+            hit[g] = 0;
+            continue;
+        }
+        hit[g] = (bits[g*words_per_lane + (cell[g] >> 5)] >> (cell[g] & 31)) & 1;
+    }
+}
+
+
+// --------------------------------------------
+// --------------  Game Batch  ----------------
+// --------------------------------------------
+
+
+class GameBatch {
+    public:
+        int f_n_lanes; // multiple of 8
+        int f_turn;
+
+        // Per lane.
+        std::vector<int32_t> f_S;
+        std::vector<int32_t> f_K;
+        std::vector<int32_t> f_P;
+        std::vector<int32_t> f_M;
+        std::vector<int32_t> f_active; // 1 while the game runs
+        std::vector<int32_t> f_killed;
+        std::vector<int32_t> f_rescued;
+        std::vector<int64_t> f_turn_limit;
+        std::vector<uint32_t> f_rng;
+
+        // Per block of eight lanes, the largest K, P and M of its games.
+        std::vector<int32_t> f_block_K;
+        std::vector<int32_t> f_block_P;
+        std::vector<int32_t> f_block_M;
+
+        // Per slot and lane. Princess owners are a knight, -1 for free
+        // princesses, -2 for unused slots and -3 for rescued princesses.
+        std::vector<int32_t> f_kx, f_ky, f_k_alive, f_k_dir, f_k_cell;
+        std::vector<int32_t> f_px, f_py, f_p_owner, f_p_cell;
+        std::vector<int32_t> f_mx, f_my, f_m_alive, f_m_cell;
+
+        // Scratch for a block of eight lanes.
+        int32_t f_hit[8];
+        std::vector<int32_t> f_knight_dies;
+
+        // Cells with living knights, one bitmap per lane of a block.
+        int f_words_per_lane;
+        std::vector<uint32_t> f_knight_bits;
+
+        GameBatch(int n_games, int max_K, int max_P, int max_M);
+
+        // Coordinates are (row, column) pairs as in the judge protocol,
+        // entrances as returned by the solver.
+        void add_game(int g, int S, const int *princesses, int n_princess_values,
+                      const int *monsters, int n_monster_values, int K, const char *entrances, uint64_t seed);
+
+        // The judge input of the next turn.
+        void status(int g, int *status, int &P, int &M);
+        void set_moves(int g, const char *moves);
+        void set_turn_limit(int g, int64_t turns) {f_turn_limit[g] = turns;}
+        void step();
+
+        int number_of_active_games();
+        double score(int g);
+
+    private:
+        void step_block(int g0);
+        void mark_knights(int g0);
+        void fight(int g0);
+        void join_knights(int g0);
+        void rescue(int g0);
+        void end_games();
+        bool on_corner(int g, int x, int y) {return (x == 0 || x == f_S[g] - 1) && (y == 0 || y == f_S[g] - 1);}
+};
+
+
+inline GameBatch::GameBatch(int n_games, int max_K, int max_P, int max_M) {
+
+    f_n_lanes = (n_games + 7)/8*8;
+    f_turn = 0;
+
+    int n = f_n_lanes;
+    f_S.assign(n, 1);
+    f_K.assign(n, 0);
+    f_P.assign(n, 0);
+    f_M.assign(n, 0);
+    f_active.assign(n, 0);
+    f_killed.assign(n, 0);
+    f_rescued.assign(n, 0);
+    f_turn_limit.assign(n, 0);
+    f_rng.assign(n, 1);
+    f_block_K.assign(n/8, 0);
+    f_block_P.assign(n/8, 0);
+    f_block_M.assign(n/8, 0);
+
+    f_kx.assign(max_K*n, 0);
+    f_ky.assign(max_K*n, 0);
+    f_k_alive.assign(max_K*n, 0);
+    f_k_dir.assign(max_K*n, -1);
+    f_k_cell.assign(max_K*n, -1);
+
+    f_px.assign(max_P*n, 0);
+    f_py.assign(max_P*n, 0);
+    f_p_owner.assign(max_P*n, -2);
+    f_p_cell.assign(max_P*n, -1);
+
+    f_mx.assign(max_M*n, 0);
+    f_my.assign(max_M*n, 0);
+    f_m_alive.assign(max_M*n, 0);
+    f_m_cell.assign(max_M*n, -1);
+
+    f_knight_dies.resize(max_K*8);
+    f_words_per_lane = 0;
+}
+
+
+inline void GameBatch::add_game(int g, int S, const int *princesses, int n_princess_values,
+                                const int *monsters, int n_monster_values, int K, const char *entrances, uint64_t seed) {
+
+    int n = f_n_lanes;
+    if ((S*S + 31)/32 > f_words_per_lane) {
+        f_words_per_lane = (S*S + 31)/32;
+        f_knight_bits.resize(8*f_words_per_lane);
+    }
+
+    f_S[g] = S;
+    f_K[g] = K;
+    f_P[g] = n_princess_values/2;
+    f_M[g] = n_monster_values/2;
+    f_block_K[g/8] = std::max(f_block_K[g/8], f_K[g]);
+    f_block_P[g/8] = std::max(f_block_P[g/8], f_P[g]);
+    f_block_M[g/8] = std::max(f_block_M[g/8], f_M[g]);
+    f_active[g] = 1;
+    f_turn_limit[g] = (int64_t)S*S*S;
+    f_rng[g] = uint32_t(seed ^ (seed >> 32));
+    if (f_rng[g] == 0)
+        f_rng[g] = 1;
+
+    for(int j = 0; j < f_P[g]; j++) {
+        f_py[j*n + g] = princesses[2*j];
+        f_px[j*n + g] = princesses[2*j + 1];
+        f_p_owner[j*n + g] = -1;
+    }
+
+    for(int j = 0; j < f_M[g]; j++) {
+        f_my[j*n + g] = monsters[2*j];
+        f_mx[j*n + g] = monsters[2*j + 1];
+        f_m_alive[j*n + g] = 1;
+    }
+
+    // Entrances 0..3 are the corners top left, top right, bottom
+    // right and bottom left.
+    for(int i = 0; i < K; i++) {
+        int e = entrances[i] - '0';
+        f_kx[i*n + g] = (e == 1 || e == 2) ? S - 1 : 0;
+        f_ky[i*n + g] = (e == 2 || e == 3) ? S - 1 : 0;
+        f_k_alive[i*n + g] = 1;
+    }
+}
+
+
+inline void GameBatch::status(int g, int *status, int &P, int &M) {
+
+    int n = f_n_lanes;
+    for(int i = 0; i < f_K[g]; i++)
+        status[i] = f_k_alive[i*n + g] == 1 ? 0 : -1;
+
+    for(int j = 0; j < f_P[g]; j++) {
+        if (f_p_owner[j*n + g] >= 0)
+            status[f_p_owner[j*n + g]]++;
+    }
+
+    P = f_P[g] - f_rescued[g];
+    M = 0;
+    for(int j = 0; j < f_M[g]; j++)
+        M += f_m_alive[j*n + g];
+}
+
+
+inline void GameBatch::set_moves(int g, const char *moves) {
+
+    for(int i = 0; i < f_K[g]; i++)
+        f_k_dir[i*f_n_lanes + g] = move_direction(moves[i]);
+}
+
+
+inline void GameBatch::step() {
+
+    f_turn++;
+
+    // Blocks of eight finished games are skipped.
+    for(int g0 = 0; g0 < f_n_lanes; g0 += 8) {
+        int n_active = 0;
+        for(int g = g0; g < g0 + 8; g++)
+            n_active += f_active[g];
+
+        if (n_active > 0)
+            step_block(g0);
+    }
+
+    end_games();
+}
+
+
+inline void GameBatch::step_block(int g0) {
+
+    int n = f_n_lanes;
+    const int32_t *S = &f_S[g0];
+    int n_K = f_block_K[g0/8];
+    int n_P = f_block_P[g0/8];
+    int n_M = f_block_M[g0/8];
+
+    for(int i = 0; i < n_K; i++)
+        knight_walk_kernel(&f_kx[i*n + g0], &f_ky[i*n + g0], &f_k_dir[i*n + g0], &f_k_alive[i*n + g0], S, 8);
+
+    for(int j = 0; j < n_P; j++)
+        princess_walk_kernel(&f_px[j*n + g0], &f_py[j*n + g0], &f_p_owner[j*n + g0], &f_rng[g0],
+                             &f_kx[g0], &f_ky[g0], n, S, 8);
+
+    for(int j = 0; j < n_M; j++)
+        monster_walk_kernel(&f_mx[j*n + g0], &f_my[j*n + g0], &f_m_alive[j*n + g0], &f_rng[g0], S, 8);
+
+    fight(g0);
+    join_knights(g0);
+    rescue(g0);
+}
+
+
+// Computes the knight cells of the block and their bitmaps.
+inline void GameBatch::mark_knights(int g0) {
+
+    int n = f_n_lanes;
+    int n_K = f_block_K[g0/8];
+    std::fill(f_knight_bits.begin(), f_knight_bits.end(), 0);
+
+    for(int i = 0; i < n_K; i++) {
+        cell_kernel(&f_kx[i*n + g0], &f_ky[i*n + g0], &f_k_alive[i*n + g0], 1, &f_S[g0], &f_k_cell[i*n + g0], 8);
+
+        for(int g = 0; g < 8; g++) {
+            int c = f_k_cell[i*n + g0 + g];
+            if (c >= 0)
+                f_knight_bits[g*f_words_per_lane + (c >> 5)] |= 1u << (c & 31);
+        }
+    }
+}
+
+
+inline void GameBatch::fight(int g0) {
+
+    int n = f_n_lanes;
+    int n_K = f_block_K[g0/8];
+    int n_P = f_block_P[g0/8];
+    int n_M = f_block_M[g0/8];
+
+    // Monsters are looked up in the knight bitmaps, the few that share
+    // a cell with knights are resolved one lane at a time. Both sides
+    // are counted before anybody dies.
+    mark_knights(g0);
+    std::fill(f_knight_dies.begin(), f_knight_dies.end(), 0);
+
+    for(int j = 0; j < n_M; j++)
+        cell_kernel(&f_mx[j*n + g0], &f_my[j*n + g0], &f_m_alive[j*n + g0], 1, &f_S[g0], &f_m_cell[j*n + g0], 8);
+
+    for(int j = 0; j < n_M; j++) {
+        occupied_kernel(f_knight_bits.data(), f_words_per_lane, &f_m_cell[j*n + g0], f_hit, 8);
+
+        for(int g = 0; g < 8; g++) {
+            if (f_hit[g] == 0)
+                continue;
+
+            int c = f_m_cell[j*n + g0 + g];
+            int n_knights = 0;
+            for(int i = 0; i < f_K[g0 + g]; i++)
+                n_knights += f_k_cell[i*n + g0 + g] == c;
+            int n_monsters = 0;
+            for(int m = 0; m < f_M[g0 + g]; m++)
+                n_monsters += f_m_cell[m*n + g0 + g] == c;
+
+            if (n_monsters > n_knights) {
+                for(int i = 0; i < f_K[g0 + g]; i++) {
+                    if (f_k_cell[i*n + g0 + g] == c)
+                        f_knight_dies[i*8 + g] = 1;
+                }
+            } else {
+                f_m_alive[j*n + g0 + g] = 0;
+                f_killed[g0 + g]++;
+            }
+        }
+    }
+
+    int n_dead = 0;
+    for(int i = 0; i < n_K; i++) {
+        for(int g = 0; g < 8; g++) {
+            f_k_alive[i*n + g0 + g] -= f_knight_dies[i*8 + g];
+            n_dead += f_knight_dies[i*8 + g];
+        }
+    }
+    if (n_dead == 0)
+        return;
+
+    // The princesses of dead knights are free again.
+    for(int j = 0; j < n_P; j++) {
+        for(int g = g0; g < g0 + 8; g++) {
+            int o = f_p_owner[j*n + g];
+            if (o >= 0 && f_k_alive[o*n + g] == 0)
+                f_p_owner[j*n + g] = -1;
+        }
+    }
+}
+
+
+// Free princesses join the lowest numbered knight on their cell.
+inline void GameBatch::join_knights(int g0) {
+
+    int n = f_n_lanes;
+    int n_P = f_block_P[g0/8];
+    mark_knights(g0);
+
+    for(int j = 0; j < n_P; j++) {
+        cell_kernel(&f_px[j*n + g0], &f_py[j*n + g0], &f_p_owner[j*n + g0], -1, &f_S[g0], &f_p_cell[j*n + g0], 8);
+        occupied_kernel(f_knight_bits.data(), f_words_per_lane, &f_p_cell[j*n + g0], f_hit, 8);
+
+        for(int g = 0; g < 8; g++) {
+            if (f_hit[g] == 0)
+                continue;
+
+            int c = f_p_cell[j*n + g0 + g];
+            for(int i = 0; i < f_K[g0 + g]; i++) {
+                if (f_k_cell[i*n + g0 + g] == c) {
+                    f_p_owner[j*n + g0 + g] = i;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+
+// Escorted princesses whose knight stands on a corner leave the board.
+inline void GameBatch::rescue(int g0) {
+
+    int n = f_n_lanes;
+    int n_P = f_block_P[g0/8];
+
+    for(int j = 0; j < n_P; j++) {
+        for(int g = g0; g < g0 + 8; g++) {
+            int o = f_p_owner[j*n + g];
+            if (o >= 0 && on_corner(g, f_kx[o*n + g], f_ky[o*n + g]) == true) {
+                f_p_owner[j*n + g] = -3;
+                f_rescued[g]++;
+            }
+        }
+    }
+}
+
+
+inline void GameBatch::end_games() {
+
+    int n = f_n_lanes;
+    for(int g = 0; g < n; g++) {
+        if (f_active[g] == 0)
+            continue;
+
+        int n_alive = 0;
+        bool all_on_corners = true;
+        for(int i = 0; i < f_K[g]; i++) {
+            if (f_k_alive[i*n + g] == 0)
+                continue;
+            n_alive++;
+            if (on_corner(g, f_kx[i*n + g], f_ky[i*n + g]) == false)
+                all_on_corners = false;
+        }
+
+        if (n_alive > 0 && (all_on_corners == false || f_turn == 1) && f_turn < f_turn_limit[g])
+            continue;
+
+        f_active[g] = 0;
+
+        // Nothing of a finished game moves, fights or draws random
+        // numbers any more.
+        for(int i = 0; i < f_K[g]; i++)
+            f_k_alive[i*n + g] = 0;
+        for(int j = 0; j < f_P[g]; j++)
+            f_p_owner[j*n + g] = -2;
+        for(int j = 0; j < f_M[g]; j++)
+            f_m_alive[j*n + g] = 0;
+    }
+}
+
+
+inline int GameBatch::number_of_active_games() {
+
+    int n_active = 0;
+    for(int g = 0; g < f_n_lanes; g++)
+        n_active += f_active[g];
+
+    return n_active;
+}
+
+
+inline double GameBatch::score(int g) {
+
+    double score = 0;
+    if (f_P[g] > 0)
+        score = score + 100.0*f_rescued[g]/f_P[g];
+    if (f_M[g] > 0)
+        score = score + 10.0*f_killed[g]/f_M[g];
+
+    return score;
+}
+
+#endif
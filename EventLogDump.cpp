@@ -0,0 +1,186 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <map>
+
+using namespace std;
+
+// Prints the event log of a solver built with -DLOG_LEVEL=1 or 2
+// (PAM_EVENT_LOG or set_event_log), one event per line:
+//
+//     EventLogDump <log> [-p] [-t first_turn] [-T last_turn] [-e event]
+//
+// The file is "PAME", a uint32_t version and 32 byte records:
+//
+//     uint16_t type, uint16_t source, int32_t turn, uint32_t values[6]
+//
+// A value is an int32_t or the bits of a float, by type (EVENTS below,
+// in the order of EventType in the solver). Source 0 is the solver, g + 1
+// its speculative guess g, played while it waited for the judge. With
+// -p only the events of the turns actually played are printed: those of
+// source 0, and of the guess an EVENT_SPECULATION of the turn before names.
+// The last record, EVENT_LOG_END, counts the events dropped on a full ring
+// and those lost by failed writes.
+//
+// Build:
+//     g++ -O2 -o EventLogDump EventLogDump.cpp
+
+
+struct LogEvent {
+    uint16_t f_type;
+    uint16_t f_source;
+    int32_t f_turn;
+    uint32_t f_values[6];
+};
+
+
+// The kind of a field is its first character: i an int, f a float,
+// o an order, c a move.
+struct EventDescription {
+    const char *f_name;
+    vector<const char*> f_fields;
+};
+
+
+const vector<EventDescription> EVENTS = {
+    {"init", {"iS", "iP", "iM", "iK"}},
+    {"princess", {"iid", "ix", "iy"}},
+    {"monster", {"iid", "ix", "iy"}},
+    {"knight", {"iid", "ix", "iy", "in_p", "oorder", "cmove"}},
+    {"groups", {"iknights_per_group", "igroups"}},
+    {"group_member", {"igroup", "iknight"}},
+    {"center_of_mass", {"ix", "iy"}},
+    {"assembly_point", {"ix", "iy", "imedian_x", "imedian_y", "fcost", "fcost_median"}},
+    {"routes", {"ilength"}},
+    {"global_order", {"oorder"}},
+    {"search_sectors", {"isectors_per_side"}},
+    {"dispersal", {"fpickup_rate", "fbest_pickup_rate", "floss_rate", "fstay_probability", "fdisperse_fraction"}},
+    {"coverage", {"ivisited"}},
+    {"deployment", {"iknights", "iblocks", "iwaves", "iwave_size", "iwave_interval"}},
+    {"wave", {"idispersed", "imax_dispersed"}},
+    {"squad", {"isquad", "ilane_x0", "istrength", "frate", "fcost_of_staying"}},
+    {"hunt", {"isquads", "iactive", "imean_strength", "iwidth"}},
+    {"turn", {"iP", "iM", "iescorted"}},
+    {"speculation", {"iguess", "ihits", "imisses"}},
+    {"log_end", {"idropped", "iwrite_errors"}},
+};
+
+const int EVENT_SPECULATION = 18;
+const int EVENT_LOG_END = 19;
+
+const vector<string> ORDER_NAMES = {
+    "MOVE_TO_PRINCESS_CENTER_OF_MASS", "INITIALLY_DISPERSED", "RANDOM_PRINCESS_SEARCH",
+    "RETURN_TO_GLOBAL_ASSEMBLY_POINT", "GUARD_CONVOY", "FINAL_RETURN_TO_GLOBAL_ASSEMBLY_POINT",
+    "KILL_MONSTERS", "GO_TO_EXIT", "DO_NOTHING"};
+
+
+void print_event(const LogEvent &e) {
+
+    if (e.f_type >= EVENTS.size()) {
+        printf("%6d %3d unknown_%d\n", e.f_turn, e.f_source, e.f_type);
+        return;
+    }
+
+    const EventDescription &d = EVENTS[e.f_type];
+    printf("%6d %3d %-15s", e.f_turn, e.f_source, d.f_name);
+    for(size_t i = 0; i < d.f_fields.size(); i++) {
+        const char *field = d.f_fields[i];
+        uint32_t u = e.f_values[i];
+        if (field[0] == 'f') {
+            float f;
+            memcpy(&f, &u, sizeof(f));
+            printf(" %s=%g", field + 1, f);
+        } else if (field[0] == 'o') {
+            printf(" %s=%s", field + 1, u < ORDER_NAMES.size() ? ORDER_NAMES[u].c_str() : "NONE");
+        } else if (field[0] == 'c') {
+            printf(" %s=%c", field + 1, u >= 32 && u < 127 ? (char)u : '-');
+        } else {
+            printf(" %s=%d", field + 1, (int32_t)u);
+        }
+    }
+    printf("\n");
+}
+
+
+int main(int argc, char **argv) {
+
+    string path;
+    bool played = false;
+    int first_turn = 0;
+    int last_turn = 1 << 30;
+    int type = -1;
+    for(int i = 1; i < argc; i++) {
+        string a = argv[i];
+        if (a == "-p") {
+            played = true;
+        } else if (a == "-t" && i + 1 < argc) {
+            first_turn = atoi(argv[++i]);
+        } else if (a == "-T" && i + 1 < argc) {
+            last_turn = atoi(argv[++i]);
+        } else if (a == "-e" && i + 1 < argc) {
+            string name = argv[++i];
+            for(size_t t = 0; t < EVENTS.size(); t++) {
+                if (name == EVENTS[t].f_name)
+                    type = t;
+            }
+            if (type < 0) {
+                fprintf(stderr, "Unknown event %s\n", name.c_str());
+                return 1;
+            }
+        } else {
+            path = a;
+        }
+    }
+
+    if (path.empty() == true) {
+        fprintf(stderr, "Usage: %s <log> [-p] [-t first_turn] [-T last_turn] [-e event]\n", argv[0]);
+        return 1;
+    }
+
+    FILE *f = fopen(path.c_str(), "rb");
+    if (f == nullptr) {
+        fprintf(stderr, "Cannot open %s\n", path.c_str());
+        return 1;
+    }
+
+    char magic[4];
+    uint32_t version;
+    if (fread(magic, 1, 4, f) != 4 || memcmp(magic, "PAME", 4) != 0 ||
+        fread(&version, sizeof(version), 1, f) != 1 || version != 1) {
+        fprintf(stderr, "%s is not an event log\n", path.c_str());
+        fclose(f);
+        return 1;
+    }
+
+    vector<LogEvent> events;
+    LogEvent e;
+    while (fread(&e, sizeof(e), 1, f) == 1)
+        events.push_back(e);
+    fclose(f);
+
+    // The solver tells which guess played turn t + 1 when the reply to
+    // turn t arrives.
+    map<int, int> played_source;
+    for(const LogEvent &e : events) {
+        if (e.f_type == EVENT_SPECULATION && e.f_source == 0 && (int32_t)e.f_values[0] >= 0)
+            played_source[e.f_turn + 1] = (int32_t)e.f_values[0] + 1;
+    }
+
+    for(const LogEvent &e : events) {
+        if (e.f_type != EVENT_LOG_END && (e.f_turn < first_turn || e.f_turn > last_turn))
+            continue;
+        if (type >= 0 && e.f_type != type && e.f_type != EVENT_LOG_END)
+            continue;
+        if (played == true && e.f_source != 0) {
+            auto it = played_source.find(e.f_turn);
+            if (it == played_source.end() || it->second != e.f_source)
+                continue;
+        }
+        print_event(e);
+    }
+
+    return 0;
+}
@@ -0,0 +1,146 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+#include "PrincessesAndMonsters.h"
+#include "ScenarioCorpus.h"
+
+using namespace std;
+
+// Plays random scenarios against random judge replies and checks every
+// reply of the solver:
+//
+//     InvariantFuzzer [n_games] [seed] [max_turns] [threads] [max_S]
+//
+// Boards are drawn up to max_S (default 128) instead of the 50 of the
+// problem statement, so that about half of them are wider than 64 and
+// play on the tiled coverage map.
+//
+// Knights pick up princesses, die and kill monsters at random, so the
+// solver sees statuses no real game would produce. Outside it checks
+// that a reply has exactly K moves from NEWSX; built with
+// -DCHECK_INVARIANTS=1 the solver also asserts that its tracked
+// knights follow the replies and compares its kernels with their
+// reference versions.
+//
+// The solver is seeded from seed, so a run prints the same digest of
+// all replies every time. Two builds that differ only in an optimized
+// kernel (e.g. with and without -mavx2), or run on a different number
+// of threads, must print the same digest.
+//
+// Build:
+//     make InvariantFuzzer
+
+
+bool valid_move(char c) {
+    return c == 'N' || c == 'E' || c == 'W' || c == 'S' || c == 'X';
+}
+
+
+// Returns the number of turns played, 0 if a reply was broken.
+int fuzz_game(ScenarioGenerator &generator, mt19937 &gen, int max_turns, int n_threads, uint64_t &digest) {
+
+    int S, K;
+    vector<int> princesses, monsters;
+    uint64_t seed;
+    generator.generate(S, K, princesses, monsters, seed);
+    int P = princesses.size()/2;
+    int M = monsters.size()/2;
+
+    PrincessesAndMonstersSolver solver;
+    solver.set_seed(seed);
+    solver.set_threads(n_threads);
+
+    string entrances(K, '?');
+    solver.initialize(S, princesses.data(), princesses.size(), monsters.data(), monsters.size(), K, &entrances[0]);
+    for(int i = 0; i < K; i++) {
+        if (entrances[i] < '0' || entrances[i] > '3') {
+            fprintf(stderr, "S=%d K=%d: bad entrance '%c' of knight %d\n", S, K, entrances[i], i);
+            return 0;
+        }
+    }
+
+    // One guard character after the K moves catches overlong replies.
+    vector<int> status(K, 0);
+    string moves(K + 1, '#');
+    int free_princesses = P;
+    uniform_real_distribution<double> uniform(0.0, 1.0);
+
+    int t = 0;
+    while (t < max_turns) {
+
+        moves.assign(K + 1, '#');
+        solver.move(status.data(), P, M, 10000, &moves[0]);
+
+        for(int i = 0; i < K; i++) {
+            if (valid_move(moves[i]) == false || (status[i] < 0 && moves[i] != 'X')) {
+                fprintf(stderr, "S=%d K=%d turn %d: bad move '%c' of knight %d (status %d)\n", S, K, t, moves[i], i, status[i]);
+                return 0;
+            }
+        }
+        if (moves[K] != '#') {
+            fprintf(stderr, "S=%d K=%d turn %d: reply longer than K\n", S, K, t);
+            return 0;
+        }
+
+        for(int i = 0; i < K; i++)
+            digest = (digest ^ (unsigned char)moves[i])*1099511628211ULL;
+        t++;
+
+        // Random outcome of the turn.
+        int alive = 0;
+        for(int i = 0; i < K; i++) {
+            if (status[i] < 0)
+                continue;
+
+            double u = uniform(gen);
+            if (u < 0.0005) {
+                free_princesses += status[i];
+                status[i] = -1;
+                continue;
+            } else if (u < 0.02 && free_princesses > 0) {
+                status[i]++;
+                free_princesses--;
+            }
+            alive++;
+        }
+        if (M > 0 && uniform(gen) < 0.01)
+            M--;
+
+        if (alive == 0)
+            break;
+    }
+
+    return t;
+}
+
+
+int main(int argc, char **argv) {
+
+    int n_games = argc > 1 ? atoi(argv[1]) : 1000;
+    uint64_t seed = argc > 2 ? strtoull(argv[2], nullptr, 10) : 1;
+    int max_turns = argc > 3 ? atoi(argv[3]) : 2000;
+    int n_threads = argc > 4 ? atoi(argv[4]) : 1;
+    int max_S = argc > 5 ? atoi(argv[5]) : 128;
+
+    ScenarioGenerator generator(seed, max(10, max_S));
+    mt19937 gen(seed);
+    uint64_t digest = 14695981039346656037ULL;
+    long long n_turns = 0;
+
+    for(int g = 0; g < n_games; g++) {
+        int turns = fuzz_game(generator, gen, max_turns, n_threads, digest);
+        if (turns == 0) {
+            fprintf(stderr, "game %d failed\n", g);
+            return 1;
+        }
+        n_turns += turns;
+    }
+
+    printf("games=%d turns=%lld digest=%016llx\n", n_games, n_turns, (unsigned long long)digest);
+    return 0;
+}
@@ -0,0 +1,207 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "ScenarioCorpus.h"
+#include "BatchSimulator.h"
+
+using namespace std;
+
+// Plays scenarios of a corpus (see ScenarioCorpus.h) against a solver
+// process speaking the judge protocol on stdin and stdout, and reports
+// how long it takes to reply to a turn, from the status sent to the
+// moves read:
+//
+//     JudgeLatency <corpus> <first> <n_games> <command> [-d judge_us] [-n turns]
+//
+// The rules engine (BatchSimulator.h) plays the judge. It takes a few
+// microseconds per turn, -d adds judge_us of waiting after every reply,
+// as a slower judge would. -n ends every game after that many turns, for
+// boards beyond the statement whose games last millions of turns. The
+// solver gets PAM_SEED=<scenario seed>, so the moves, and their digest,
+// repeat:
+//
+//     JudgeLatency corpus.bin 0 20 "PAM_SPECULATE=0 ./PrincessesAndMonsters"
+//     JudgeLatency corpus.bin 0 20 "PAM_SPECULATE=1 ./PrincessesAndMonsters"
+//
+// Build:
+//     g++ -O2 -o JudgeLatency JudgeLatency.cpp
+
+
+// The solver process of one game.
+class SolverProcess {
+    public:
+        pid_t f_pid;
+        FILE *f_to;
+        FILE *f_from;
+
+        SolverProcess(const string &command);
+        ~SolverProcess();
+
+        bool read_line(string &line);
+};
+
+
+SolverProcess::SolverProcess(const string &command): f_pid(-1), f_to(nullptr), f_from(nullptr) {
+
+    int to_child[2], from_child[2];
+    if (pipe(to_child) != 0 || pipe(from_child) != 0)
+        return;
+
+    f_pid = fork();
+    if (f_pid == 0) {
+        dup2(to_child[0], 0);
+        dup2(from_child[1], 1);
+        close(to_child[0]);
+        close(to_child[1]);
+        close(from_child[0]);
+        close(from_child[1]);
+        execl("/bin/sh", "sh", "-c", command.c_str(), (char*)nullptr);
+        _exit(127);
+    }
+
+    close(to_child[0]);
+    close(from_child[1]);
+    f_to = fdopen(to_child[1], "w");
+    f_from = fdopen(from_child[0], "r");
+}
+
+
+SolverProcess::~SolverProcess() {
+
+    // The solver ends at the end of its input.
+    if (f_to != nullptr)
+        fclose(f_to);
+    if (f_from != nullptr)
+        fclose(f_from);
+    if (f_pid > 0)
+        waitpid(f_pid, nullptr, 0);
+}
+
+
+bool SolverProcess::read_line(string &line) {
+
+    line.clear();
+    int c;
+    while ((c = fgetc(f_from)) != EOF && c != '\n')
+        line.push_back(c);
+
+    return c != EOF;
+}
+
+
+// Plays scenario s, adds the latency of every turn in microseconds to
+// latencies and the moves to digest. False if the solver failed.
+bool play_game(const Scenario &s, const string &command, int judge_us, int max_turns, vector<double> &latencies, uint64_t &digest) {
+
+    SolverProcess solver("PAM_SEED=" + to_string((unsigned)s.seed) + " " + command);
+    if (solver.f_to == nullptr || solver.f_from == nullptr)
+        return false;
+
+    string m = to_string(s.S) + "\n" + to_string(s.n_princess_values) + "\n";
+    for(int i = 0; i < s.n_princess_values; i++)
+        m += to_string(s.princesses[i]) + "\n";
+    m += to_string(s.n_monster_values) + "\n";
+    for(int i = 0; i < s.n_monster_values; i++)
+        m += to_string(s.monsters[i]) + "\n";
+    m += to_string(s.K) + "\n";
+
+    string reply;
+    if (fputs(m.c_str(), solver.f_to) < 0 || fflush(solver.f_to) != 0 ||
+        solver.read_line(reply) == false || (int)reply.size() < s.K)
+        return false;
+
+    GameBatch batch(1, s.K, s.n_princess_values/2, s.n_monster_values/2);
+    batch.add_game(0, s.S, s.princesses, s.n_princess_values, s.monsters, s.n_monster_values, s.K, reply.c_str(), s.seed);
+    if (max_turns > 0)
+        batch.set_turn_limit(0, max_turns);
+
+    vector<int> status(s.K);
+    while (batch.number_of_active_games() > 0) {
+
+        int P, M;
+        batch.status(0, status.data(), P, M);
+        m = to_string(s.K) + "\n";
+        for(int i = 0; i < s.K; i++)
+            m += to_string(status[i]) + "\n";
+        m += to_string(P) + "\n" + to_string(M) + "\n10000\n";
+
+        auto t0 = chrono::steady_clock::now();
+        if (fputs(m.c_str(), solver.f_to) < 0 || fflush(solver.f_to) != 0 ||
+            solver.read_line(reply) == false || (int)reply.size() < s.K)
+            return false;
+        latencies.push_back(chrono::duration<double, micro>(chrono::steady_clock::now() - t0).count());
+
+        for(int i = 0; i < s.K; i++)
+            digest = (digest ^ (unsigned char)reply[i])*1099511628211ULL;
+
+        batch.set_moves(0, reply.c_str());
+        batch.step();
+        if (judge_us > 0)
+            this_thread::sleep_for(chrono::microseconds(judge_us));
+    }
+
+    return true;
+}
+
+
+int main(int argc, char **argv) {
+
+    vector<string> args;
+    int judge_us = 0;
+    int max_turns = 0;
+    for(int i = 1; i < argc; i++) {
+        string a = argv[i];
+        if (a == "-d" && i + 1 < argc)
+            judge_us = max(0, atoi(argv[++i]));
+        else if (a == "-n" && i + 1 < argc)
+            max_turns = max(0, atoi(argv[++i]));
+        else
+            args.push_back(a);
+    }
+
+    if (args.size() != 4) {
+        fprintf(stderr, "Usage: %s <corpus> <first> <n_games> <command> [-d judge_us] [-n turns]\n", argv[0]);
+        return 1;
+    }
+
+    ScenarioCorpus corpus;
+    if (corpus.open(args[0]) == false) {
+        fprintf(stderr, "Cannot open %s\n", args[0].c_str());
+        return 1;
+    }
+
+    int first = atoi(args[1].c_str());
+    int n_games = max(0, min(atoi(args[2].c_str()), corpus.size() - first));
+
+    vector<double> latencies;
+    uint64_t digest = 14695981039346656037ULL;
+    for(int k = first; k < first + n_games; k++) {
+        if (play_game(corpus.scenario(k), args[3], judge_us, max_turns, latencies, digest) == false) {
+            fprintf(stderr, "Scenario %d: the solver failed\n", k);
+            return 1;
+        }
+    }
+
+    if (latencies.empty() == true)
+        return 0;
+
+    double total = 0;
+    for(double l : latencies)
+        total = total + l;
+    sort(latencies.begin(), latencies.end());
+    int n = latencies.size();
+
+    printf("games=%d turns=%d latency mean=%.1f us p50=%.1f us p90=%.1f us p99=%.1f us max=%.1f us moves=%016llx\n",
+           n_games, n, total/n, latencies[n/2], latencies[n*9/10], latencies[n*99/100], latencies[n - 1],
+           (unsigned long long)digest);
+
+    return 0;
+}
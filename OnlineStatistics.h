@@ -0,0 +1,158 @@
+#ifndef ONLINE_STATISTICS_H
+#define ONLINE_STATISTICS_H
+
+#include <cmath>
+#include <algorithm>
+
+// Accumulators that see every value once and keep O(1) state, for
+// harnesses that stream game scores.
+
+
+// --------------------------------------------
+// -----------  Running Moments  --------------
+// --------------------------------------------
+
+
+// Count, mean and variance by Welford's update, which stays accurate
+// when the mean is large compared to the spread.
+class RunningMoments {
+    public:
+        long long f_n;
+        double f_mean;
+        double f_m2; // sum of squared deviations from the mean
+        double f_min;
+        double f_max;
+
+        RunningMoments(): f_n(0), f_mean(0), f_m2(0), f_min(0), f_max(0) {}
+
+        void add(double x) {
+            f_n++;
+            double delta = x - f_mean;
+            f_mean += delta/f_n;
+            f_m2 += delta*(x - f_mean);
+            f_min = f_n == 1 ? x : std::min(f_min, x);
+            f_max = f_n == 1 ? x : std::max(f_max, x);
+        }
+
+        double variance() const {return f_n > 1 ? f_m2/(f_n - 1) : 0.0;}
+        double standard_error() const {return f_n > 1 ? std::sqrt(variance()/f_n) : 0.0;}
+};
+
+
+// --------------------------------------------
+// ------------  P2 Quantile  -----------------
+// --------------------------------------------
+
+
+// Estimate of the p quantile from five markers whose heights follow a
+// parabola between their neighbours (Jain and Chlamtac's P^2 method).
+// Exact up to five values.
+class P2Quantile {
+    public:
+        double f_p;
+        int f_n;
+        double f_q[5];  // marker heights
+        double f_pos[5]; // marker positions, 1 based
+        double f_want[5]; // desired positions
+        double f_step[5]; // of the desired positions per value
+
+        P2Quantile(double p = 0.5): f_p(p), f_n(0) {
+            double step[5] = {0, p/2, p, (1 + p)/2, 1};
+            for(int i = 0; i < 5; i++) {
+                f_q[i] = 0;
+                f_pos[i] = i + 1;
+                f_want[i] = 1 + 4*step[i];
+                f_step[i] = step[i];
+            }
+        }
+
+        void add(double x);
+        double value() const;
+
+    private:
+        double parabolic(int i, int d) const {
+            return f_q[i] + d/(f_pos[i + 1] - f_pos[i - 1])*
+                   ((f_pos[i] - f_pos[i - 1] + d)*(f_q[i + 1] - f_q[i])/(f_pos[i + 1] - f_pos[i]) +
+                    (f_pos[i + 1] - f_pos[i] - d)*(f_q[i] - f_q[i - 1])/(f_pos[i] - f_pos[i - 1]));
+        }
+        double linear(int i, int d) const {
+            return f_q[i] + d*(f_q[i + d] - f_q[i])/(f_pos[i + d] - f_pos[i]);
+        }
+};
+
+
+inline void P2Quantile::add(double x) {
+
+    if (f_n < 5) {
+        f_q[f_n++] = x;
+        std::sort(f_q, f_q + f_n);
+        return;
+    }
+    f_n++;
+
+    // Cell of x, stretching the extreme markers if needed.
+    int k;
+    if (x < f_q[0]) {
+        f_q[0] = x;
+        k = 0;
+    } else if (x >= f_q[4]) {
+        f_q[4] = std::max(f_q[4], x);
+        k = 3;
+    } else {
+        k = 0;
+        while (x >= f_q[k + 1])
+            k++;
+    }
+
+    for(int i = k + 1; i < 5; i++)
+        f_pos[i]++;
+    for(int i = 0; i < 5; i++)
+        f_want[i] += f_step[i];
+
+    // Move the middle markers by one towards their desired positions.
+    for(int i = 1; i < 4; i++) {
+        double off = f_want[i] - f_pos[i];
+        if ((off >= 1 && f_pos[i + 1] - f_pos[i] > 1) || (off <= -1 && f_pos[i - 1] - f_pos[i] < -1)) {
+            int d = off > 0 ? 1 : -1;
+            double q = parabolic(i, d);
+            f_q[i] = f_q[i - 1] < q && q < f_q[i + 1] ? q : linear(i, d);
+            f_pos[i] += d;
+        }
+    }
+}
+
+
+inline double P2Quantile::value() const {
+
+    if (f_n >= 5)
+        return f_q[2];
+    if (f_n == 0)
+        return 0.0;
+
+    // f_q holds the sorted values so far.
+    int i = std::min(f_n - 1, int(f_p*f_n));
+    return f_q[i];
+}
+
+
+// --------------------------------------------
+// ------------  Normal Quantile  -------------
+// --------------------------------------------
+
+
+// z with P(Z > z) = tail for a standard normal Z, 0 < tail < 1.
+inline double normal_upper_quantile(double tail) {
+
+    double lo = -40, hi = 40;
+    for(int i = 0; i < 100; i++) {
+        double mid = 0.5*(lo + hi);
+        if (0.5*std::erfc(mid/std::sqrt(2.0)) > tail)
+            lo = mid;
+        else
+            hi = mid;
+    }
+
+    return 0.5*(lo + hi);
+}
+
+#endif
@@ -0,0 +1,235 @@
+#ifndef PAIRED_GAMES_H
+#define PAIRED_GAMES_H
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <memory>
+#include <utility>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "PrincessesAndMonsters.h"
+#include "ScenarioCorpus.h"
+#include "BatchSimulator.h"
+
+// Two variants of the solver playing the same scenario, for harnesses
+// that compare (ABCompare.cpp) or tune (TuningCampaign.cpp) them. A
+// player is the library solver with a policy and parameters, or a
+// server process (protocol in PrincessesAndMonstersServer.cpp).
+
+
+// --------------------------------------------
+// ---------------  Players  ------------------
+// --------------------------------------------
+
+
+// One variant playing one game at a time.
+class Player {
+    public:
+        virtual ~Player() {}
+
+        virtual bool initialize(const Scenario &s, char *entrances) = 0;
+        virtual bool move(const int *status, int K, int P, int M, char *moves) = 0;
+        virtual void end() {}
+};
+
+
+class LibraryPlayer : public Player {
+    public:
+        std::string f_policy;
+        std::vector<std::pair<std::string, double>> f_parameters;
+        std::unique_ptr<PrincessesAndMonstersSolver> f_solver;
+
+        bool initialize(const Scenario &s, char *entrances);
+        bool move(const int *status, int K, int P, int M, char *moves);
+};
+
+
+inline bool LibraryPlayer::initialize(const Scenario &s, char *entrances) {
+
+    f_solver.reset(new PrincessesAndMonstersSolver());
+    if (f_solver->set_policy(f_policy.c_str()) == false)
+        return false;
+    for(auto &p : f_parameters) {
+        if (f_solver->set_parameter(p.first.c_str(), p.second) == false)
+            return false;
+    }
+    f_solver->set_seed((unsigned)s.seed);
+
+    f_solver->initialize(s.S, s.princesses, s.n_princess_values, s.monsters, s.n_monster_values, s.K, entrances);
+    return true;
+}
+
+
+inline bool LibraryPlayer::move(const int *status, int, int P, int M, char *moves) {
+    f_solver->move(status, P, M, 10000, moves);
+    return true;
+}
+
+
+// Talks to a server process over its stdin and stdout.
+class ServerPlayer : public Player {
+    public:
+        pid_t f_pid;
+        FILE *f_to;
+        FILE *f_from;
+        long long f_game_id;
+        std::string f_reply;
+
+        ServerPlayer(const std::string &command);
+        ~ServerPlayer();
+
+        bool initialize(const Scenario &s, char *entrances);
+        bool move(const int *status, int K, int P, int M, char *moves);
+        void end();
+
+    private:
+        bool request(const std::string &message, int n_chars, char *chars);
+};
+
+
+inline ServerPlayer::ServerPlayer(const std::string &command): f_pid(-1), f_to(nullptr), f_from(nullptr), f_game_id(0) {
+
+    int to_child[2], from_child[2];
+    if (pipe(to_child) != 0 || pipe(from_child) != 0)
+        return;
+
+    f_pid = fork();
+    if (f_pid == 0) {
+        dup2(to_child[0], 0);
+        dup2(from_child[1], 1);
+        close(to_child[0]);
+        close(to_child[1]);
+        close(from_child[0]);
+        close(from_child[1]);
+        execl("/bin/sh", "sh", "-c", command.c_str(), (char*)nullptr);
+        _exit(127);
+    }
+
+    close(to_child[0]);
+    close(from_child[1]);
+    f_to = fdopen(to_child[1], "w");
+    f_from = fdopen(from_child[0], "r");
+}
+
+
+inline ServerPlayer::~ServerPlayer() {
+
+    // The server ends at the end of its input.
+    if (f_to != nullptr)
+        fclose(f_to);
+    if (f_from != nullptr)
+        fclose(f_from);
+    if (f_pid > 0)
+        waitpid(f_pid, nullptr, 0);
+}
+
+
+// Sends one message as a batch and copies the n_chars characters after
+// "<id> " of the reply to chars.
+inline bool ServerPlayer::request(const std::string &message, int n_chars, char *chars) {
+
+    if (f_to == nullptr || f_from == nullptr)
+        return false;
+
+    fputs(message.c_str(), f_to);
+    fputs("\n\n", f_to);
+    if (fflush(f_to) != 0)
+        return false;
+
+    // Replies up to the empty line closing the batch.
+    f_reply.clear();
+    int c;
+    while ((c = fgetc(f_from)) != EOF) {
+        if (c == '\n' && (f_reply.empty() == true || f_reply.back() == '\n'))
+            break;
+        f_reply.push_back(c);
+    }
+    if (c == EOF)
+        return false;
+
+    if (n_chars == 0)
+        return true;
+
+    std::string prefix = std::to_string(f_game_id) + " ";
+    if (f_reply.compare(0, prefix.size(), prefix) != 0 || (int)f_reply.size() < (int)prefix.size() + n_chars ||
+        f_reply.compare(prefix.size(), 5, "ERROR") == 0) {
+        fprintf(stderr, "Server replied: %s", f_reply.c_str());
+        return false;
+    }
+
+    memcpy(chars, f_reply.data() + prefix.size(), n_chars);
+    return true;
+}
+
+
+inline bool ServerPlayer::initialize(const Scenario &s, char *entrances) {
+
+    f_game_id++;
+    std::string m = "INIT " + std::to_string(f_game_id) + " " + std::to_string(s.S) + " " + std::to_string(s.n_princess_values);
+    for(int i = 0; i < s.n_princess_values; i++)
+        m += " " + std::to_string(s.princesses[i]);
+    m += " " + std::to_string(s.n_monster_values);
+    for(int i = 0; i < s.n_monster_values; i++)
+        m += " " + std::to_string(s.monsters[i]);
+    m += " " + std::to_string(s.K) + " " + std::to_string((unsigned)s.seed);
+
+    return request(m, s.K, entrances);
+}
+
+
+inline bool ServerPlayer::move(const int *status, int K, int P, int M, char *moves) {
+
+    std::string m = "MOVE " + std::to_string(f_game_id) + " " + std::to_string(K);
+    for(int i = 0; i < K; i++)
+        m += " " + std::to_string(status[i]);
+    m += " " + std::to_string(P) + " " + std::to_string(M) + " 10000";
+
+    return request(m, K, moves);
+}
+
+
+inline void ServerPlayer::end() {
+    request("END " + std::to_string(f_game_id), 0, nullptr);
+}
+
+
+// Plays s with a in lane 0 and b in lane 1 of a rules engine, so both
+// games draw the same random walks. False if a player failed.
+inline bool play_pair(const Scenario &s, Player &a, Player &b, double &score_a, double &score_b) {
+
+    std::string entrances_a(s.K, '0'), entrances_b(s.K, '0');
+    if (a.initialize(s, &entrances_a[0]) == false || b.initialize(s, &entrances_b[0]) == false)
+        return false;
+
+    GameBatch batch(2, s.K, s.n_princess_values/2, s.n_monster_values/2);
+    batch.add_game(0, s.S, s.princesses, s.n_princess_values, s.monsters, s.n_monster_values, s.K, entrances_a.c_str(), s.seed);
+    batch.add_game(1, s.S, s.princesses, s.n_princess_values, s.monsters, s.n_monster_values, s.K, entrances_b.c_str(), s.seed);
+
+    Player *players[2] = {&a, &b};
+    std::vector<int> status(s.K);
+    std::string moves(s.K, 'X');
+    while (batch.number_of_active_games() > 0) {
+        for(int g = 0; g < 2; g++) {
+            if (batch.f_active[g] == 0)
+                continue;
+
+            int P, M;
+            batch.status(g, status.data(), P, M);
+            if (players[g]->move(status.data(), s.K, P, M, &moves[0]) == false)
+                return false;
+            batch.set_moves(g, moves.c_str());
+        }
+        batch.step();
+    }
+
+    a.end();
+    b.end();
+    score_a = batch.score(0);
+    score_b = batch.score(1);
+    return true;
+}
+
+#endif
@@ -7,11 +7,40 @@
 #include <algorithm>
 #include <random>
 #include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <climits>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 
 using namespace std;
 
-#define PRINT_DEBUG 0
 #define EPSILON 10e-12
+#define MAX_SEARCH_SECTORS_PER_SIDE 32
+#define SUSPECTED_PRINCESSES 1.0 // expected in a block to search it as a target
+
+// Build with -DCHECK_INVARIANTS=1 to check every reply against the
+// tracked knights and to run the fast kernels next to their reference
+// versions. Slow, meant for the fuzzer (InvariantFuzzer.cpp).
+#ifndef CHECK_INVARIANTS
+#define CHECK_INVARIANTS 0
+#endif
+
+// Build with -DLOG_LEVEL=1 to record the events of every turn in the
+// event log, 2 also those of every knight, princess and monster. At 0
+// no event is compiled in.
+#ifndef LOG_LEVEL
+#define LOG_LEVEL 0
+#endif
 
 // --------------------------------------------
 // -----------------  Knight  -----------------
@@ -26,6 +55,7 @@ class Knight {
         int f_y;
         int f_n_p; // number of princesses escorted by knight
         int f_g; // the knight belong to group f_g
+        int f_e; // the knight enters/exits through corner f_e
         string f_order;
 
         Knight(int idp = -1, 
@@ -33,12 +63,13 @@ class Knight {
                int yp = -1,
                int np = 0,
                int gp = -1,
-               string sp = "NONE"): f_id(idp), f_x(xp), f_y(yp), f_n_p(np), f_g(gp), f_order(sp) {}
+               int ep = 0,
+               string sp = "NONE"): f_id(idp), f_x(xp), f_y(yp), f_n_p(np), f_g(gp), f_e(ep), f_order(sp) {}
 };
 
 
 ostream & operator<<(ostream & os, const Knight &k){
-    os << "KnightObject - Description: id: " << k.f_id << " at (" << k.f_x << "," << k.f_y << ")  in state: " << k.f_n_p << " order: " << k.f_order;
+    os << "KnightObject - Description: id: " << k.f_id << " at (" << k.f_x << "," << k.f_y << ")  in state: " << k.f_n_p << " exit: " << k.f_e << " order: " << k.f_order;
     return os;
 }
 
@@ -130,927 +161,4345 @@ ostream & operator<<(ostream & os, const Monster &p){
 
 
 // --------------------------------------------
-// ------------  GameState  -------------------
+// ---------------  Turn Pool  ----------------
 // --------------------------------------------
 
 
-class GameState {
-    public:
-        string f_moves = "NEWS";
-        int f_S; // board size
-        int f_turn; // current turn
-        int f_n_knights; // number of knights
-        int f_n_princesses; // number of princesses
-        int f_n_monsters; // number of monsters
-        int f_total_dispersed;
-        double f_disperse_fraction;
-        double f_initial_disperse_fraction;
-        int f_max_number_of_dispersed_knights;
-        vector<Knight*> f_knights;
-        vector<Princess> f_princesses;
-        vector<Monster> f_monsters;
-        vector<KnightGroup> f_knight_group_collection;
-
-        string f_current_global_order_name;
-        string f_current_order_instructions;
-
-        pair<int, int> f_global_assembly_point;
-        pair<int, int> f_entrance_exit;
-
-        mt19937 f_gen;
-        uniform_int_distribution<> f_uniform_int;
-        uniform_real_distribution<> f_uniform_real;
+// Per knight loops of a turn are cut into parts of KNIGHTS_PER_PART
+// knights. A part is run in order by one thread, writes only the slots
+// of its own knights and leaves whatever it adds up to the caller,
+// which merges the parts in part order. The parts do not depend on the
+// number of threads, so neither do the moves.
+const int KNIGHTS_PER_PART = 512;
 
-        GameState();
 
-        int knights_alive();
+// A bid is a pass over all targets. Bids made ahead in one batch of
+// the auction, see KnightAssignment::assign.
+const int BIDS_PER_PART = 32;
+const int BIDS_AHEAD = 1024;
 
-        int _manhatan_distance_from_point(pair<int, int> &point, int &x, int &y);
-        double _euclidean_distance_from_point(pair<int, int> &point, int &x, int &y);
 
-        void set_S(int &S) {f_S = S;}
-        void set_fractions(double &disperse_fraction, double &initial_disperse_fraction);
+inline int number_of_parts(int n) {
+    return (n + KNIGHTS_PER_PART - 1)/KNIGHTS_PER_PART;
+}
 
-        void set_princesses(vector<int> &pr);
-        void print_princesses();
 
-        void set_monsters(vector<int> &mo);
-        void print_monsters();
+// Threads that run the parts of one loop at a time, the calling
+// thread takes parts too. Every worker takes part in every loop, so
+// none can still be busy with a loop when the next one is set up.
+class TurnPool {
+    public:
+        vector<thread> f_workers;
+        mutex f_run_mutex; // one loop at a time
+        mutex f_mutex;
+        condition_variable f_work_ready;
+        condition_variable f_work_done;
+        const function<void(int)> *f_job;
+        int f_n_jobs;
+        atomic<int> f_next_job;
+        int f_n_done; // workers done with the current loop
+        int f_generation;
+        bool f_stop;
+
+        TurnPool(int n_threads);
+        ~TurnPool();
+
+        void run(int n_jobs, const function<void(int)> &job);
+
+    private:
+        void worker();
+        void work();
+
+        TurnPool(const TurnPool &);
+        TurnPool &operator=(const TurnPool &);
+};
 
-        void set_knights(vector<Knight> &knights);
-        void update_initial_knight_positions(pair<int, int> &pos);
-        void update_knights_number_of_princesses(vector<int> &status);
-        void print_knights();
 
-        int get_number_of_escorted_princesses_at_cm(pair<int, int> &cm_point);
+TurnPool::TurnPool(int n_threads): f_job(nullptr), f_n_jobs(0), f_next_job(0), f_n_done(0), f_generation(0), f_stop(false) {
 
-        pair<int, int> _determine_the_number_of_groups();
-        void make_groups();
-        void print_groups();
+    for(int i = 1; i < n_threads; i++)
+        f_workers.push_back(thread(&TurnPool::worker, this));
+}
 
-        pair<int, int> princess_center_of_mass();
-        char princess_cm_closest_entrence(pair<int, int> &cm);
 
+TurnPool::~TurnPool() {
 
-        string move_towards_point(pair<int, int> &point);
-        void move_towards_point(pair<int, int> &point, string &move_order);
-        void move_diagonally_towards_point(pair<int, int> &point, string &move_order);
-        void move_diagonally_knight_towards_point(pair<int, int> &point, string &move_order, int &id);
-        void move_knight_towards_point(pair<int, int> &point, string &move_order, int &id);
-        bool princess_cm_reached(pair<int, int> &cm_point);
-        bool check_if_knight_reached_princess_cm(pair<int, int> &cm_point, int &id);
-        bool check_if_all_knights_reached_princess_cm(pair<int, int> &cm_point);
+    {
+        lock_guard<mutex> lock(f_mutex);
+        f_stop = true;
+    }
+    f_work_ready.notify_all();
 
-        void send_global_order(string &order);
-        void send_order_to_all_knights(string &order);
-        void send_order_to_a_fraction_of_knights(string &order);
+    for(thread &w : f_workers)
+        w.join();
+}
 
-        void random_disperse_the_ith_knight(string &move_order, int &i);
-        void repulsive_random_disperse_the_ith_knight(string &move_order, int &i);
-        void check_and_set_princess_escort_during_random_disperse(string &move_order);
 
-        void max_forward_disperse();
-        void attractive_random_disperse_the_ith_knight(string &move_order, int &i);
-        void atractive_disperse(string &move_order);
+void TurnPool::work() {
 
-        void random_disperse_all_knights_to_the_same_point(string &move_order);
+    int j;
+    while ((j = f_next_job++) < f_n_jobs)
+        (*f_job)(j);
+}
 
-};
 
+void TurnPool::worker() {
 
-GameState::GameState() {
+    int generation = 0;
+    while (true) {
+        {
+            unique_lock<mutex> lock(f_mutex);
+            f_work_ready.wait(lock, [&] {return f_stop == true || f_generation != generation;});
+            if (f_stop == true)
+                return;
+            generation = f_generation;
+        }
 
-    random_device rd;  
-    mt19937 gen(rd());
-    uniform_int_distribution<> uniform_int(0, 3);
-    uniform_real_distribution<> uniform_real(0.0, 1.0);
+        work();
 
-    f_gen = gen;
-    f_uniform_int = uniform_int;
-    f_uniform_real = uniform_real;
+        {
+            lock_guard<mutex> lock(f_mutex);
+            f_n_done++;
+        }
+        f_work_done.notify_all();
+    }
 }
 
 
-int GameState::knights_alive() {
+void TurnPool::run(int n_jobs, const function<void(int)> &job) {
 
-    int ka = 0;
-    for(int i = 0; i < f_n_knights; i++) {
-        if (f_knights[i]->f_n_p >= 0)        
-            ka++;
+    lock_guard<mutex> run_lock(f_run_mutex);
+
+    {
+        lock_guard<mutex> lock(f_mutex);
+        f_job = &job;
+        f_n_jobs = n_jobs;
+        f_next_job = 0;
+        f_n_done = 0;
+        f_generation++;
     }
+    f_work_ready.notify_all();
 
-    return ka;
+    work();
+
+    unique_lock<mutex> lock(f_mutex);
+    f_work_done.wait(lock, [&] {return f_n_done == (int)f_workers.size();});
 }
 
 
-int GameState::_manhatan_distance_from_point(pair<int, int> &point, int &x, int &y) {
+// Calls part_job(p, begin, end) for the parts of the knights 0..n - 1,
+// on the pool if there is one. Loops with more work per knight take
+// smaller parts.
+template<class PartJob>
+void for_each_part(TurnPool *pool, int n, PartJob part_job, int part_size = KNIGHTS_PER_PART) {
 
-    return abs(point.first - x) + abs(point.second - y);
+    int n_parts = (n + part_size - 1)/part_size;
+    function<void(int)> job = [&] (int p) {
+        part_job(p, p*part_size, min(n, (p + 1)*part_size));
+    };
+
+    if (pool == nullptr || n_parts < 2) {
+        for(int p = 0; p < n_parts; p++)
+            job(p);
+    } else {
+        pool->run(n_parts, job);
+    }
 }
 
 
-double GameState::_euclidean_distance_from_point(pair<int, int> &point, int &x, int &y) {
+// Thrown to stop a turn that is no longer wanted (GameState::f_cancel),
+// the copy of the game it was played on is dropped.
+struct TurnCancelled {};
 
-    double dx = point.first - x;
-    double dy = point.second - y;
 
-    return sqrt(dx*dx + dy*dy);
+// --------------------------------------------
+// --------------  Counter Rng  ---------------
+// --------------------------------------------
 
-}
 
+// Draw n of stream f_key is a hash (splitmix64) of the pair, so the
+// draws of a knight do not depend on the knights before it in a loop
+// nor on the thread that moves it.
+class CounterRng {
+    public:
+        uint64_t f_key;
+        uint64_t f_counter;
 
-void GameState::set_fractions(double &disperse_fraction, double &initial_disperse_fraction) {
+        CounterRng(uint64_t key): f_key(key), f_counter(0) {}
 
-    f_total_dispersed = 0;
-    f_disperse_fraction = disperse_fraction;
-    f_initial_disperse_fraction = initial_disperse_fraction;
-    f_max_number_of_dispersed_knights = int(f_initial_disperse_fraction*f_disperse_fraction*f_n_knights);
+        static uint64_t mix(uint64_t z) {
+            z = (z ^ (z >> 30))*0xbf58476d1ce4e5b9ULL;
+            z = (z ^ (z >> 27))*0x94d049bb133111ebULL;
+            return z ^ (z >> 31);
+        }
 
-}
+        uint64_t next() {return mix(f_key + 0x9e3779b97f4a7c15ULL*(++f_counter));}
+        double uniform() {return (next() >> 11)*(1.0/9007199254740992.0);}
+
+        // Index drawn with probability weights[i]/sum of weights.
+        int discrete(const double *weights, int n) {
+            double sum = 0;
+            for(int i = 0; i < n; i++)
+                sum = sum + weights[i];
+            double u = uniform()*sum;
+            for(int i = 0; i < n - 1; i++) {
+                u = u - weights[i];
+                if (u < 0)
+                    return i;
+            }
+            return n - 1;
+        }
+};
 
 
-void GameState::set_princesses(vector<int> &pr) {
+// --------------------------------------------
+// ---------------  Event Log  ----------------
+// --------------------------------------------
 
-    int n = pr.size();
-    f_n_princesses = n/2;
-    f_princesses.resize( n/2 );
-    for(int i = 0; i < n/2; i++) {
-        f_princesses[i].f_last_x = pr[2*i + 1];
-        f_princesses[i].f_last_y = pr[2*i];
-    }
-}
 
+// Fields of the events as listed in EventLogDump.cpp, which prints
+// the log.
+enum EventType {
+    EVENT_INIT, EVENT_PRINCESS, EVENT_MONSTER, EVENT_KNIGHT, EVENT_GROUPS, EVENT_GROUP_MEMBER,
+    EVENT_CENTER_OF_MASS, EVENT_ASSEMBLY_POINT, EVENT_ROUTES, EVENT_GLOBAL_ORDER, EVENT_SEARCH_SECTORS,
+    EVENT_DISPERSAL, EVENT_COVERAGE, EVENT_DEPLOYMENT, EVENT_WAVE, EVENT_SQUAD, EVENT_HUNT, EVENT_TURN,
+    EVENT_SPECULATION, EVENT_LOG_END
+};
 
-void GameState::set_monsters(vector<int> &mo) {
 
-    int n = mo.size();
-    f_n_monsters = n/2;
-    f_monsters.resize( n/2 );
-    for(int i = 0; i < n/2; i++) {
-        f_monsters[i].f_last_x = mo[2*i + 1];
-        f_monsters[i].f_last_y = mo[2*i];
-    }
-}
+// A record of the log file, 32 bytes.
+struct LogEvent {
+    uint16_t f_type;
+    uint16_t f_source; // 0 the solver, g + 1 its speculative guess g
+    int32_t f_turn;
+    uint32_t f_values[6]; // int32_t or float, by type
+};
 
 
-void GameState::print_princesses() {
-    for(int i = 0; i < f_princesses.size(); i++) {
-        #if PRINT_DEBUG == 1     
-        cerr << "Princess id: " << i << ": " << f_princesses[i] << endl;
-        #endif       
-    }
+inline uint32_t event_value(int v) {
+    return (uint32_t)v;
 }
 
 
-void GameState::print_monsters() {
-    for(int i = 0; i < f_monsters.size(); i++) {
-        #if PRINT_DEBUG == 1
-        cerr << "Monster id: " << i << ": " << f_monsters[i] << endl;
-        #endif
-    }
+inline uint32_t event_value(double v) {
+    float f = (float)v;
+    uint32_t u;
+    memcpy(&u, &f, sizeof(u));
+    return u;
 }
 
 
-void GameState::set_knights(vector<Knight> &knights) {
-    int k = knights.size();
-    f_n_knights = k;
-    f_knights.resize(k);
-    for(int i = 0; i < k; i++)
-        f_knights[i] = &knights[i];
+// The events of a game go into a ring, a thread of the log appends
+// them to a file. The thread playing a turn pays for a few stores per
+// event and never waits: with the ring full the event is dropped and
+// counted in the EVENT_LOG_END record, which also counts the events a
+// failed write lost. There is one producer at a
+// time, the solver or, while it waits for the judge, the thread
+// playing its speculative copies; starting and joining that thread
+// hands the ring over.
+class EventLog {
+    public:
+        static const uint64_t CAPACITY = 1 << 16; // events, a power of 2
 
-}
+        vector<LogEvent> f_ring;
+        atomic<uint64_t> f_head; // events pushed, by the producer
+        atomic<uint64_t> f_tail; // events written, by the log thread
+        uint64_t f_tail_seen; // f_tail when the producer last looked
+        uint64_t f_dropped;
+        uint64_t f_write_errors; // events lost by fwrite, by the log thread
+        FILE *f_file;
+        atomic<bool> f_stop;
+        thread f_thread;
 
-void GameState::update_initial_knight_positions(pair<int, int> &pos) {
+        EventLog(): f_ring(CAPACITY), f_head(0), f_tail(0), f_tail_seen(0), f_dropped(0), f_write_errors(0), f_file(nullptr), f_stop(false) {}
+        ~EventLog() {close();}
 
-    for(int i = 0; i < f_n_knights; i++) {
-        f_knights[i]->f_x = pos.first;
-        f_knights[i]->f_y = pos.second;
+        bool open(const char *path);
+        void close();
+
+        template<class... Values>
+        void push(EventType type, int source, int turn, Values... values);
+
+    private:
+        void run();
+
+        EventLog(const EventLog &);
+        EventLog &operator=(const EventLog &);
+};
+
+
+// The file starts with "PAME" and a uint32_t version.
+bool EventLog::open(const char *path) {
+
+    close();
+
+    f_file = fopen(path, "wb");
+    if (f_file == nullptr)
+        return false;
+
+    // The ring is the buffer, unbuffered writes tell which events a
+    // failed write lost.
+    setvbuf(f_file, nullptr, _IONBF, 0);
+
+    uint32_t version = 1;
+    if (fwrite("PAME", 1, 4, f_file) != 4 || fwrite(&version, sizeof(version), 1, f_file) != 1) {
+        fclose(f_file);
+        f_file = nullptr;
+        return false;
     }
+
+    f_head = 0;
+    f_tail = 0;
+    f_tail_seen = 0;
+    f_dropped = 0;
+    f_write_errors = 0;
+    f_stop = false;
+    f_thread = thread(&EventLog::run, this);
+    return true;
 }
 
 
-void GameState::update_knights_number_of_princesses(vector<int> &status) {
+// Writes the events pushed so far and closes the file.
+void EventLog::close() {
 
-    for(int i = 0; i < f_n_knights; i++)
-        f_knights[i]->f_n_p = status[i];
+    if (f_file == nullptr)
+        return;
+
+    f_stop = true;
+    f_thread.join();
+
+    LogEvent end;
+    memset(&end, 0, sizeof(end));
+    end.f_type = EVENT_LOG_END;
+    end.f_values[0] = (uint32_t)min<uint64_t>(f_dropped, 0xffffffffu);
+    end.f_values[1] = (uint32_t)min<uint64_t>(f_write_errors, 0xffffffffu);
+    if (fwrite(&end, sizeof(end), 1, f_file) != 1 || f_write_errors > 0)
+        cerr << "Event log: " << f_write_errors << " events lost by failed writes" << endl;
+
+    fclose(f_file);
+    f_file = nullptr;
 }
 
 
-void GameState::print_knights() {
-    for(int i = 0; i < f_knights.size(); i++) {
-        #if PRINT_DEBUG == 1
-        cerr << "Knight id: " << i << ": " << *f_knights[i] << endl;
-        #endif
+template<class... Values>
+void EventLog::push(EventType type, int source, int turn, Values... values) {
+
+    static_assert(sizeof...(Values) <= 6, "at most 6 values per event");
+
+    uint64_t head = f_head.load(memory_order_relaxed);
+    if (head - f_tail_seen >= CAPACITY) {
+        f_tail_seen = f_tail.load(memory_order_acquire);
+        if (head - f_tail_seen >= CAPACITY) {
+            f_dropped++;
+            return;
+        }
     }
-    // cerr << "-----------------" << endl;
+
+    uint32_t v[] = {event_value(values)..., 0, 0, 0, 0, 0, 0};
+    LogEvent &e = f_ring[head & (CAPACITY - 1)];
+    e.f_type = type;
+    e.f_source = source;
+    e.f_turn = turn;
+    memcpy(e.f_values, v, sizeof(e.f_values));
+    f_head.store(head + 1, memory_order_release);
 }
 
 
-int GameState::get_number_of_escorted_princesses_at_cm(pair<int, int> &cm_point) {
+void EventLog::run() {
 
-    int n_princesses = 0;
-    for(int i = 0; i < f_n_knights; i++) {
-        if (f_knights[i]->f_n_p <= 0)
+    while (true) {
+        bool stop = f_stop;
+        uint64_t tail = f_tail.load(memory_order_relaxed);
+        uint64_t head = f_head.load(memory_order_acquire);
+        if (head == tail) {
+            if (stop == true)
+                return;
+            this_thread::sleep_for(chrono::milliseconds(1));
             continue;
-        if (f_knights[i]->f_x == cm_point.first && f_knights[i]->f_y == cm_point.second)
-            n_princesses = n_princesses + f_knights[i]->f_n_p;
+        }
+
+        // At most two runs of slots, before and after the wrap.
+        while (tail < head) {
+            uint64_t i = tail & (CAPACITY - 1);
+            uint64_t n = min(head - tail, CAPACITY - i);
+            f_write_errors += n - fwrite(&f_ring[i], sizeof(LogEvent), n, f_file);
+            tail += n;
+        }
+        f_tail.store(tail, memory_order_release);
     }
-    return n_princesses;
 }
 
 
-pair<int, int> GameState::_determine_the_number_of_groups() {
+// --------------------------------------------
+// ----------  Knight Assignment  -------------
+// --------------------------------------------
 
-    // monster_p - probability of meeting a monster
-    //double monster_p = f_n_monsters / (f_S*f_S);
 
-    int min_number_of_knights_in_group = f_n_knights;
-    int number_of_groups = int(f_n_knights/min_number_of_knights_in_group);
+// Manhattan distance from (x, y) to n targets given as separate
+// x and y arrays. This is the inner loop of every bid.
+void manhattan_cost_row(const int *tx, const int *ty, int n, int x, int y, int *cost) {
 
-    #if PRINT_DEBUG == 1
-    fprintf(stderr, "min_number_of_knights_in_group: %d\n", min_number_of_knights_in_group);
-    fprintf(stderr, "number_of_groups: %d\n", number_of_groups);
+    int i = 0;
+
+    #ifdef __AVX2__
+    __m256i vx = _mm256_set1_epi32(x);
+    __m256i vy = _mm256_set1_epi32(y);
+    for(; i + 8 <= n; i += 8) {
+        __m256i dx = _mm256_abs_epi32(_mm256_sub_epi32(_mm256_loadu_si256((const __m256i*)(tx + i)), vx));
+        __m256i dy = _mm256_abs_epi32(_mm256_sub_epi32(_mm256_loadu_si256((const __m256i*)(ty + i)), vy));
+        _mm256_storeu_si256((__m256i*)(cost + i), _mm256_add_epi32(dx, dy));
+    }
     #endif
 
-    return make_pair(min_number_of_knights_in_group, number_of_groups);
+    for(; i < n; i++)
+        cost[i] = abs(tx[i] - x) + abs(ty[i] - y);
+
+    #if CHECK_INVARIANTS == 1
+    for(int j = 0; j < n; j++)
+        assert(cost[j] == abs(tx[j] - x) + abs(ty[j] - y));
+    #endif
 }
 
 
-void GameState::make_groups() {
+// Forward auction between knights and targets. A knight values
+// target t at f_value_offset - distance and is free to stay
+// unassigned (value 0), so there may be more knights than targets
+// and the other way round. Prices and owners are kept between
+// turns, so only knights that lost their target bid again. At most
+// f_max_bids bids (one pass over the targets each) are made per
+// call, a bidding war between many more knights than targets goes
+// on over the next turns.
 
-    pair<int, int> group_parameters = _determine_the_number_of_groups();
+class KnightAssignment {
+    public:
+        int f_value_offset;
+        int f_max_bids;
+        int f_epsilon; // least raise of a bid, see assign
+        vector<int> f_target_x;
+        vector<int> f_target_y;
+        vector<char> f_target_active;
+        vector<int> f_price;
+        vector<int> f_target_owner; // knight id or -1
+        vector<int> f_knight_target; // target id or -1
+
+        vector<int> f_cost_row;
+
+        // Bids made ahead (see assign), by knight, in batch f_batch.
+        int f_batch;
+        vector<int> f_bid_batch;
+        vector<int> f_bid_target;
+        vector<int> f_bid_second;
+        vector<int> f_bid_price;
+        vector<int> f_price_batch; // by target, batch of the last price change
+        vector<int> f_ahead_target; // by position on the stack
+        vector<int> f_ahead_second;
+        vector<int> f_ahead_price;
+        vector<int> f_ahead_top;
+        vector<int> f_bid_top;
+        vector<vector<int>> f_ahead_cost_rows; // by part of a batch
+
+        // Scratch of assign, kept between calls.
+        vector<int> f_queue;
+        vector<uint64_t> f_cell_bidders;
+        vector<int> f_first;
+
+        // Knights left unassigned by their last bid, in f_epoch: the best
+        // value was f_idle_value (<= 0) at (f_idle_x, f_idle_y).
+        int f_epoch; // prices were last reset
+        vector<int> f_idle_epoch;
+        vector<int> f_idle_value;
+        vector<int> f_idle_x;
+        vector<int> f_idle_y;
+
+        KnightAssignment(): f_value_offset(0), f_max_bids(0), f_epsilon(1), f_batch(0), f_epoch(0) {}
+        KnightAssignment(int n_knights, int value_offset, int max_bids);
+
+        int add_target(int x, int y);
+        int number_of_active_targets();
+        void activate_all_targets();
+        void remove_target(int t);
+        void remove_targets_from(int t);
+        void release_knight(int id);
+        void make_bid(vector<Knight*> &knights, int id, int *cost_row, int &best_t, int &second_t, int &price, int &top_v);
+        bool stays_idle(vector<Knight*> &knights, int id);
+        void assign(vector<Knight*> &knights, vector<int> &bidders, TurnPool *pool, const atomic<bool> *cancel);
+};
 
-    int min_number_of_knights_in_group = group_parameters.first;
-    int number_of_groups = group_parameters.second;
 
+KnightAssignment::KnightAssignment(int n_knights, int value_offset, int max_bids) {
+    f_batch = 0;
+    f_epsilon = 1;
+    f_value_offset = value_offset;
+    f_max_bids = max_bids;
+    f_knight_target.resize(n_knights, -1);
+    f_bid_batch.resize(n_knights, -1);
+    f_bid_target.resize(n_knights, -1);
+    f_bid_second.resize(n_knights, -1);
+    f_bid_price.resize(n_knights, 0);
+    f_bid_top.resize(n_knights, 0);
+    f_epoch = 0;
+    f_idle_epoch.resize(n_knights, -1);
+    f_idle_value.resize(n_knights, 0);
+    f_idle_x.resize(n_knights, 0);
+    f_idle_y.resize(n_knights, 0);
+}
 
-    int q = min_number_of_knights_in_group*number_of_groups;
 
-    #if PRINT_DEBUG == 1
-    fprintf(stderr, "q: %d\n", q);
-    fprintf(stderr, "f_n_knights: %d\n", f_n_knights);
-    #endif    
+int KnightAssignment::add_target(int x, int y) {
 
-    if (q == f_n_knights) {
-        f_knight_group_collection.resize(number_of_groups);
-    } else if (q < f_n_knights) {
-        number_of_groups = number_of_groups + 1;
-        f_knight_group_collection.resize(number_of_groups);
-    } else {
-        fprintf(stderr, "Cannot have more groups than knights!\n");        
-        assert(false);
-    }
+    f_target_x.push_back(x);
+    f_target_y.push_back(y);
+    f_target_active.push_back(1);
+    f_price.push_back(0);
+    f_target_owner.push_back(-1);
+    f_cost_row.push_back(0);
+    f_price_batch.push_back(-1);
 
+    return f_target_x.size() - 1;
+}
 
-    int knight_index = 0;
-    for(int i = 0; i < number_of_groups; i++) {
 
-        for(int j = 0; j < min_number_of_knights_in_group; j++) {
+int KnightAssignment::number_of_active_targets() {
 
-            Knight *kp = f_knights[knight_index];
-            f_knight_group_collection[i].f_knights_group.push_back(kp);
+    int n_active = 0;
+    int n = f_target_active.size();
+    for(int t = 0; t < n; t++)
+        n_active += f_target_active[t];
 
-            knight_index++;
-            if (knight_index == f_n_knights)
-                break;
-        }
+    return n_active;
+}
+
+
+void KnightAssignment::activate_all_targets() {
+
+    f_epoch++;
+    int n = f_target_active.size();
+    for(int t = 0; t < n; t++) {
+        if (f_target_owner[t] >= 0)
+            f_knight_target[f_target_owner[t]] = -1;
+
+        f_target_active[t] = 1;
+        f_price[t] = 0;
+        f_target_owner[t] = -1;
     }
 }
 
 
-void GameState::print_groups() {
+void KnightAssignment::remove_target(int t) {
 
-    int n = f_knight_group_collection.size();
-    for(int i = 0; i < n; i++) {
+    if (f_target_owner[t] >= 0)
+        f_knight_target[f_target_owner[t]] = -1;
 
-        int n_kinghts = f_knight_group_collection[i].f_knights_group.size();
+    f_target_active[t] = 0;
+    f_target_owner[t] = -1;
+}
 
-        #if PRINT_DEBUG == 1
-        fprintf(stderr, "Group id: %d, f_knight_group_collection[i].f_knights_group.size(): %d\n", i, n_kinghts);
-        #endif
 
-        for(int j = 0; j < n_kinghts; j++) {
-            #if PRINT_DEBUG == 1
-            cerr << " --> " << *(f_knight_group_collection[i].f_knights_group[j]) << endl;
-            #endif        
-        }
+// Drops targets t and up, their knights are left unassigned.
+void KnightAssignment::remove_targets_from(int t) {
 
+    int n = f_target_x.size();
+    for(int u = t; u < n; u++) {
+        if (f_target_owner[u] >= 0)
+            f_knight_target[f_target_owner[u]] = -1;
     }
 
+    f_target_x.resize(t);
+    f_target_y.resize(t);
+    f_target_active.resize(t);
+    f_price.resize(t);
+    f_target_owner.resize(t);
+    f_cost_row.resize(t);
+    f_price_batch.resize(t);
 }
 
 
-pair<int, int> GameState::princess_center_of_mass() {
+void KnightAssignment::release_knight(int id) {
 
-    int x_cm = 0;
-    int y_cm = 0;
+    int t = f_knight_target[id];
+    if (t < 0)
+        return;
 
-    for(int i = 0; i < f_n_princesses; i++) {
-        x_cm = x_cm + f_princesses[i].f_last_x;
-        y_cm = y_cm + f_princesses[i].f_last_y;
+    f_target_owner[t] = -1;
+    f_knight_target[id] = -1;
+}
+
+
+// The bid of knight id at the current prices: its best and second
+// best target and the price it offers, best_t is -1 if staying
+// unassigned is worth more. top_v is the value of the best target,
+// INT_MIN if none is active.
+void KnightAssignment::make_bid(vector<Knight*> &knights, int id, int *cost_row, int &best_t, int &second_t, int &price, int &top_v) {
+
+    int n_targets = f_target_x.size();
+
+    manhattan_cost_row(f_target_x.data(), f_target_y.data(), n_targets,
+                       knights[id]->f_x, knights[id]->f_y, cost_row);
+
+    // Staying unassigned is always worth 0.
+    best_t = -1;
+    second_t = -1;
+    int best_v = 0;
+    int second_v = 0;
+    top_v = INT_MIN;
+    for(int t = 0; t < n_targets; t++) {
+        if (f_target_active[t] == 0)
+            continue;
+
+        int v = f_value_offset - cost_row[t] - f_price[t];
+        top_v = max(top_v, v);
+        if (v > best_v) {
+            second_v = best_v;
+            second_t = best_t;
+            best_v = v;
+            best_t = t;
+        } else if (v > second_v) {
+            second_v = v;
+            second_t = t;
+        }
     }
 
-    x_cm = x_cm/f_n_princesses;
-    y_cm = y_cm/f_n_princesses;
+    price = best_t >= 0 ? f_price[best_t] + best_v - second_v + f_epsilon : 0;
+}
 
-    #if PRINT_DEBUG == 1
-    fprintf(stderr, "Princess center of mass (x_cm, y_cm): (%d, %d)\n", x_cm, y_cm);
-    #endif
 
-    return make_pair(x_cm, y_cm);
+// Prices only rise until activate_all_targets and a knight gains at
+// most a value of 1 per cell it moves, so one left unassigned stays so
+// while its best value plus the cells it moved is still <= 0. Its bid
+// is skipped and does not count against f_max_bids.
+bool KnightAssignment::stays_idle(vector<Knight*> &knights, int id) {
 
+    return f_idle_epoch[id] == f_epoch &&
+           f_idle_value[id] + abs(knights[id]->f_x - f_idle_x[id]) + abs(knights[id]->f_y - f_idle_y[id]) <= 0;
 }
 
-char GameState::princess_cm_closest_entrence(pair<int, int> &cm) {
 
-    pair<int, int> top_left = make_pair(0, 0); // 0
-    pair<int, int> top_right = make_pair(f_S-1, 0); // 1
+// Bids in stack order, one at a time. With a pool the bids of the next
+// knights on the stack are made ahead on it, at the prices when the
+// batch started; such a bid is used if neither of its two targets
+// changed its price since, as prices only rise it is then the bid the
+// knight would make now. The others are made again, so the result is
+// the same with or without a pool. A set cancel stops the auction with
+// TurnCancelled.
+void KnightAssignment::assign(vector<Knight*> &knights, vector<int> &bidders, TurnPool *pool, const atomic<bool> *cancel) {
+
+    int n_targets = f_target_x.size();
+
+    // Knights and prices moved since the last call.
+    f_batch++;
+
+    // Knights on one cell value the targets alike and outbid each other
+    // by f_epsilon, a raise of 1 would take some f_value_offset bids per
+    // target. With more bidders than targets the raise grows with their
+    // ratio to the targets, up to 1/16 of f_value_offset. Every knight
+    // then gets a target at most f_epsilon worse than its best. There
+    // are as many targets as searching knights at contest sizes (see
+    // make_search_sectors), f_epsilon is 1.
+    f_epsilon = max(1, min((int)bidders.size()/max(1, n_targets), f_value_offset/16));
+
+    // Bidders on one cell make the same bid, one left unassigned leaves
+    // the others on its cell unassigned (cell_bidders[first[id]], ...
+    // while on the same cell).
+    int n_bidders = bidders.size();
+    vector<uint64_t> &cell_bidders = f_cell_bidders;
+    cell_bidders.resize(n_bidders);
+    for(int k = 0; k < n_bidders; k++) {
+        int id = bidders[k];
+        cell_bidders[k] = (uint64_t)knights[id]->f_y << 48 | (uint64_t)knights[id]->f_x << 32 | id;
+    }
+    sort(cell_bidders.begin(), cell_bidders.end());
+    vector<int> &first = f_first;
+    first.assign(knights.size(), -1);
+    for(int k = 0; k < n_bidders; k++)
+        first[cell_bidders[k] & 0xffffffff] = k == 0 || (cell_bidders[k] >> 32) != (cell_bidders[k - 1] >> 32) ? k : first[cell_bidders[k - 1] & 0xffffffff];
 
-    pair<int, int> bottom_right = make_pair(f_S-1, f_S-1); // 2
-    pair<int, int> bottom_left = make_pair(0, f_S-1); // 3
+    f_ahead_cost_rows.resize((BIDS_AHEAD + BIDS_PER_PART - 1)/BIDS_PER_PART);
+    for(vector<int> &row : f_ahead_cost_rows)
+        row.resize(n_targets);
 
-    
-    int dtl = abs(cm.first - top_left.first) + abs(cm.second - top_left.second);
-    int dtr = abs(cm.first - top_right.first) + abs(cm.second - top_right.second);
-    int dbr = abs(cm.first - bottom_right.first) + abs(cm.second - bottom_right.second);
-    int dbl = abs(cm.first - bottom_left.first) + abs(cm.second - bottom_left.second);
-
-    #if PRINT_DEBUG == 1
-    fprintf(stderr, "Distances to the entrences from the princess center of mass:\n");
-    fprintf(stderr, "dtl: %d\n", dtl);
-    fprintf(stderr, "dtr: %d\n", dtr);
-    fprintf(stderr, "dbl: %d\n", dbl);
-    fprintf(stderr, "dbr: %d\n", dbr);
-    #endif
+    int n_bids = 0;
+    vector<int> &queue = f_queue;
+    queue.assign(bidders.begin(), bidders.end());
+    while (queue.empty() == false && n_bids < f_max_bids) {
+
+        if (cancel != nullptr && cancel->load(memory_order_relaxed) == true)
+            throw TurnCancelled();
+
+        int id = queue.back();
+        queue.pop_back();
+
+        if (f_knight_target[id] >= 0 || stays_idle(knights, id) == true)
+            continue;
 
-    vector<int> v = {dtl, dtr, dbr, dbl};
+        int best_t, second_t, price, top_v;
+        bool ahead = f_bid_batch[id] == f_batch;
+        if (ahead == false && pool != nullptr) {
+
+            // A new batch, from the top of the stack down. A knight can be
+            // twice on the stack, the bids are made by position.
+            queue.push_back(id);
+            int n_ahead = min((int)queue.size(), BIDS_AHEAD);
+            f_batch++;
+            f_ahead_target.resize(n_ahead);
+            f_ahead_second.resize(n_ahead);
+            f_ahead_price.resize(n_ahead);
+            f_ahead_top.resize(n_ahead);
+            for_each_part(pool, n_ahead, [&] (int part, int begin, int end) {
+                vector<int> &cost_row = f_ahead_cost_rows[part];
+                for(int k = begin; k < end; k++) {
+                    int j = queue[queue.size() - 1 - k];
+                    if (f_knight_target[j] < 0 && stays_idle(knights, j) == false)
+                        make_bid(knights, j, cost_row.data(), f_ahead_target[k], f_ahead_second[k], f_ahead_price[k], f_ahead_top[k]);
+                }
+            }, BIDS_PER_PART);
+
+            for(int k = 0; k < n_ahead; k++) {
+                int j = queue[queue.size() - 1 - k];
+                if (f_knight_target[j] >= 0 || stays_idle(knights, j) == true)
+                    continue;
+                f_bid_batch[j] = f_batch;
+                f_bid_target[j] = f_ahead_target[k];
+                f_bid_second[j] = f_ahead_second[k];
+                f_bid_price[j] = f_ahead_price[k];
+                f_bid_top[j] = f_ahead_top[k];
+            }
+            continue;
+        }
 
-    int d_min = 2500; // Max S = 50 so 2500 is enough.
-    char closest_entrence_index = -1;
-    for(int i = 0; i < v.size(); i++) {
-        if (v[i] < d_min) {
-            d_min = v[i];
-            closest_entrence_index = i;
+        best_t = f_bid_target[id];
+        second_t = f_bid_second[id];
+        bool valid = ahead == true && (best_t < 0 || f_price_batch[best_t] != f_batch) &&
+                     (second_t < 0 || f_price_batch[second_t] != f_batch);
+        if (valid == true) {
+            price = f_bid_price[id];
+            top_v = f_bid_top[id];
+        } else {
+            make_bid(knights, id, f_cost_row.data(), best_t, second_t, price, top_v);
+        }
+        f_bid_batch[id] = -1;
+
+        n_bids++;
+        if (best_t < 0) {
+            f_idle_epoch[id] = f_epoch;
+            f_idle_value[id] = top_v;
+            f_idle_x[id] = knights[id]->f_x;
+            f_idle_y[id] = knights[id]->f_y;
+            for(int k = first[id]; k >= 0 && k < n_bidders && (cell_bidders[k] >> 32) == (cell_bidders[first[id]] >> 32); k++) {
+                int j = cell_bidders[k] & 0xffffffff;
+                if (f_knight_target[j] >= 0)
+                    continue;
+                f_idle_epoch[j] = f_epoch;
+                f_idle_value[j] = top_v;
+                f_idle_x[j] = knights[j]->f_x;
+                f_idle_y[j] = knights[j]->f_y;
+            }
+            continue;
         }
-    }
 
-    if (closest_entrence_index == 0)
-        closest_entrence_index = '0';
-    else if (closest_entrence_index == 1)
-        closest_entrence_index = '1';
-    else if (closest_entrence_index == 2)
-        closest_entrence_index = '2';
-    else if (closest_entrence_index == 3)
-        closest_entrence_index = '3';
-    else {
-        cerr << "Could not get entrence id!" << endl;
-        assert(false);   
+        f_price[best_t] = price;
+        f_price_batch[best_t] = f_batch;
+
+        int previous_owner = f_target_owner[best_t];
+        if (previous_owner >= 0) {
+            // It bids next, against a price of this batch: the stale bid
+            // makes it bid again on its own rather than start a batch.
+            f_knight_target[previous_owner] = -1;
+            queue.push_back(previous_owner);
+            f_bid_batch[previous_owner] = f_batch;
+            f_bid_target[previous_owner] = best_t;
+        }
+
+        f_target_owner[best_t] = id;
+        f_knight_target[id] = best_t;
     }
+}
 
-    #if PRINT_DEBUG == 1
-    fprintf(stderr, "Distance to closest entrance d_min: %d\n", d_min);
-    fprintf(stderr, "closest_entrence_index: %c\n", closest_entrence_index);
-    #endif
 
-    return closest_entrence_index;
-}
+// --------------------------------------------
+// ---------  Deployment Scheduler  -----------
+// --------------------------------------------
 
 
-void GameState::move_knight_towards_point(pair<int, int> &point,
-                                            string &move_order,
-                                            int &id) {
+// Releases knights from f_queue in waves of f_wave_size every
+// f_wave_interval turns, the first wave has f_first_wave_size knights.
+// The InterceptionPlanner sends them on.
+class DeploymentScheduler {
+    public:
+        vector<int> f_queue; // knight ids in release order
+        int f_head; // number of knights released so far
+        int f_first_wave_size;
+        int f_wave_size;
+        int f_wave_interval;
+        int f_next_wave_turn;
 
-    #if PRINT_DEBUG == 1
-    fprintf(stderr, "Moving towards (%d, %d)\n", point.first, point.second);
-    #endif
+        DeploymentScheduler(): f_head(0), f_first_wave_size(0), f_wave_size(0), f_wave_interval(1), f_next_wave_turn(0) {}
 
-    if (point.first > f_knights[id]->f_x) {
+        bool wave_due(int &turn) {return f_head < (int)f_queue.size() && turn >= f_next_wave_turn;}
+        int release(int &turn);
+};
 
-        move_order[id] = 'E'; // move right
-        if (f_knights[id]->f_x < f_S - 1) 
-            f_knights[id]->f_x = f_knights[id]->f_x + 1;
 
-    } else if (point.first < f_knights[id]->f_x) {
+int DeploymentScheduler::release(int &turn) {
+
+    f_head = min(f_head + (f_head == 0 ? f_first_wave_size : f_wave_size), (int)f_queue.size());
+    f_next_wave_turn = turn + f_wave_interval;
+
+    return f_head;
+}
+
+
+// --------------------------------------------
+// -------------  Spatial Prior  --------------
+// --------------------------------------------
+
+
+// What the princesses did in simulated games, learned by
+// SpatialPrior.cpp, which rewrites the tables. By S bucket (S in
+// [10 + 10*s, 20 + 10*s), the last one open) and turn bucket (S/4
+// elapsed turns each), at the end of the bucket:
+//     PRIOR_DRIFT   variance per axis of a free princess around the
+//                   cell she was last set free on, over half the
+//                   turns since, the ratio to a random walk on an
+//                   open board,
+//     PRIOR_PICKED  share of the princesses picked up at least once,
+//                   by ring of their first cell (prior_ring).
+// Only the interception planner reads them: the sweeps and the
+// frontier search cover every cell whatever the prior says, and
+// search sectors valued by their free share did no better.
+// -------8<------- begin of the spatial prior tables (SpatialPrior.cpp) -------8<-------
+const int PRIOR_S_BUCKETS = 5;
+const int PRIOR_TURN_BUCKETS = 32;
+const int PRIOR_RINGS = 4;
+constexpr float PRIOR_DRIFT[PRIOR_S_BUCKETS][PRIOR_TURN_BUCKETS] = {
+    {0.9529f, 0.8883f, 0.8381f, 0.7997f, 0.7809f, 0.7518f, 0.7163f, 0.6892f,
+     0.6671f, 0.6484f, 0.6297f, 0.6146f, 0.5895f, 0.5743f, 0.5516f, 0.5372f,
+     0.5250f, 0.5113f, 0.5017f, 0.4908f, 0.4743f, 0.4642f, 0.4516f, 0.4475f,
+     0.4385f, 0.4287f, 0.4201f, 0.4174f, 0.4146f, 0.4078f, 0.4022f, 0.3952f},
+    {0.9778f, 0.9374f, 0.9011f, 0.8750f, 0.8446f, 0.8303f, 0.8023f, 0.7769f,
+     0.7603f, 0.7381f, 0.7229f, 0.7107f, 0.6969f, 0.6858f, 0.6708f, 0.6594f,
+     0.6465f, 0.6333f, 0.6221f, 0.6097f, 0.5984f, 0.5916f, 0.5810f, 0.5726f,
+     0.5600f, 0.5518f, 0.5426f, 0.5344f, 0.5265f, 0.5176f, 0.5114f, 0.5047f},
+    {0.9791f, 0.9496f, 0.9251f, 0.9069f, 0.8938f, 0.8786f, 0.8611f, 0.8422f,
+     0.8279f, 0.8080f, 0.7911f, 0.7761f, 0.7630f, 0.7486f, 0.7344f, 0.7200f,
+     0.7028f, 0.6928f, 0.6798f, 0.6732f, 0.6628f, 0.6547f, 0.6445f, 0.6329f,
+     0.6236f, 0.6149f, 0.6068f, 0.5993f, 0.5916f, 0.5839f, 0.5765f, 0.5693f},
+    {0.9832f, 0.9747f, 0.9584f, 0.9468f, 0.9207f, 0.9026f, 0.8798f, 0.8651f,
+     0.8435f, 0.8258f, 0.8137f, 0.7996f, 0.7854f, 0.7731f, 0.7622f, 0.7537f,
+     0.7427f, 0.7332f, 0.7223f, 0.7124f, 0.7049f, 0.6950f, 0.6883f, 0.6817f,
+     0.6731f, 0.6659f, 0.6586f, 0.6502f, 0.6439f, 0.6382f, 0.6317f, 0.6256f},
+    {0.9965f, 0.9850f, 0.9667f, 0.9424f, 0.9320f, 0.9069f, 0.8970f, 0.8831f,
+     0.8671f, 0.8482f, 0.8301f, 0.8136f, 0.7971f, 0.7828f, 0.7745f, 0.7615f,
+     0.7483f, 0.7379f, 0.7372f, 0.7344f, 0.7298f, 0.7201f, 0.7073f, 0.6991f,
+     0.6924f, 0.6902f, 0.6847f, 0.6792f, 0.6724f, 0.6647f, 0.6587f, 0.6539f},
+};
+constexpr float PRIOR_PICKED[PRIOR_S_BUCKETS][PRIOR_RINGS][PRIOR_TURN_BUCKETS] = {
+    {{0.0673f, 0.0923f, 0.0955f, 0.1002f, 0.1315f, 0.1721f, 0.2316f, 0.2551f,
+      0.2754f, 0.3067f, 0.3255f, 0.3459f, 0.3631f, 0.3740f, 0.3991f, 0.4100f,
+      0.4272f, 0.4413f, 0.4491f, 0.4537f, 0.4631f, 0.4694f, 0.4835f, 0.4874f,
+      0.4984f, 0.5047f, 0.5150f, 0.5197f, 0.5276f, 0.5332f, 0.5459f, 0.5522f},
+     {0.0071f, 0.0278f, 0.0385f, 0.0533f, 0.1039f, 0.1634f, 0.2236f, 0.2652f,
+      0.3062f, 0.3410f, 0.3645f, 0.3873f, 0.4073f, 0.4271f, 0.4428f, 0.4570f,
+      0.4690f, 0.4810f, 0.4921f, 0.5015f, 0.5154f, 0.5278f, 0.5367f, 0.5405f,
+      0.5500f, 0.5578f, 0.5651f, 0.5731f, 0.5805f, 0.5900f, 0.5950f, 0.5990f},
+     {0.0000f, 0.0123f, 0.0355f, 0.0744f, 0.1590f, 0.2228f, 0.2769f, 0.3077f,
+      0.3489f, 0.3781f, 0.4062f, 0.4280f, 0.4506f, 0.4645f, 0.4792f, 0.4966f,
+      0.5092f, 0.5189f, 0.5315f, 0.5394f, 0.5499f, 0.5607f, 0.5696f, 0.5769f,
+      0.5856f, 0.5919f, 0.5987f, 0.6019f, 0.6101f, 0.6152f, 0.6207f, 0.6242f},
+     {0.0000f, 0.0039f, 0.0326f, 0.0991f, 0.2282f, 0.2934f, 0.3468f, 0.3794f,
+      0.4172f, 0.4511f, 0.4811f, 0.4928f, 0.5137f, 0.5241f, 0.5346f, 0.5398f,
+      0.5476f, 0.5580f, 0.5737f, 0.5802f, 0.5867f, 0.5971f, 0.6050f, 0.6123f,
+      0.6253f, 0.6319f, 0.6387f, 0.6466f, 0.6518f, 0.6522f, 0.6562f, 0.6588f}},
+    {{0.0446f, 0.0591f, 0.0601f, 0.0601f, 0.0684f, 0.1005f, 0.1472f, 0.1743f,
+      0.2002f, 0.2189f, 0.2355f, 0.2459f, 0.2604f, 0.2707f, 0.2801f, 0.2905f,
+      0.2977f, 0.3091f, 0.3143f, 0.3205f, 0.3257f, 0.3330f, 0.3392f, 0.3444f,
+      0.3485f, 0.3537f, 0.3600f, 0.3651f, 0.3693f, 0.3755f, 0.3786f, 0.3828f},
+     {0.0043f, 0.0250f, 0.0301f, 0.0318f, 0.0568f, 0.1095f, 0.1577f, 0.1920f,
+      0.2227f, 0.2425f, 0.2584f, 0.2739f, 0.2872f, 0.2996f, 0.3100f, 0.3196f,
+      0.3280f, 0.3362f, 0.3448f, 0.3526f, 0.3606f, 0.3674f, 0.3730f, 0.3789f,
+      0.3856f, 0.3916f, 0.3969f, 0.4010f, 0.4057f, 0.4098f, 0.4142f, 0.4174f},
+     {0.0000f, 0.0044f, 0.0175f, 0.0359f, 0.1004f, 0.1665f, 0.2117f, 0.2482f,
+      0.2789f, 0.2995f, 0.3178f, 0.3326f, 0.3457f, 0.3589f, 0.3716f, 0.3801f,
+      0.3925f, 0.4010f, 0.4079f, 0.4141f, 0.4223f, 0.4278f, 0.4330f, 0.4390f,
+      0.4437f, 0.4490f, 0.4534f, 0.4579f, 0.4629f, 0.4671f, 0.4704f, 0.4741f},
+     {0.0000f, 0.0000f, 0.0162f, 0.0645f, 0.1912f, 0.2581f, 0.3037f, 0.3397f,
+      0.3780f, 0.4014f, 0.4208f, 0.4353f, 0.4494f, 0.4601f, 0.4698f, 0.4767f,
+      0.4860f, 0.4936f, 0.4988f, 0.5064f, 0.5109f, 0.5140f, 0.5192f, 0.5236f,
+      0.5305f, 0.5347f, 0.5395f, 0.5447f, 0.5495f, 0.5530f, 0.5554f, 0.5585f}},
+    {{0.0334f, 0.0463f, 0.0463f, 0.0463f, 0.0472f, 0.0583f, 0.1038f, 0.1346f,
+      0.1612f, 0.1758f, 0.1844f, 0.1913f, 0.1990f, 0.2058f, 0.2127f, 0.2170f,
+      0.2247f, 0.2316f, 0.2376f, 0.2427f, 0.2444f, 0.2470f, 0.2487f, 0.2556f,
+      0.2599f, 0.2642f, 0.2676f, 0.2684f, 0.2719f, 0.2736f, 0.2779f, 0.2779f},
+     {0.0033f, 0.0216f, 0.0257f, 0.0261f, 0.0388f, 0.0838f, 0.1283f, 0.1586f,
+      0.1820f, 0.1996f, 0.2128f, 0.2227f, 0.2311f, 0.2394f, 0.2468f, 0.2530f,
+      0.2587f, 0.2646f, 0.2703f, 0.2753f, 0.2801f, 0.2847f, 0.2889f, 0.2922f,
+      0.2963f, 0.2994f, 0.3022f, 0.3049f, 0.3078f, 0.3105f, 0.3133f, 0.3155f},
+     {0.0000f, 0.0024f, 0.0139f, 0.0231f, 0.0762f, 0.1415f, 0.1837f, 0.2133f,
+      0.2390f, 0.2577f, 0.2710f, 0.2835f, 0.2954f, 0.3059f, 0.3150f, 0.3219f,
+      0.3305f, 0.3368f, 0.3434f, 0.3487f, 0.3542f, 0.3591f, 0.3633f, 0.3667f,
+      0.3708f, 0.3741f, 0.3773f, 0.3803f, 0.3829f, 0.3859f, 0.3884f, 0.3908f},
+     {0.0000f, 0.0000f, 0.0122f, 0.0521f, 0.1715f, 0.2470f, 0.2860f, 0.3197f,
+      0.3468f, 0.3688f, 0.3871f, 0.3993f, 0.4135f, 0.4257f, 0.4342f, 0.4431f,
+      0.4521f, 0.4608f, 0.4668f, 0.4734f, 0.4780f, 0.4832f, 0.4863f, 0.4902f,
+      0.4934f, 0.4965f, 0.4998f, 0.5028f, 0.5064f, 0.5099f, 0.5124f, 0.5151f}},
+    {{0.0748f, 0.1411f, 0.1724f, 0.1922f, 0.2037f, 0.2113f, 0.2273f, 0.2395f,
+      0.2471f, 0.2517f, 0.2563f, 0.2563f, 0.2609f, 0.2654f, 0.2700f, 0.2723f,
+      0.2731f, 0.2738f, 0.2761f, 0.2769f, 0.2784f, 0.2815f, 0.2822f, 0.2830f,
+      0.2845f, 0.2860f, 0.2891f, 0.2891f, 0.2891f, 0.2899f, 0.2899f, 0.2914f},
+     {0.0076f, 0.0696f, 0.1116f, 0.1401f, 0.1648f, 0.1884f, 0.2120f, 0.2281f,
+      0.2420f, 0.2505f, 0.2559f, 0.2620f, 0.2669f, 0.2722f, 0.2764f, 0.2808f,
+      0.2842f, 0.2869f, 0.2889f, 0.2916f, 0.2949f, 0.2977f, 0.2999f, 0.3020f,
+      0.3043f, 0.3068f, 0.3091f, 0.3109f, 0.3128f, 0.3143f, 0.3156f, 0.3173f},
+     {0.0000f, 0.0102f, 0.0483f, 0.0824f, 0.1462f, 0.1961f, 0.2243f, 0.2430f,
+      0.2605f, 0.2729f, 0.2819f, 0.2891f, 0.2966f, 0.3031f, 0.3092f, 0.3142f,
+      0.3189f, 0.3232f, 0.3270f, 0.3305f, 0.3340f, 0.3368f, 0.3398f, 0.3424f,
+      0.3450f, 0.3481f, 0.3503f, 0.3523f, 0.3548f, 0.3571f, 0.3588f, 0.3607f},
+     {0.0000f, 0.0001f, 0.0175f, 0.0707f, 0.1995f, 0.2718f, 0.3114f, 0.3350f,
+      0.3554f, 0.3697f, 0.3823f, 0.3910f, 0.4012f, 0.4101f, 0.4159f, 0.4233f,
+      0.4288f, 0.4350f, 0.4403f, 0.4444f, 0.4489f, 0.4525f, 0.4566f, 0.4602f,
+      0.4634f, 0.4675f, 0.4705f, 0.4724f, 0.4757f, 0.4773f, 0.4794f, 0.4813f}},
+    {{0.1311f, 0.1967f, 0.2377f, 0.2459f, 0.2541f, 0.2869f, 0.2951f, 0.3033f,
+      0.3033f, 0.3033f, 0.3033f, 0.3115f, 0.3197f, 0.3279f, 0.3279f, 0.3279f,
+      0.3279f, 0.3279f, 0.3279f, 0.3279f, 0.3279f, 0.3279f, 0.3279f, 0.3279f,
+      0.3279f, 0.3279f, 0.3279f, 0.3279f, 0.3279f, 0.3361f, 0.3361f, 0.3361f},
+     {0.0062f, 0.0676f, 0.1017f, 0.1300f, 0.1511f, 0.1712f, 0.1894f, 0.2029f,
+      0.2082f, 0.2158f, 0.2221f, 0.2245f, 0.2269f, 0.2283f, 0.2350f, 0.2379f,
+      0.2398f, 0.2417f, 0.2422f, 0.2436f, 0.2480f, 0.2499f, 0.2508f, 0.2528f,
+      0.2552f, 0.2566f, 0.2585f, 0.2604f, 0.2628f, 0.2662f, 0.2662f, 0.2667f},
+     {0.0000f, 0.0071f, 0.0467f, 0.0801f, 0.1350f, 0.1740f, 0.1952f, 0.2077f,
+      0.2200f, 0.2312f, 0.2388f, 0.2432f, 0.2478f, 0.2526f, 0.2587f, 0.2633f,
+      0.2664f, 0.2700f, 0.2740f, 0.2771f, 0.2794f, 0.2817f, 0.2840f, 0.2863f,
+      0.2904f, 0.2927f, 0.2950f, 0.2960f, 0.2983f, 0.2996f, 0.3019f, 0.3031f},
+     {0.0000f, 0.0000f, 0.0130f, 0.0782f, 0.1755f, 0.2450f, 0.2763f, 0.3015f,
+      0.3267f, 0.3345f, 0.3484f, 0.3597f, 0.3684f, 0.3771f, 0.3858f, 0.3901f,
+      0.3936f, 0.3953f, 0.3988f, 0.4040f, 0.4040f, 0.4075f, 0.4101f, 0.4101f,
+      0.4109f, 0.4136f, 0.4162f, 0.4188f, 0.4222f, 0.4240f, 0.4240f, 0.4275f}},
+};
+// -------8<------- end of the spatial prior tables -------8<-------
+
+
+int prior_s_bucket(int S) {
+    return max(0, min(PRIOR_S_BUCKETS - 1, (S - 10)/10));
+}
+
+
+// Rings of S/4 of Manhattan distance to the nearest corner, where the
+// knights come in.
+int prior_ring(int S, int x, int y) {
+    int d = min(x, S - 1 - x) + min(y, S - 1 - y);
+    return min(PRIOR_RINGS - 1, PRIOR_RINGS*d/S);
+}
+
+
+// Linear between the ends of the turn buckets of S in a row of a
+// table, the first value before the first end and the last one after
+// the last.
+double prior_value(const float row[PRIOR_TURN_BUCKETS], int S, int turn) {
+
+    double x = 4.0*turn/S - 1;
+    if (x <= 0)
+        return row[0];
+    if (x >= PRIOR_TURN_BUCKETS - 1)
+        return row[PRIOR_TURN_BUCKETS - 1];
+
+    int k = (int)x;
+    return row[k] + (x - k)*(row[k + 1] - row[k]);
+}
+
+
+// Variance per axis, in cells squared, of where a princess can be
+// after turn turns.
+double prior_drift(int S, int turn) {
+    return prior_value(PRIOR_DRIFT[prior_s_bucket(S)], S, turn)*turn/2;
+}
+
+
+// Share of the princesses first seen around (x, y) not picked up yet
+// after turn turns.
+double prior_free_share(int S, int turn, int x, int y) {
+    return 1 - prior_value(PRIOR_PICKED[prior_s_bucket(S)][prior_ring(S, x, y)], S, turn);
+}
+
+
+// --------------------------------------------
+// ---------  Interception Planner  -----------
+// --------------------------------------------
+
+
+// Where the princesses can be at a later turn. They are counted in
+// f_n x f_n blocks of f_block cells at the positions given in
+// initialize. Frame k, the expected number of princesses per block
+// after k*f_dt turns, is one diffusion step of frame k - 1, which adds
+// the variance the spatial prior (prior_drift) gives for the turns in
+// between. Frames are added when a later turn is asked for.
+//
+// A knight is sent to the block with the most princesses expected at
+// the turn it gets there, less the princesses other knights claimed,
+// blocks across the board count half as much as the nearest ones.
+// The frames do not know about pickups, the prior share of princesses
+// of the ring of the block still free at that turn is taken of them.
+//
+// f_remaining follows the princesses still on the board: it is
+// diffused every f_dt turns like the frames and the princesses picked
+// up (or dropped by a dead knight) are taken out of (put back into)
+// their block.
+class InterceptionPlanner {
+    public:
+        int f_S;
+        int f_n; // blocks per side
+        int f_block; // cells per block side
+        int f_dt; // turns between two frames
+        double f_share; // princesses claimed by one knight
+        vector<vector<double>> f_frames; // f_frames[k][by*f_n + bx]
+        vector<double> f_claimed;
+        vector<int> f_knight_block; // block of every knight or -1
+        vector<int> f_knight_turn; // turn the knight is expected there
+        vector<double> f_remaining;
+        int f_remaining_turn; // turn f_remaining was last diffused to
+
+        InterceptionPlanner(): f_S(0), f_n(0), f_block(1), f_dt(1), f_share(0), f_remaining_turn(0) {}
+
+        void set_princesses(int &S, vector<Princess> &princesses, int &n_knights, int &n_planned);
+        double rate(int k);
+        void diffuse(const vector<double> &last, vector<double> &next, double rate);
+        vector<double> &frame(int turn);
+        vector<double> &remaining(int turn);
+        void collect(int x, int y, int n);
+        int intercept(int id, int x, int y, int turn);
+        void release(int id);
+
+        pair<int, int> center(int b) {
+            return make_pair(min((b % f_n)*f_block + f_block/2, f_S - 1), min((b/f_n)*f_block + f_block/2, f_S - 1));
+        }
+};
+
+
+void InterceptionPlanner::set_princesses(int &S, vector<Princess> &princesses, int &n_knights, int &n_planned) {
+
+    f_S = S;
+    f_block = max(3, (S + 15)/16);
+    f_n = (S + f_block - 1)/f_block;
+
+    // About a quarter block squared of variance per axis and frame.
+    f_dt = max(1, f_block*f_block/2);
+
+    f_frames.assign(1, vector<double>(f_n*f_n, 0.0));
+    int n_princesses = princesses.size();
+    for(int i = 0; i < n_princesses; i++)
+        f_frames[0][(princesses[i].f_last_y/f_block)*f_n + princesses[i].f_last_x/f_block] += 1.0;
+
+    f_remaining = f_frames[0];
+    f_remaining_turn = 0;
+
+    f_claimed.assign(f_n*f_n, 0.0);
+    f_knight_block.assign(n_knights, -1);
+    f_knight_turn.assign(n_knights, 0);
+    f_share = (double)n_princesses/max(1, n_planned);
+}
+
+
+// Share of a block moving to each neighbour from frame k to k + 1, a
+// step adds 2*rate blocks squared of variance per axis.
+double InterceptionPlanner::rate(int k) {
+    double variance = prior_drift(f_S, (k + 1)*f_dt) - prior_drift(f_S, k*f_dt);
+    return max(0.0, min(0.2, variance/(2.0*f_block*f_block)));
+}
+
+
+void InterceptionPlanner::diffuse(const vector<double> &last, vector<double> &next, double rate) {
+
+    // Reflecting border, a step off the board stays in its block.
+    next.resize(f_n*f_n);
+    for(int by = 0; by < f_n; by++) {
+        for(int bx = 0; bx < f_n; bx++) {
+            int b = by*f_n + bx;
+            double in = (bx > 0 ? last[b - 1] : last[b]) + (bx < f_n - 1 ? last[b + 1] : last[b]) +
+                        (by > 0 ? last[b - f_n] : last[b]) + (by < f_n - 1 ? last[b + f_n] : last[b]);
+            next[b] = (1 - 4*rate)*last[b] + rate*in;
+        }
+    }
+}
+
+
+vector<double> &InterceptionPlanner::frame(int turn) {
+
+    int k = turn/f_dt;
+    while ((int)f_frames.size() <= k) {
+        vector<double> next;
+        diffuse(f_frames.back(), next, rate(f_frames.size() - 1));
+        f_frames.push_back(next);
+    }
+
+    return f_frames[k];
+}
+
+
+vector<double> &InterceptionPlanner::remaining(int turn) {
+
+    vector<double> next;
+    for(; f_remaining_turn + f_dt <= turn; f_remaining_turn += f_dt) {
+        diffuse(f_remaining, next, rate(f_remaining_turn/f_dt));
+        f_remaining.swap(next);
+    }
+
+    return f_remaining;
+}
+
+
+void InterceptionPlanner::collect(int x, int y, int n) {
+
+    int b = (y/f_block)*f_n + x/f_block;
+    f_remaining[b] = max(0.0, f_remaining[b] - n);
+}
+
+
+int InterceptionPlanner::intercept(int id, int x, int y, int turn) {
+
+    release(id);
+
+    // No block is over-served while another is not: the distance only
+    // scales the value, so a block with more princesses expected than
+    // claimed (value > 0) beats every block with fewer.
+    int best = -1;
+    double best_value = 0;
+    bool under_served = false;
+    for(int b = 0; b < f_n*f_n; b++) {
+        pair<int, int> c = center(b);
+        int d = abs(c.first - x) + abs(c.second - y);
+        double value = (frame(turn + d)[b]*prior_free_share(f_S, turn + d, c.first, c.second) - f_claimed[b])/(1 + 2.0*d/f_S);
+        under_served = under_served || value > 0;
+        if (best < 0 || value > best_value) {
+            best = b;
+            best_value = value;
+        }
+    }
+
+    #if CHECK_INVARIANTS == 1
+    assert(best_value > 0 || under_served == false);
+    #endif
+
+    pair<int, int> c = center(best);
+    f_knight_block[id] = best;
+    f_knight_turn[id] = turn + abs(c.first - x) + abs(c.second - y);
+    f_claimed[best] += f_share;
+
+    return best;
+}
+
+
+void InterceptionPlanner::release(int id) {
+
+    if (f_knight_block[id] < 0)
+        return;
+
+    f_claimed[f_knight_block[id]] -= f_share;
+    f_knight_block[id] = -1;
+}
+
+
+// --------------------------------------------
+// -------------  Hunting Squad  --------------
+// --------------------------------------------
+
+
+// A squad hunts in a lane of f_width columns starting at f_x0.
+// Its knights stand in one row, f_strength of them per cell, and
+// the row sweeps the lane from one board edge to the other. The
+// strength follows the monsters of the lane, so the squads are split
+// again whenever one of them takes a new lane.
+class HuntingSquad {
+    public:
+        vector<int> f_members; // knight ids
+        int f_strength; // knights per cell
+        int f_width;
+        int f_x0;
+        int f_y; // row of the formation
+        int f_dy; // +1 sweeping south, -1 sweeping north
+        double f_rate; // expected kills per turn in the lane
+        bool f_active;
+
+        HuntingSquad(): f_strength(1), f_width(1), f_x0(-1), f_y(0), f_dy(1), f_rate(0.0), f_active(true) {}
+};
+
+
+// --------------------------------------------
+// -------------  Cell Buckets  ---------------
+// --------------------------------------------
+
+
+// Points (knights, convoys) sorted into square buckets of f_size cells,
+// at most 64 buckets per side. nearest() goes out ring by ring from the
+// bucket of the query and stops once a ring cannot hold a closer
+// point, so it looks at the points around the query only.
+class CellBuckets {
+    public:
+        int f_size; // cells per bucket side
+        int f_side; // buckets per board side
+        vector<int> f_start; // points of bucket b are [f_start[b], f_start[b + 1])
+        vector<int> f_ids;
+        vector<int> f_x;
+        vector<int> f_y;
+
+        CellBuckets(): f_size(1), f_side(0) {}
+
+        void build(int S, const vector<int> &ids, const vector<int> &x, const vector<int> &y);
+
+        // The id for which usable(id) holds with the smallest Manhattan
+        // distance to (x, y) below max_d, the smallest id among equals,
+        // or -1.
+        template<class Usable>
+        int nearest(int x, int y, int max_d, Usable usable);
+};
+
+
+// Point k is ids[k] at (x[k], y[k]), a counting sort by bucket keeps
+// the ids of a bucket in increasing order of k.
+void CellBuckets::build(int S, const vector<int> &ids, const vector<int> &x, const vector<int> &y) {
+
+    f_size = max(4, (S + 63)/64);
+    f_side = (S + f_size - 1)/f_size;
+    f_start.assign(f_side*f_side + 1, 0);
+
+    int n = ids.size();
+    for(int k = 0; k < n; k++)
+        f_start[(y[k]/f_size)*f_side + x[k]/f_size + 1]++;
+    for(int b = 0; b < f_side*f_side; b++)
+        f_start[b + 1] += f_start[b];
+
+    vector<int> next(f_start.begin(), f_start.end() - 1);
+    f_ids.resize(n);
+    f_x.resize(n);
+    f_y.resize(n);
+    for(int k = 0; k < n; k++) {
+        int j = next[(y[k]/f_size)*f_side + x[k]/f_size]++;
+        f_ids[j] = ids[k];
+        f_x[j] = x[k];
+        f_y[j] = y[k];
+    }
+}
+
+
+template<class Usable>
+int CellBuckets::nearest(int x, int y, int max_d, Usable usable) {
+
+    int best = -1;
+    int best_d = max_d;
+    int bx = x/f_size;
+    int by = y/f_size;
+
+    auto scan = [&] (int nx, int ny) {
+        int b = ny*f_side + nx;
+        for(int j = f_start[b]; j < f_start[b + 1]; j++) {
+            int d = abs(f_x[j] - x) + abs(f_y[j] - y);
+            if ((d < best_d || (d == best_d && best >= 0 && f_ids[j] < best)) && usable(f_ids[j]) == true) {
+                best = f_ids[j];
+                best_d = d;
+            }
+        }
+    };
+
+    // A point r rings out is at least (r - 1)*f_size + 1 cells away.
+    for(int r = 0; r < f_side && (r == 0 || (r - 1)*f_size + 1 <= best_d); r++) {
+        for(int ny = max(0, by - r); ny <= min(f_side - 1, by + r); ny++) {
+            if (ny == by - r || ny == by + r) {
+                for(int nx = max(0, bx - r); nx <= min(f_side - 1, bx + r); nx++)
+                    scan(nx, ny);
+            } else {
+                if (bx - r >= 0)
+                    scan(bx - r, ny);
+                if (bx + r < f_side)
+                    scan(bx + r, ny);
+            }
+        }
+    }
+
+    #if CHECK_INVARIANTS == 1
+    int reference = -1;
+    int reference_d = max_d;
+    for(int j = 0; j < (int)f_ids.size(); j++) {
+        int d = abs(f_x[j] - x) + abs(f_y[j] - y);
+        if ((d < reference_d || (d == reference_d && reference >= 0 && f_ids[j] < reference)) && usable(f_ids[j]) == true) {
+            reference = f_ids[j];
+            reference_d = d;
+        }
+    }
+    assert(best == reference);
+    #endif
+
+    return best;
+}
+
+
+// --------------------------------------------
+// ----------------  Convoy  ------------------
+// --------------------------------------------
+
+
+// Expected princesses a convoy may lose on its way (see convoy_size),
+// and the largest convoy asked for.
+const double CONVOY_MAX_LOSS = 0.03;
+const int MAX_CONVOY_SIZE = 8;
+
+
+// Knights returning to the assembly point from one cell, they all make
+// the same move. A convoy too small for the monsters on its way either
+// walks to a convoy nearer the assembly point (f_target), or waits
+// (f_hold) for a convoy or a guard coming to it.
+class Convoy {
+    public:
+        vector<int> f_members; // knight ids
+        int f_x;
+        int f_y;
+        int f_distance; // to the assembly point
+        int f_n_princesses; // escorted by the members
+        int f_incoming; // guards on their way
+        int f_target; // convoy walked to or -1
+        bool f_hold;
+
+        Convoy(): f_x(0), f_y(0), f_distance(0), f_n_princesses(0), f_incoming(0), f_target(-1), f_hold(false) {}
+};
+
+
+// --------------------------------------------
+// --------------  Route Cache  ---------------
+// --------------------------------------------
+
+
+// Whole routes of all knights to fixed targets. A route goes along x
+// first and then along y, as in move_knight_towards_point, so it is
+// kept as the steps left on each axis and a knight's next move is read
+// off its two counters: 8 bytes per knight whatever the length of the
+// routes, and a turn is one pass over the knights.
+class RouteCache {
+    public:
+        int f_n_knights;
+        int f_length; // length of the longest route, at build
+        vector<int> f_dx; // steps left east (> 0) or west (< 0)
+        vector<int> f_dy; // steps left south (> 0) or north (< 0)
+        bool f_valid;
+
+        RouteCache(): f_n_knights(0), f_length(0), f_valid(false) {}
+
+        template<class Target>
+        void build(vector<Knight*> &knights, Target target);
+        char next_move(int i);
+        void invalidate_knight(int i) {f_dx[i] = 0; f_dy[i] = 0;}
+};
+
+
+// target(i) is the target of knight i, dead knights get no route.
+template<class Target>
+void RouteCache::build(vector<Knight*> &knights, Target target) {
+
+    f_n_knights = knights.size();
+    f_dx.assign(f_n_knights, 0);
+    f_dy.assign(f_n_knights, 0);
+
+    f_length = 0;
+    for(int i = 0; i < f_n_knights; i++) {
+        if (knights[i]->f_n_p < 0)
+            continue;
+
+        pair<int, int> t = target(i);
+        f_dx[i] = t.first - knights[i]->f_x;
+        f_dy[i] = t.second - knights[i]->f_y;
+        f_length = max(f_length, abs(f_dx[i]) + abs(f_dy[i]));
+    }
+
+    f_valid = true;
+}
+
+
+// The move of knight i this turn, 'X' once it arrived.
+inline char RouteCache::next_move(int i) {
+
+    if (f_dx[i] > 0) {
+        f_dx[i]--;
+        return 'E';
+    } else if (f_dx[i] < 0) {
+        f_dx[i]++;
+        return 'W';
+    } else if (f_dy[i] > 0) {
+        f_dy[i]--;
+        return 'S';
+    } else if (f_dy[i] < 0) {
+        f_dy[i]++;
+        return 'N';
+    }
+
+    return 'X';
+}
+
+
+// --------------------------------------------
+// -------------  Coverage Map  ---------------
+// --------------------------------------------
+
+
+// Cells visited by knights during the princess search and cells
+// occupied by knights in the current turn.
+class CoverageMap {
+    public:
+        virtual ~CoverageMap() {}
+
+        virtual CoverageMap *clone() const = 0;
+        virtual void clear_visited() = 0;
+        virtual void set_occupied(vector<Knight*> &knights) = 0;
+        virtual int number_of_visited() = 0;
+        virtual bool nearest_unexplored(int x, int y, int &ux, int &uy) = 0;
+        virtual bool is_visited(int x, int y) = 0;
+
+        // All visited cells, laid out as in WideBitboardCoverageMap:
+        // S rows of (S + 63)/64 words.
+        virtual void copy_visited(vector<uint64_t> &rows) = 0;
+
+        // nearest_unexplored for the knights ids[0], ..., ids[n - 1],
+        // the cell of knight i goes to (ux[i], uy[i]), ux[i] = -1 if
+        // there is none.
+        virtual void nearest_unexplored_cells(vector<Knight*> &knights, const int *ids, int n, int *ux, int *uy) = 0;
+};
+
+
+// The maps derive from CoverageMapBatch<Map>, which runs the loop of
+// nearest_unexplored_cells on Map itself: one virtual call per batch
+// and the query of every knight is bound at compile time.
+template<class Map>
+class CoverageMapBatch : public CoverageMap {
+    public:
+        void nearest_unexplored_cells(vector<Knight*> &knights, const int *ids, int n, int *ux, int *uy);
+};
+
+
+template<class Map>
+void CoverageMapBatch<Map>::nearest_unexplored_cells(vector<Knight*> &knights, const int *ids, int n, int *ux, int *uy) {
+
+    Map &map = static_cast<Map&>(*this);
+    for(int k = 0; k < n; k++) {
+        int i = ids[k];
+        if (map.Map::nearest_unexplored(knights[i]->f_x, knights[i]->f_y, ux[i], uy[i]) == false)
+            ux[i] = -1;
+    }
+}
+
+
+// One 64 bit word per board row, bit x of f_visited[y] is cell (x, y).
+// MAX_S only bounds the rows, so small boards touch fewer words.
+template<int MAX_S>
+class BitboardCoverageMap : public CoverageMapBatch<BitboardCoverageMap<MAX_S>> {
+    public:
+        int f_S;
+        uint64_t f_mask; // the f_S lowest bits
+        uint64_t f_visited[MAX_S];
+        uint64_t f_occupied[MAX_S];
+
+        BitboardCoverageMap(int S);
+
+        CoverageMap *clone() const {return new BitboardCoverageMap(*this);}
+        void clear_visited();
+        void set_occupied(vector<Knight*> &knights);
+        int number_of_visited();
+        bool nearest_unexplored(int x, int y, int &ux, int &uy);
+        bool is_visited(int x, int y) {return (f_visited[y] >> x) & 1;}
+        void copy_visited(vector<uint64_t> &rows) {rows.assign(f_visited, f_visited + f_S);}
+};
+
+
+template<int MAX_S>
+BitboardCoverageMap<MAX_S>::BitboardCoverageMap(int S) {
+
+    f_S = S;
+    f_mask = S == 64 ? ~0ULL : (1ULL << S) - 1;
+    memset(f_visited, 0, sizeof(f_visited));
+    memset(f_occupied, 0, sizeof(f_occupied));
+}
+
+
+template<int MAX_S>
+void BitboardCoverageMap<MAX_S>::clear_visited() {
+    memset(f_visited, 0, sizeof(f_visited));
+}
+
+
+template<int MAX_S>
+void BitboardCoverageMap<MAX_S>::set_occupied(vector<Knight*> &knights) {
+
+    memset(f_occupied, 0, sizeof(f_occupied));
+
+    int n = knights.size();
+    for(int i = 0; i < n; i++) {
+        if (knights[i]->f_n_p < 0)
+            continue;
+        f_occupied[knights[i]->f_y] |= 1ULL << knights[i]->f_x;
+    }
+
+    for(int y = 0; y < f_S; y++)
+        f_visited[y] |= f_occupied[y];
+}
+
+
+template<int MAX_S>
+int BitboardCoverageMap<MAX_S>::number_of_visited() {
+
+    int n = 0;
+    for(int y = 0; y < f_S; y++)
+        n += __builtin_popcountll(f_visited[y]);
+
+    return n;
+}
+
+
+template<int MAX_S>
+bool BitboardCoverageMap<MAX_S>::nearest_unexplored(int x, int y, int &ux, int &uy) {
+
+    // Walk the rows outwards from y, in each row the closest free bit
+    // on either side of x is one count-leading/trailing-zeros away.
+    int best = 2*f_S;
+    for(int dy = 0; dy < best && dy < f_S; dy++) {
+
+        int rows[2] = {y - dy, y + dy};
+        for(int r = 0; r < (dy == 0 ? 1 : 2); r++) {
+
+            int row = rows[r];
+            if (row < 0 || row > f_S - 1)
+                continue;
+
+            uint64_t free_cells = ~f_visited[row] & f_mask;
+            if (free_cells == 0)
+                continue;
+
+            uint64_t left = free_cells & ((2ULL << x) - 1);
+            if (left != 0) {
+                int bx = 63 - __builtin_clzll(left);
+                if (dy + x - bx < best) {
+                    best = dy + x - bx;
+                    ux = bx;
+                    uy = row;
+                }
+            }
+
+            uint64_t right = free_cells >> x;
+            if (right != 0) {
+                int bx = x + __builtin_ctzll(right);
+                if (dy + bx - x < best) {
+                    best = dy + bx - x;
+                    ux = bx;
+                    uy = row;
+                }
+            }
+        }
+    }
+
+    return best < 2*f_S;
+}
+
+
+// Any board, f_W words per row and bit x of the row is bit x%64 of
+// word x/64. The reference of CheckedCoverageMap.
+class WideBitboardCoverageMap : public CoverageMapBatch<WideBitboardCoverageMap> {
+    public:
+        int f_S;
+        int f_W;
+        uint64_t f_last_mask; // valid bits of the last word of a row
+        vector<uint64_t> f_visited; // row y starts at f_visited[y*f_W]
+
+        WideBitboardCoverageMap(int S);
+
+        CoverageMap *clone() const {return new WideBitboardCoverageMap(*this);}
+        void clear_visited();
+        void set_occupied(vector<Knight*> &knights);
+        int number_of_visited();
+        bool nearest_unexplored(int x, int y, int &ux, int &uy);
+        bool is_visited(int x, int y) {return (f_visited[y*f_W + x/64] >> (x % 64)) & 1;}
+        void copy_visited(vector<uint64_t> &rows) {rows = f_visited;}
+
+        uint64_t free_cells(int y, int w) {
+            return ~f_visited[y*f_W + w] & (w == f_W - 1 ? f_last_mask : ~0ULL);
+        }
+};
+
+
+WideBitboardCoverageMap::WideBitboardCoverageMap(int S) {
+
+    f_S = S;
+    f_W = (S + 63)/64;
+    f_last_mask = S % 64 == 0 ? ~0ULL : (1ULL << (S % 64)) - 1;
+    f_visited.resize(f_S*f_W, 0);
+}
+
+
+void WideBitboardCoverageMap::clear_visited() {
+    fill(f_visited.begin(), f_visited.end(), 0);
+}
+
+
+void WideBitboardCoverageMap::set_occupied(vector<Knight*> &knights) {
+
+    // Nothing reads the occupied cells apart from the visited
+    // ones, so they go straight into f_visited.
+    int n = knights.size();
+    for(int i = 0; i < n; i++) {
+        if (knights[i]->f_n_p < 0)
+            continue;
+        int x = knights[i]->f_x;
+        f_visited[knights[i]->f_y*f_W + x/64] |= 1ULL << (x % 64);
+    }
+}
+
+
+int WideBitboardCoverageMap::number_of_visited() {
+
+    int n = 0;
+    int n_words = f_visited.size();
+    for(int i = 0; i < n_words; i++)
+        n += __builtin_popcountll(f_visited[i]);
+
+    return n;
+}
+
+
+bool WideBitboardCoverageMap::nearest_unexplored(int x, int y, int &ux, int &uy) {
+
+    // As in BitboardCoverageMap, but the closest free bit on either
+    // side of x may be some words away. The scan of a row stops as
+    // soon as it cannot beat the best cell found so far.
+    int best = 2*f_S;
+    int wx = x/64;
+    int bx = x % 64;
+    for(int dy = 0; dy < best && dy < f_S; dy++) {
+
+        int rows[2] = {y - dy, y + dy};
+        for(int r = 0; r < (dy == 0 ? 1 : 2); r++) {
+
+            int row = rows[r];
+            if (row < 0 || row > f_S - 1)
+                continue;
+
+            for(int w = wx; w >= 0 && dy + x - 64*w - 63 < best; w--) {
+                uint64_t left = free_cells(row, w);
+                if (w == wx)
+                    left &= bx == 63 ? ~0ULL : (2ULL << bx) - 1;
+                if (left == 0)
+                    continue;
+
+                int cx = 64*w + 63 - __builtin_clzll(left);
+                if (dy + x - cx < best) {
+                    best = dy + x - cx;
+                    ux = cx;
+                    uy = row;
+                }
+                break;
+            }
+
+            for(int w = wx; w < f_W && dy + 64*w - x < best; w++) {
+                uint64_t right = free_cells(row, w);
+                if (w == wx)
+                    right &= ~0ULL << bx;
+                if (right == 0)
+                    continue;
+
+                int cx = 64*w + __builtin_ctzll(right);
+                if (dy + cx - x < best) {
+                    best = dy + cx - x;
+                    ux = cx;
+                    uy = row;
+                }
+                break;
+            }
+        }
+    }
+
+    return best < 2*f_S;
+}
+
+
+// Boards wider than 64 cells as tiles of 64 x 64 cells, one word per
+// tile row. A tile gets its words when a knight first enters it, so a
+// mostly unexplored board is cheap to copy and to clear. A quadtree
+// over the tiles counts the visited cells under every node: the root
+// is number_of_visited, and nearest_unexplored goes down the nearest
+// nodes first, skipping full nodes and nodes no closer than the best
+// cell found, so it only scans the tiles around the answer.
+class TiledCoverageMap : public CoverageMapBatch<TiledCoverageMap> {
+    public:
+        int f_S;
+        vector<int> f_side; // nodes per side, level 0 are the tiles
+        vector<vector<int>> f_count; // f_count[l][ny*f_side[l] + nx], visited cells
+        vector<int> f_tile_words; // first word of a tile in f_words or -1
+        vector<uint64_t> f_words; // 64 per tile, bit x of word y is cell (64*tx + x, 64*ty + y)
+
+        TiledCoverageMap(int S);
+
+        CoverageMap *clone() const {return new TiledCoverageMap(*this);}
+        void clear_visited();
+        void set_occupied(vector<Knight*> &knights);
+        int number_of_visited() {return f_count.back()[0];}
+        bool nearest_unexplored(int x, int y, int &ux, int &uy);
+        bool is_visited(int x, int y) {
+            int w = f_tile_words[(y/64)*f_side[0] + x/64];
+            return w >= 0 && ((f_words[w + y % 64] >> (x % 64)) & 1);
+        }
+        void copy_visited(vector<uint64_t> &rows);
+
+        // Cells of a node, [x0, x1) x [y0, y1).
+        void node_cells(int l, int nx, int ny, int &x0, int &y0, int &x1, int &y1) {
+            x0 = (64 << l)*nx;
+            y0 = (64 << l)*ny;
+            x1 = min(f_S, x0 + (64 << l));
+            y1 = min(f_S, y0 + (64 << l));
+        }
+
+        // Row r of tile (tx, ty), 0 outside the board or if unvisited.
+        uint64_t tile_row(int tx, int ty, int r) {
+            if (tx < 0 || ty < 0 || tx >= f_side[0] || ty >= f_side[0])
+                return 0;
+            int w = f_tile_words[ty*f_side[0] + tx];
+            return w >= 0 ? f_words[w + r] : 0;
+        }
+
+        uint64_t tile_mask(int tx) {
+            int n = min(64, f_S - 64*tx);
+            return n == 64 ? ~0ULL : (1ULL << n) - 1;
+        }
+
+        void nearest_in_node(int l, int nx, int ny, int x, int y, int &best, int &ux, int &uy);
+        void nearest_in_tile(int tx, int ty, int x, int y, int &best, int &ux, int &uy);
+};
+
+
+// Word tx of a board row is tile column tx, tiles not entered yet are 0.
+void TiledCoverageMap::copy_visited(vector<uint64_t> &rows) {
+
+    int side = f_side[0];
+    rows.assign(f_S*side, 0);
+    for(int ty = 0; ty < side; ty++) {
+        for(int tx = 0; tx < side; tx++) {
+            int w = f_tile_words[ty*side + tx];
+            if (w < 0)
+                continue;
+            for(int r = 0; r < min(64, f_S - 64*ty); r++)
+                rows[(64*ty + r)*side + tx] = f_words[w + r];
+        }
+    }
+}
+
+
+TiledCoverageMap::TiledCoverageMap(int S) {
+
+    f_S = S;
+    int side = (S + 63)/64;
+    f_side.push_back(side);
+    while (side > 1) {
+        side = (side + 1)/2;
+        f_side.push_back(side);
+    }
+
+    for(int l = 0; l < (int)f_side.size(); l++)
+        f_count.push_back(vector<int>(f_side[l]*f_side[l], 0));
+    f_tile_words.assign(f_side[0]*f_side[0], -1);
+}
+
+
+void TiledCoverageMap::clear_visited() {
+
+    for(int l = 0; l < (int)f_count.size(); l++)
+        fill(f_count[l].begin(), f_count[l].end(), 0);
+    fill(f_tile_words.begin(), f_tile_words.end(), -1);
+    f_words.clear();
+}
+
+
+void TiledCoverageMap::set_occupied(vector<Knight*> &knights) {
+
+    // Only cells visited for the first time go up the tree.
+    int n = knights.size();
+    int n_levels = f_side.size();
+    for(int i = 0; i < n; i++) {
+        if (knights[i]->f_n_p < 0)
+            continue;
+
+        int x = knights[i]->f_x;
+        int y = knights[i]->f_y;
+        int t = (y/64)*f_side[0] + x/64;
+        if (f_tile_words[t] < 0) {
+            f_tile_words[t] = f_words.size();
+            f_words.resize(f_words.size() + 64, 0);
+        }
+
+        uint64_t &word = f_words[f_tile_words[t] + y % 64];
+        uint64_t bit = 1ULL << (x % 64);
+        if ((word & bit) != 0)
+            continue;
+        word |= bit;
+
+        for(int l = 0; l < n_levels; l++)
+            f_count[l][(y/(64 << l))*f_side[l] + x/(64 << l)]++;
+    }
+}
+
+
+bool TiledCoverageMap::nearest_unexplored(int x, int y, int &ux, int &uy) {
+
+    int best = 2*f_S;
+    nearest_in_node(f_side.size() - 1, 0, 0, x, y, best, ux, uy);
+
+    return best < 2*f_S;
+}
+
+
+void TiledCoverageMap::nearest_in_node(int l, int nx, int ny, int x, int y, int &best, int &ux, int &uy) {
+
+    int x0, y0, x1, y1;
+    node_cells(l, nx, ny, x0, y0, x1, y1);
+    if (f_count[l][ny*f_side[l] + nx] == (x1 - x0)*(y1 - y0))
+        return;
+
+    // No cell of the node is closer than its nearest cell.
+    int d = max(0, max(x0 - x, x - x1 + 1)) + max(0, max(y0 - y, y - y1 + 1));
+    if (d >= best)
+        return;
+
+    if (l == 0) {
+        nearest_in_tile(nx, ny, x, y, best, ux, uy);
+        return;
+    }
+
+    // Children, nearest first, by insertion into at most 4 slots.
+    pair<int, int> children[4];
+    int n_children = 0;
+    for(int cy = 2*ny; cy < min(2*ny + 2, f_side[l - 1]); cy++) {
+        for(int cx = 2*nx; cx < min(2*nx + 2, f_side[l - 1]); cx++) {
+            node_cells(l - 1, cx, cy, x0, y0, x1, y1);
+            d = max(0, max(x0 - x, x - x1 + 1)) + max(0, max(y0 - y, y - y1 + 1));
+            pair<int, int> child(d, cy*f_side[l - 1] + cx);
+            int c = n_children++;
+            for(; c > 0 && child < children[c - 1]; c--)
+                children[c] = children[c - 1];
+            children[c] = child;
+        }
+    }
+
+    for(int c = 0; c < n_children; c++)
+        nearest_in_node(l - 1, children[c].second % f_side[l - 1], children[c].second/f_side[l - 1], x, y, best, ux, uy);
+}
+
+
+void TiledCoverageMap::nearest_in_tile(int tx, int ty, int x, int y, int &best, int &ux, int &uy) {
+
+    int x0 = 64*tx;
+    int y0 = 64*ty;
+    int n_rows = min(64, f_S - y0);
+    uint64_t mask = tile_mask(tx);
+    int cx = min(max(x - x0, 0), 63 - __builtin_clzll(mask)); // x clamped into the tile
+    int cy = min(max(y - y0, 0), n_rows - 1);
+
+    // Rows outwards from the one closest to y, as in BitboardCoverageMap.
+    for(int k = 0; k < n_rows; k++) {
+        bool in_reach = false;
+        for(int side = 0; side < (k == 0 ? 1 : 2); side++) {
+            int r = side == 0 ? cy - k : cy + k;
+            int dy = abs(y0 + r - y);
+            if (r < 0 || r >= n_rows || dy >= best)
+                continue;
+            in_reach = true;
+
+            uint64_t free_cells = ~tile_row(tx, ty, r) & mask;
+            uint64_t left = free_cells & ((2ULL << cx) - 1);
+            if (left != 0) {
+                int bx = x0 + 63 - __builtin_clzll(left);
+                if (dy + abs(x - bx) < best) {
+                    best = dy + abs(x - bx);
+                    ux = bx;
+                    uy = y0 + r;
+                }
+            }
+
+            uint64_t right = free_cells >> cx;
+            if (right != 0) {
+                int bx = x0 + cx + __builtin_ctzll(right);
+                if (dy + abs(x - bx) < best) {
+                    best = dy + abs(x - bx);
+                    ux = bx;
+                    uy = y0 + r;
+                }
+            }
+        }
+
+        // Rows further out are further from y.
+        if (in_reach == false)
+            break;
+    }
+}
+
+
+#if CHECK_INVARIANTS == 1
+
+// Runs a bitboard or tiled map next to the word array map, which
+// handles any board size, and asserts that both answer every query the
+// same way.
+class CheckedCoverageMap : public CoverageMap {
+    public:
+        unique_ptr<CoverageMap> f_fast;
+        WideBitboardCoverageMap f_reference;
+
+        CheckedCoverageMap(CoverageMap *fast, int S): f_fast(fast), f_reference(S) {}
+        CheckedCoverageMap(const CheckedCoverageMap &other): f_fast(other.f_fast->clone()), f_reference(other.f_reference) {}
+
+        CoverageMap *clone() const {return new CheckedCoverageMap(*this);}
+        void clear_visited() {f_fast->clear_visited(); f_reference.clear_visited();}
+        void set_occupied(vector<Knight*> &knights) {f_fast->set_occupied(knights); f_reference.set_occupied(knights);}
+
+        int number_of_visited() {
+            int n = f_fast->number_of_visited();
+            assert(n == f_reference.number_of_visited());
+            return n;
+        }
+
+        // Ties may be broken differently, only the distance must agree.
+        bool nearest_unexplored(int x, int y, int &ux, int &uy) {
+            int rx, ry;
+            bool found = f_fast->nearest_unexplored(x, y, ux, uy);
+            assert(found == f_reference.nearest_unexplored(x, y, rx, ry));
+            assert(found == false || abs(ux - x) + abs(uy - y) == abs(rx - x) + abs(ry - y));
+            return found;
+        }
+
+        void nearest_unexplored_cells(vector<Knight*> &knights, const int *ids, int n, int *ux, int *uy) {
+            f_fast->nearest_unexplored_cells(knights, ids, n, ux, uy);
+            for(int k = 0; k < n; k++) {
+                int i = ids[k];
+                int rx, ry;
+                bool found = f_reference.nearest_unexplored(knights[i]->f_x, knights[i]->f_y, rx, ry);
+                assert(found == (ux[i] >= 0));
+                assert(found == false || abs(ux[i] - knights[i]->f_x) + abs(uy[i] - knights[i]->f_y) ==
+                                         abs(rx - knights[i]->f_x) + abs(ry - knights[i]->f_y));
+            }
+        }
+
+        bool is_visited(int x, int y) {
+            bool visited = f_fast->is_visited(x, y);
+            assert(visited == f_reference.is_visited(x, y));
+            return visited;
+        }
+
+        void copy_visited(vector<uint64_t> &rows) {
+            vector<uint64_t> reference;
+            f_fast->copy_visited(rows);
+            f_reference.copy_visited(reference);
+            assert(rows == reference);
+        }
+};
+
+#endif
+
+
+CoverageMap *make_coverage_map(int S) {
+
+    #if CHECK_INVARIANTS == 1
+    CoverageMap *fast = S <= 16 ? (CoverageMap*)new BitboardCoverageMap<16>(S) :
+                        S <= 32 ? (CoverageMap*)new BitboardCoverageMap<32>(S) :
+                        S <= 64 ? (CoverageMap*)new BitboardCoverageMap<64>(S) :
+                                  (CoverageMap*)new TiledCoverageMap(S);
+    return new CheckedCoverageMap(fast, S);
+    #endif
+
+    if (S <= 16)
+        return new BitboardCoverageMap<16>(S);
+    else if (S <= 32)
+        return new BitboardCoverageMap<32>(S);
+    else if (S <= 64)
+        return new BitboardCoverageMap<64>(S);
+
+    return new TiledCoverageMap(S);
+}
+
+
+// Owns the coverage map of a GameState, copies clone the map so a
+// copied GameState searches on its own board.
+class CoverageMapPtr {
+    public:
+        unique_ptr<CoverageMap> f_map;
+
+        CoverageMapPtr() {}
+        CoverageMapPtr(const CoverageMapPtr &other): f_map(other.f_map ? other.f_map->clone() : nullptr) {}
+        CoverageMapPtr &operator=(const CoverageMapPtr &other) {
+            f_map.reset(other.f_map ? other.f_map->clone() : nullptr);
+            return *this;
+        }
+        CoverageMapPtr(CoverageMapPtr &&other): f_map(move(other.f_map)) {}
+        CoverageMapPtr &operator=(CoverageMapPtr &&other) {
+            f_map = move(other.f_map);
+            return *this;
+        }
+
+        void reset(CoverageMap *map) {f_map.reset(map);}
+        CoverageMap *operator->() const {return f_map.get();}
+};
+
+
+// --------------------------------------------
+// ---------  Dispersal Controller  -----------
+// --------------------------------------------
+
+
+// Watches pickups (new escorts and rescued princesses) and knight
+// losses as moving averages per turn. GameState::adapt_dispersal acts
+// on them once every f_period turns.
+class DispersalController {
+    public:
+        int f_period;
+        int f_next_update_turn;
+        int f_last_escorted;
+        int f_last_P;
+        int f_last_alive;
+        double f_pickup_rate;
+        double f_best_pickup_rate;
+        double f_loss_rate;
+        double f_stay_probability; // of the repulsive random walk
+
+        DispersalController(): f_period(1), f_next_update_turn(0), f_last_escorted(0), f_last_P(-1), f_last_alive(-1),
+                               f_pickup_rate(0.0), f_best_pickup_rate(0.0), f_loss_rate(0.0), f_stay_probability(0.05) {}
+
+        void observe(int escorted, int P, int alive);
+};
+
+
+void DispersalController::observe(int escorted, int P, int alive) {
+
+    if (f_last_P < 0) {
+        f_last_escorted = escorted;
+        f_last_P = P;
+        f_last_alive = alive;
+    }
+
+    int pickups = max(0, escorted - f_last_escorted) + max(0, f_last_P - P);
+    int losses = max(0, f_last_alive - alive);
+
+    double alpha = 0.05;
+    f_pickup_rate = (1.0 - alpha)*f_pickup_rate + alpha*pickups;
+    f_loss_rate = (1.0 - alpha)*f_loss_rate + alpha*losses;
+    f_best_pickup_rate = max(f_best_pickup_rate, f_pickup_rate);
+
+    f_last_escorted = escorted;
+    f_last_P = P;
+    f_last_alive = alive;
+}
+
+
+// --------------------------------------------
+// ------------  Dispersal Walks  -------------
+// --------------------------------------------
+
+
+// Random steps of dispersing knights. The policy only records them and
+// they are taken once it is done with the knights of the turn
+// (GameState::take_walks), so the steps of many games played in
+// lockstep are drawn in one pass (PrincessesAndMonstersBatch).
+//
+// Step k stays with probability f_stay[k], otherwise it goes one cell
+// N, E, W or S, weighted by the Manhattan distance of that cell to
+// (f_px[k], f_py[k]) if repulsive, by one over one plus it if
+// attractive. The draws are those of a CounterRng with key f_key[k].
+enum WalkKind {WALK_NONE, WALK_REPULSIVE, WALK_ATTRACTIVE};
+
+class DispersalWalks {
+    public:
+        vector<uint64_t> f_key;
+        vector<int> f_S;
+        vector<int> f_x;
+        vector<int> f_y;
+        vector<int> f_px;
+        vector<int> f_py;
+        vector<char> f_kind;
+        vector<double> f_stay;
+        vector<int> f_move; // index in NEWS, -1 to stay, set by walk
+
+        int size() {return f_key.size();}
+        void clear();
+        void add(uint64_t key, int S, int x, int y, int px, int py, char kind, double stay);
+        void walk();
+};
+
+
+void DispersalWalks::clear() {
+    f_key.clear();
+    f_S.clear();
+    f_x.clear();
+    f_y.clear();
+    f_px.clear();
+    f_py.clear();
+    f_kind.clear();
+    f_stay.clear();
+}
+
+
+void DispersalWalks::add(uint64_t key, int S, int x, int y, int px, int py, char kind, double stay) {
+    f_key.push_back(key);
+    f_S.push_back(S);
+    f_x.push_back(x);
+    f_y.push_back(y);
+    f_px.push_back(px);
+    f_py.push_back(py);
+    f_kind.push_back(kind);
+    f_stay.push_back(stay);
+}
+
+
+void DispersalWalks::walk() {
+
+    int n = size();
+    f_move.resize(n);
+    for(int k = 0; k < n; k++) {
+
+        CounterRng rng(f_key[k]);
+        if (rng.uniform() < f_stay[k]) {
+            f_move[k] = -1;
+            continue;
+        }
+
+        // The cells N, E, W and S, clamped to the board.
+        int S = f_S[k];
+        int x[4] = {f_x[k], min(f_x[k] + 1, S - 1), max(f_x[k] - 1, 0), f_x[k]};
+        int y[4] = {max(f_y[k] - 1, 0), f_y[k], f_y[k], min(f_y[k] + 1, S - 1)};
+
+        double d[4];
+        for(int j = 0; j < 4; j++) {
+            int distance = abs(f_px[k] - x[j]) + abs(f_py[k] - y[j]);
+            d[j] = f_kind[k] == WALK_REPULSIVE ? distance : 1.0/(1 + distance);
+        }
+
+        double sum = d[0] + d[1] + d[2] + d[3];
+        double weights[4] = {d[0]/sum, d[1]/sum, d[2]/sum, d[3]/sum};
+        f_move[k] = rng.discrete(weights, 4);
+    }
+}
+
+
+// --------------------------------------------
+// ------------  Parameters  ------------------
+// --------------------------------------------
+
+
+// Constants of the strategy that harnesses may replace by name before
+// a game starts, to compare or tune them.
+class Parameters {
+    public:
+        double f_disperse_fraction; // of the knights that search
+        double f_initial_disperse_fraction; // of those, sent ahead of the army
+        double f_large_board; // boards with S above disperse in waves and hunt monsters
+        double f_stay_probability; // of the repulsive random walk, where DispersalController starts
+        double f_attractive_stay_probability; // of the attractive random walk
+
+        Parameters(): f_disperse_fraction(0.9), f_initial_disperse_fraction(0.5), f_large_board(40), f_stay_probability(0.05),
+                      f_attractive_stay_probability(0.05) {}
+
+        bool set(const string &name, double value);
+};
+
+
+bool Parameters::set(const string &name, double value) {
+
+    if (name == "disperse_fraction")
+        f_disperse_fraction = value;
+    else if (name == "initial_disperse_fraction")
+        f_initial_disperse_fraction = value;
+    else if (name == "large_board")
+        f_large_board = value;
+    else if (name == "stay_probability")
+        f_stay_probability = value;
+    else if (name == "attractive_stay_probability")
+        f_attractive_stay_probability = value;
+    else {
+        cerr << "Unknown parameter: " << name << endl;
+        return false;
+    }
+
+    return true;
+}
+
+
+// Orders as numbered in telemetry frames and events, anything else is
+// 255.
+const vector<string> order_names = {
+    "ORDER_MOVE_TO_PRINCESS_CENTER_OF_MASS", "ORDER_INITIALLY_DISPERSED", "ORDER_RANDOM_PRINCESS_SEARCH",
+    "ORDER_RETURN_TO_GLOBAL_ASSEMBLY_POINT", "ORDER_GUARD_CONVOY", "ORDER_FINAL_RETURN_TO_GLOBAL_ASSEMBLY_POINT",
+    "ORDER_KILL_MONSTERS", "ORDER_GO_TO_EXIT", "ORDER_DO_NOTHING"};
+
+
+int order_id(const string &order) {
+
+    int n_orders = order_names.size();
+    for(int o = 0; o < n_orders; o++) {
+        if (order_names[o] == order)
+            return o;
+    }
+
+    return 255;
+}
+
+
+// --------------------------------------------
+// ------------  GameState  -------------------
+// --------------------------------------------
+
+
+class GameState {
+    public:
+        string f_moves = "NEWS";
+        int f_S; // board size
+        int f_turn; // current turn
+        int f_n_knights; // number of knights
+        int f_n_princesses; // number of princesses
+        int f_n_monsters; // number of monsters
+        int f_total_dispersed;
+        double f_disperse_fraction;
+        double f_initial_disperse_fraction;
+        int f_max_number_of_dispersed_knights;
+        Parameters f_parameters;
+        vector<Knight*> f_knights;
+        vector<Princess> f_princesses;
+        vector<Monster> f_monsters;
+        vector<KnightGroup> f_knight_group_collection;
+        KnightAssignment f_assignment; // searching knights to search sectors
+        int f_n_search_sectors; // the other targets of f_assignment are suspected princess blocks
+        DeploymentScheduler f_deployment; // knights sent ahead of the army
+        InterceptionPlanner f_interception; // where the knights sent ahead meet princesses
+        RouteCache f_routes; // final return and exit routes
+        CoverageMapPtr f_coverage; // cells visited during the search
+        DispersalController f_controller; // search effort during the game
+
+        // Random step knight i takes this turn, f_walk_kind[i] (WalkKind)
+        // from (f_walk_x[i], f_walk_y[i]), see take_walks.
+        vector<char> f_walk_kind;
+        vector<int> f_walk_x;
+        vector<int> f_walk_y;
+        DispersalWalks f_walks;
+
+        // ORDER_KILL_MONSTERS state. f_column_monsters[x] is the expected
+        // number of monsters in column x, f_lane_owner[x] the squad hunting there.
+        vector<HuntingSquad> f_squads;
+        vector<double> f_column_monsters;
+        vector<int> f_lane_owner;
+        bool f_split_squads; // a squad took a new lane
+        int f_last_number_of_monsters;
+        int f_last_knights_alive;
+        double f_knight_loss_rate;
+
+        // Convoys of the returning knights, made again every turn.
+        // f_guard_target[i] is the knight guard i walks to or -1.
+        vector<Convoy> f_convoys;
+        vector<int> f_knight_convoy;
+        vector<int> f_guard_target;
+
+        string f_current_global_order_name;
+        string f_current_order_instructions;
+
+        pair<int, int> f_global_assembly_point;
+        int f_next_recenter_turn;
+
+        // Corners in entrance id order: top left, top right,
+        // bottom right, bottom left.
+        vector<pair<int, int>> f_corners;
+
+        // Random draws of knight i in a turn come from knight_rng(i).
+        uint64_t f_stream_seed;
+
+        // Per knight loops run on f_pool, shared by the copies of a game.
+        shared_ptr<TurnPool> f_pool;
+
+        // Events go to f_events if set, shared by the copies of a game,
+        // which tell theirs apart by f_event_source.
+        shared_ptr<EventLog> f_events;
+        int f_event_source;
+
+        // Set in the copies SpeculativePlanner plays a guess on, their
+        // turn stops with TurnCancelled once the guess is dropped.
+        const atomic<bool> *f_cancel;
+
+        // Nearest unexplored cell of the searching knights without a
+        // sector, found in find_frontier_cells at f_frontier_turn. It
+        // was f_frontier_d cells away from (f_frontier_from_x,
+        // f_frontier_from_y), -1 if it must be looked up again.
+        vector<int> f_frontier_x;
+        vector<int> f_frontier_y;
+        vector<int> f_frontier_turn;
+        vector<int> f_frontier_from_x;
+        vector<int> f_frontier_from_y;
+        vector<int> f_frontier_d;
+        vector<int> f_frontier_ids; // knights looked up this turn
+        vector<uint64_t> f_frontier_keys; // cell << 32 | knight
+
+        GameState();
+
+        CounterRng knight_rng(int i);
+        TurnPool *pool() {return f_pool.get();}
+
+        // Only on the thread playing the turn, never in a part job.
+        void check_cancel() {
+            if (f_cancel != nullptr && f_cancel->load(memory_order_relaxed) == true)
+                throw TurnCancelled();
+        }
+
+        template<class... Values>
+        void event(EventType type, Values... values) {
+            if (f_events)
+                f_events->push(type, f_event_source, f_turn, values...);
+        }
+
+        int knights_alive();
+
+        int _manhatan_distance_from_point(pair<int, int> &point, int &x, int &y);
+        double _euclidean_distance_from_point(pair<int, int> &point, int &x, int &y);
+
+        void set_S(int &S) {f_S = S; f_coverage.reset(make_coverage_map(S));}
+        void set_corners();
+        int closest_corner(int &x, int &y);
+        void set_fractions(double &disperse_fraction, double &initial_disperse_fraction);
+
+        void set_princesses(const int *pr, int n);
+        void log_princesses();
+
+        void set_monsters(const int *mo, int n);
+        void log_monsters();
+
+        void set_knights(vector<Knight> &knights);
+        void rebind_knights(vector<Knight> &knights, const vector<Knight> &old_knights);
+        void set_knights_entrances(pair<int, int> &target);
+        void set_knights_exits();
+        void update_knights_number_of_princesses(const int *status);
+
+        int get_number_of_escorted_princesses_at_cm(pair<int, int> &cm_point);
+
+        pair<int, int> _determine_the_number_of_groups();
+        void make_groups();
+        void log_groups();
+
+        pair<int, int> princess_center_of_mass();
+        void recenter_assembly_point();
+
+
+        string move_towards_point(pair<int, int> &point);
+        void move_towards_point(pair<int, int> &point, string &move_order);
+        void move_diagonally_towards_point(pair<int, int> &point, string &move_order);
+        void move_diagonally_knight_towards_point(pair<int, int> &point, string &move_order, int &id);
+        void move_knight_towards_point(pair<int, int> &point, string &move_order, int &id);
+        void check_move_towards(pair<int, int> &point, string &move_order, int &id, int x, int y);
+        void apply_move(char &c, int &id);
+        template<class Target>
+        void move_along_routes(Target target, string &move_order);
+        void move_towards_global_assembly_point(string &move_order);
+        void move_towards_exits(string &move_order);
+        bool princess_cm_reached(pair<int, int> &cm_point);
+        bool check_if_knight_reached_princess_cm(pair<int, int> &cm_point, int &id);
+        bool check_if_all_knights_reached_princess_cm(pair<int, int> &cm_point);
+
+        void send_global_order(string &order);
+        void send_order_to_all_knights(string &order);
+        void send_order_to_a_fraction_of_knights(string &order);
+
+        void random_disperse_the_ith_knight(string &move_order, int &i);
+        void repulsive_random_disperse_the_ith_knight(string &move_order, int &i);
+        template<class SearchStep>
+        void check_and_set_princess_escort_during_random_disperse(string &move_order, SearchStep search_step);
+        void find_frontier_cells();
+        void search_sector_or_frontier(string &move_order, int &i);
+        int convoy_size(int &distance, int &n_princesses, int &M);
+        void make_convoys(int &M);
+        void move_convoys(string &move_order, int &M);
+
+        void make_search_sectors();
+        void add_suspected_princess_targets();
+        void adapt_dispersal(int &P);
+        void assign_knights_to_search_sectors();
+
+        void make_deployment_schedule();
+        void deploy_next_wave();
+        void attractive_random_disperse_the_ith_knight(pair<int, int> &point, string &move_order, int &i);
+        void atractive_disperse(string &move_order);
+
+        void collect_walks(DispersalWalks &walks);
+        void apply_walks(DispersalWalks &walks, int &k, string &move_order);
+        void take_walks(string &move_order);
+
+        void estimate_column_monsters(int &M);
+        double expected_lane_kill_rate(int &x0, int &width);
+        int lane_strength(int &x0, int &width);
+        int alive_squad_members(int &s);
+        bool select_hunting_lane(int &s);
+        void retire_hunting_squad(int &s);
+        void split_hunting_squads();
+        int make_hunting_squads(int &M);
+        void move_hunting_squad(string &move_order, int &s);
+        bool hunt_monsters(string &move_order, int &M);
+
+};
+
+
+GameState::GameState() {
+
+    f_next_recenter_turn = 0;
+    f_turn = 0;
+    f_event_source = 0;
+    f_cancel = nullptr;
+
+    random_device rd;
+    f_stream_seed = ((uint64_t)rd() << 32) | rd();
+}
+
+
+CounterRng GameState::knight_rng(int i) {
+    return CounterRng(CounterRng::mix(f_stream_seed + ((uint64_t)f_turn << 32) + (uint32_t)i));
+}
+
+
+int GameState::knights_alive() {
+
+    int ka = 0;
+    for(int i = 0; i < f_n_knights; i++) {
+        if (f_knights[i]->f_n_p >= 0)        
+            ka++;
+    }
+
+    return ka;
+}
+
+
+int GameState::_manhatan_distance_from_point(pair<int, int> &point, int &x, int &y) {
+
+    return abs(point.first - x) + abs(point.second - y);
+}
+
+
+double GameState::_euclidean_distance_from_point(pair<int, int> &point, int &x, int &y) {
+
+    double dx = point.first - x;
+    double dy = point.second - y;
+
+    return sqrt(dx*dx + dy*dy);
+
+}
+
+
+void GameState::set_corners() {
+
+    f_corners = {make_pair(0, 0),
+                 make_pair(f_S - 1, 0),
+                 make_pair(f_S - 1, f_S - 1),
+                 make_pair(0, f_S - 1)};
+}
+
+
+int GameState::closest_corner(int &x, int &y) {
+
+    int c_min = 0;
+    int d_min = _manhatan_distance_from_point(f_corners[0], x, y);
+    int n_corners = f_corners.size();
+    for(int c = 1; c < n_corners; c++) {
+        int d = _manhatan_distance_from_point(f_corners[c], x, y);
+        if (d < d_min) {
+            d_min = d;
+            c_min = c;
+        }
+    }
+
+    return c_min;
+}
+
+
+void GameState::set_fractions(double &disperse_fraction, double &initial_disperse_fraction) {
+
+    f_total_dispersed = 0;
+    f_disperse_fraction = disperse_fraction;
+    f_initial_disperse_fraction = initial_disperse_fraction;
+    f_max_number_of_dispersed_knights = int(f_initial_disperse_fraction*f_disperse_fraction*f_n_knights);
+
+}
+
+
+void GameState::set_princesses(const int *pr, int n) {
+
+    f_n_princesses = n/2;
+    f_princesses.resize( n/2 );
+    for(int i = 0; i < n/2; i++) {
+        f_princesses[i].f_last_x = pr[2*i + 1];
+        f_princesses[i].f_last_y = pr[2*i];
+    }
+}
+
+
+void GameState::set_monsters(const int *mo, int n) {
+
+    f_n_monsters = n/2;
+    f_monsters.resize( n/2 );
+    for(int i = 0; i < n/2; i++) {
+        f_monsters[i].f_last_x = mo[2*i + 1];
+        f_monsters[i].f_last_y = mo[2*i];
+    }
+}
+
+
+void GameState::log_princesses() {
+    #if LOG_LEVEL >= 2
+    for(int i = 0; i < (int)f_princesses.size(); i++)
+        event(EVENT_PRINCESS, i, f_princesses[i].f_last_x, f_princesses[i].f_last_y);
+    #endif
+}
+
+
+void GameState::log_monsters() {
+    #if LOG_LEVEL >= 2
+    for(int i = 0; i < (int)f_monsters.size(); i++)
+        event(EVENT_MONSTER, i, f_monsters[i].f_last_x, f_monsters[i].f_last_y);
+    #endif
+}
+
+
+void GameState::set_knights(vector<Knight> &knights) {
+    int k = knights.size();
+    f_n_knights = k;
+    f_knights.resize(k);
+    for(int i = 0; i < k; i++)
+        f_knights[i] = &knights[i];
+
+    f_walk_kind.assign(k, WALK_NONE);
+    f_walk_x.assign(k, 0);
+    f_walk_y.assign(k, 0);
+
+}
+
+
+// After a copy the knight pointers still point into old_knights,
+// move them to the same knights of the copy.
+void GameState::rebind_knights(vector<Knight> &knights, const vector<Knight> &old_knights) {
+
+    for(int i = 0; i < f_n_knights; i++)
+        f_knights[i] = &knights[f_knights[i] - old_knights.data()];
+
+    int n_groups = f_knight_group_collection.size();
+    for(int g = 0; g < n_groups; g++) {
+        vector<Knight*> &group = f_knight_group_collection[g].f_knights_group;
+        int n = group.size();
+        for(int i = 0; i < n; i++) {
+            if (group[i] != nullptr)
+                group[i] = &knights[group[i] - old_knights.data()];
+        }
+    }
+}
+
+void GameState::set_knights_entrances(pair<int, int> &target) {
+
+    // Every knight starts in the corner from which its
+    // way to target is the shortest.
+    int e = closest_corner(target.first, target.second);
+
+    for(int i = 0; i < f_n_knights; i++) {
+        f_knights[i]->f_e = e;
+        f_knights[i]->f_x = f_corners[e].first;
+        f_knights[i]->f_y = f_corners[e].second;
+    }
+}
+
+
+void GameState::set_knights_exits() {
+
+    // Knights do not have to leave through the entrance,
+    // each one picks the corner closest to where it is now.
+    f_routes.f_valid = false;
+    for(int i = 0; i < f_n_knights; i++) {
+        if (f_knights[i]->f_n_p < 0)
+            continue;
+
+        f_knights[i]->f_e = closest_corner(f_knights[i]->f_x, f_knights[i]->f_y);
+    }
+}
+
+
+void GameState::update_knights_number_of_princesses(const int *status) {
+
+    // Knights whose status changed, by part.
+    vector<vector<int>> changed(number_of_parts(f_n_knights));
+    vector<vector<int>> change(changed.size());
+    for_each_part(pool(), f_n_knights, [&] (int p, int begin, int end) {
+        for(int i = begin; i < end; i++) {
+            int n_p = f_knights[i]->f_n_p;
+            // A knight that loses princesses alive has rescued them.
+            if (n_p >= 0 && (status[i] > n_p || (status[i] < 0 && n_p > 0))) {
+                changed[p].push_back(i);
+                change[p].push_back(status[i] < 0 ? -n_p : status[i] - n_p);
+            }
+
+            f_knights[i]->f_n_p = status[i];
+        }
+    });
+
+    // Princesses picked up leave the board, those of a knight that
+    // died are back on it. Rescued princesses left it at pickup.
+    for(int p = 0; p < (int)changed.size(); p++) {
+        for(int k = 0; k < (int)changed[p].size(); k++) {
+            int i = changed[p][k];
+            f_interception.collect(f_knights[i]->f_x, f_knights[i]->f_y, change[p][k]);
+        }
+    }
+}
+
+
+int GameState::get_number_of_escorted_princesses_at_cm(pair<int, int> &cm_point) {
+
+    vector<int> part_sum(number_of_parts(f_n_knights), 0);
+    for_each_part(pool(), f_n_knights, [&] (int p, int begin, int end) {
+        for(int i = begin; i < end; i++) {
+            if (f_knights[i]->f_n_p <= 0)
+                continue;
+            if (f_knights[i]->f_x == cm_point.first && f_knights[i]->f_y == cm_point.second)
+                part_sum[p] = part_sum[p] + f_knights[i]->f_n_p;
+        }
+    });
+
+    int n_princesses = 0;
+    for(int sum : part_sum)
+        n_princesses = n_princesses + sum;
+    return n_princesses;
+}
+
+
+pair<int, int> GameState::_determine_the_number_of_groups() {
+
+    // monster_p - probability of meeting a monster
+    //double monster_p = f_n_monsters / (f_S*f_S);
+
+    int min_number_of_knights_in_group = f_n_knights;
+    int number_of_groups = int(f_n_knights/min_number_of_knights_in_group);
+
+    return make_pair(min_number_of_knights_in_group, number_of_groups);
+}
+
+
+void GameState::make_groups() {
+
+    pair<int, int> group_parameters = _determine_the_number_of_groups();
+
+    int min_number_of_knights_in_group = group_parameters.first;
+    int number_of_groups = group_parameters.second;
+
+
+    int q = min_number_of_knights_in_group*number_of_groups;
+
+    #if LOG_LEVEL >= 1
+    event(EVENT_GROUPS, min_number_of_knights_in_group, number_of_groups);
+    #endif
+
+    if (q == f_n_knights) {
+        f_knight_group_collection.resize(number_of_groups);
+    } else if (q < f_n_knights) {
+        number_of_groups = number_of_groups + 1;
+        f_knight_group_collection.resize(number_of_groups);
+    } else {
+        fprintf(stderr, "Cannot have more groups than knights!\n");        
+        assert(false);
+    }
+
+
+    int knight_index = 0;
+    for(int i = 0; i < number_of_groups; i++) {
+
+        for(int j = 0; j < min_number_of_knights_in_group; j++) {
+
+            Knight *kp = f_knights[knight_index];
+            f_knight_group_collection[i].f_knights_group.push_back(kp);
+
+            knight_index++;
+            if (knight_index == f_n_knights)
+                break;
+        }
+    }
+}
+
+
+void GameState::log_groups() {
+
+    #if LOG_LEVEL >= 2
+    int n = f_knight_group_collection.size();
+    for(int i = 0; i < n; i++) {
+        int n_kinghts = f_knight_group_collection[i].f_knights_group.size();
+        for(int j = 0; j < n_kinghts; j++)
+            event(EVENT_GROUP_MEMBER, i, f_knight_group_collection[i].f_knights_group[j]->f_id);
+    }
+    #endif
+}
+
+
+// The center of the board without princesses.
+pair<int, int> GameState::princess_center_of_mass() {
+
+    // The sums outgrow an int for large boards.
+    long long x_sum = 0;
+    long long y_sum = 0;
+
+    for(int i = 0; i < f_n_princesses; i++) {
+        x_sum = x_sum + f_princesses[i].f_last_x;
+        y_sum = y_sum + f_princesses[i].f_last_y;
+    }
+
+    int x_cm = f_n_princesses > 0 ? int(x_sum/f_n_princesses) : f_S/2;
+    int y_cm = f_n_princesses > 0 ? int(y_sum/f_n_princesses) : f_S/2;
+
+    #if LOG_LEVEL >= 1
+    event(EVENT_CENTER_OF_MASS, x_cm, y_cm);
+    #endif
+
+    return make_pair(x_cm, y_cm);
+
+}
+
+
+// Every princess still on the board costs a knight the walk from her
+// block to the assembly point and back, every escorted princess the
+// walk of her escort from where it is. The point with the least total
+// walk is the weighted median of the rows and of the columns. The
+// point moves there when that saves more than a tenth of the walk, a
+// small saving is not worth sending the waiting escorts after it.
+void GameState::recenter_assembly_point() {
+
+    if (f_turn < f_next_recenter_turn)
+        return;
+    f_next_recenter_turn = f_turn + f_S;
+
+    vector<double> wx(f_S, 0.0);
+    vector<double> wy(f_S, 0.0);
+
+    vector<double> &remaining = f_interception.remaining(f_turn);
+    int n_blocks = remaining.size();
+    for(int b = 0; b < n_blocks; b++) {
+        pair<int, int> c = f_interception.center(b);
+        wx[c.first] += remaining[b];
+        wy[c.second] += remaining[b];
+    }
+
+    for(int i = 0; i < f_n_knights; i++) {
+        if (f_knights[i]->f_n_p <= 0)
+            continue;
+        wx[f_knights[i]->f_x] += f_knights[i]->f_n_p;
+        wy[f_knights[i]->f_y] += f_knights[i]->f_n_p;
+    }
+
+    double total = 0;
+    for(int x = 0; x < f_S; x++)
+        total += wx[x];
+    if (total < EPSILON)
+        return;
+
+    pair<int, int> median;
+    double sx = 0, sy = 0;
+    for(median.first = 0; median.first < f_S - 1 && 2*(sx + wx[median.first]) < total; median.first++)
+        sx += wx[median.first];
+    for(median.second = 0; median.second < f_S - 1 && 2*(sy + wy[median.second]) < total; median.second++)
+        sy += wy[median.second];
+
+    double cost_now = 0, cost_median = 0;
+    for(int z = 0; z < f_S; z++) {
+        cost_now += wx[z]*abs(z - f_global_assembly_point.first) + wy[z]*abs(z - f_global_assembly_point.second);
+        cost_median += wx[z]*abs(z - median.first) + wy[z]*abs(z - median.second);
+    }
+
+    if (cost_median < 0.9*cost_now) {
+
+        #if LOG_LEVEL >= 1
+        event(EVENT_ASSEMBLY_POINT, f_global_assembly_point.first, f_global_assembly_point.second,
+              median.first, median.second, cost_now, cost_median);
+        #endif
+
+        f_global_assembly_point = median;
+        f_routes.f_valid = false;
+    }
+}
+
+void GameState::move_knight_towards_point(pair<int, int> &point,
+                                            string &move_order,
+                                            int &id) {
+
+    if (point.first > f_knights[id]->f_x) {
+
+        move_order[id] = 'E'; // move right
+        if (f_knights[id]->f_x < f_S - 1) 
+            f_knights[id]->f_x = f_knights[id]->f_x + 1;
+
+    } else if (point.first < f_knights[id]->f_x) {
+
+        move_order[id] = 'W'; // move left
+        if (f_knights[id]->f_x > 0) 
+            f_knights[id]->f_x = f_knights[id]->f_x - 1;
+
+    } else if (point.second > f_knights[id]->f_y) {
+
+        move_order[id] = 'S'; // move left
+        if (f_knights[id]->f_y < f_S - 1) 
+            f_knights[id]->f_y = f_knights[id]->f_y + 1;
+
+    } else if (point.second < f_knights[id]->f_y) {
+
+        move_order[id] = 'N'; // move left
+        if (f_knights[id]->f_y > 0) 
+            f_knights[id]->f_y = f_knights[id]->f_y - 1;
+
+    }
+
+}
+
+
+// Knight id moved from (x, y) as move_knight_towards_point moves it to
+// point, for moves made another way (CHECK_INVARIANTS).
+void GameState::check_move_towards(pair<int, int> &point, string &move_order, int &id, int x, int y) {
+
+    char c = move_order[id];
+    int x1 = f_knights[id]->f_x;
+    int y1 = f_knights[id]->f_y;
+
+    move_order[id] = 'X';
+    f_knights[id]->f_x = x;
+    f_knights[id]->f_y = y;
+    move_knight_towards_point(point, move_order, id);
+    assert(move_order[id] == c && f_knights[id]->f_x == x1 && f_knights[id]->f_y == y1);
+}
+
+
+void GameState::apply_move(char &c, int &id) {
+
+    if (c == 'N' && f_knights[id]->f_y > 0)
+        f_knights[id]->f_y = f_knights[id]->f_y - 1;
+    else if (c == 'E' && f_knights[id]->f_x < f_S - 1)
+        f_knights[id]->f_x = f_knights[id]->f_x + 1;
+    else if (c == 'W' && f_knights[id]->f_x > 0)
+        f_knights[id]->f_x = f_knights[id]->f_x - 1;
+    else if (c == 'S' && f_knights[id]->f_y < f_S - 1)
+        f_knights[id]->f_y = f_knights[id]->f_y + 1;
+}
+
+
+// Routes are built on the first turn of a phase, target(i) is only
+// called then. Anything that moves a target invalidates them.
+template<class Target>
+void GameState::move_along_routes(Target target, string &move_order) {
+
+    if (f_routes.f_valid == false) {
+        f_routes.build(f_knights, target);
+
+        #if LOG_LEVEL >= 1
+        event(EVENT_ROUTES, f_routes.f_length);
+        #endif
+    }
+
+    for_each_part(pool(), f_n_knights, [&] (int, int begin, int end) {
+        for(int i = begin; i < end; i++) {
+            if (f_knights[i]->f_n_p < 0)
+                f_routes.invalidate_knight(i);
+
+            #if CHECK_INVARIANTS == 1
+            int x = f_knights[i]->f_x;
+            int y = f_knights[i]->f_y;
+            #endif
+
+            move_order[i] = f_routes.next_move(i);
+            apply_move(move_order[i], i);
+
+            #if CHECK_INVARIANTS == 1
+            if (f_knights[i]->f_n_p >= 0) {
+                pair<int, int> t = target(i);
+                check_move_towards(t, move_order, i, x, y);
+            }
+            #endif
+        }
+    });
+}
+
+
+void GameState::move_towards_global_assembly_point(string &move_order) {
+    move_along_routes([&] (int) {return f_global_assembly_point;}, move_order);
+}
+
+
+void GameState::move_towards_exits(string &move_order) {
+    move_along_routes([&] (int i) {return f_corners[f_knights[i]->f_e];}, move_order);
+}
+
+
+void GameState::move_diagonally_knight_towards_point(pair<int, int> &point,
+                                                     string &move_order,
+                                                     int &id) {
+
+
+    if (point.first == f_knights[id]->f_x && point.second == f_knights[id]->f_y)
+        return;
+
+    int x0 = f_knights[id]->f_x;
+    int y0 = f_knights[id]->f_y - 1;
+
+    if (y0 < 0)
+        y0 = 0;
+
+    int x1 = f_knights[id]->f_x + 1;
+    int y1 = f_knights[id]->f_y;
+
+    if (x1 > f_S - 1)
+        x1 = f_S - 1;
+
+    int x2 = f_knights[id]->f_x - 1;
+    int y2 = f_knights[id]->f_y;
+
+    if (x2 < 0)
+        x2 = 0;
+
+    int x3 = f_knights[id]->f_x;
+    int y3 = f_knights[id]->f_y + 1;
+
+    if (y3 > f_S - 1)
+        y3 = f_S - 1;
+
+    double x0d = _euclidean_distance_from_point(point, x0, y0);
+    double x1d = _euclidean_distance_from_point(point, x1, y1);
+    double x2d = _euclidean_distance_from_point(point, x2, y2);
+    double x3d = _euclidean_distance_from_point(point, x3, y3);
+    
+    // Find smallest distance to point.
+    vector<double> vec{x0d, x1d, x2d, x3d};
+    vector<double>::iterator result = min_element(begin(vec), end(vec));
+    int move_id = distance(begin(vec), result);
+
+    move_order[id] = f_moves[move_id];
+    if (move_id == 0) {
+
+        if (f_knights[id]->f_y > 0) {
+            f_knights[id]->f_y = f_knights[id]->f_y - 1;
+
+        }
+    } else if (move_id == 1) {
+
+        if (f_knights[id]->f_x < f_S - 1) {
+            f_knights[id]->f_x = f_knights[id]->f_x + 1;
+
+        }
+    } else if (move_id == 2) {
+
+        if (f_knights[id]->f_x > 0) {
+            f_knights[id]->f_x = f_knights[id]->f_x - 1;
+
+        }
+    } else if (move_id == 3) {
+
+        if (f_knights[id]->f_y < f_S - 1) {
+            f_knights[id]->f_y = f_knights[id]->f_y + 1;
+
+        }
+    }
+
+
+
+}
+
+
+void GameState::move_towards_point(pair<int, int> &point, string &move_order) {
+
+    //fprintf(stderr, "Moving towards (%d, %d)\n", point.first, point.second);
+    for(int i = 0; i < f_n_knights; i++) {
+        //
+        if (f_knights[i]->f_n_p < 0 || f_knights[i]->f_order == "ORDER_INITIALLY_DISPERSED")
+            continue;
+
+        move_knight_towards_point(point, move_order, i);
+    }
+}
+
+
+
+void GameState::move_diagonally_towards_point(pair<int, int> &point, string &move_order) {
+
+    //fprintf(stderr, "Moving towards (%d, %d)\n", point.first, point.second);
+    for_each_part(pool(), f_n_knights, [&] (int, int begin, int end) {
+        for(int i = begin; i < end; i++) {
+            if (f_knights[i]->f_n_p < 0 || f_knights[i]->f_order == "ORDER_INITIALLY_DISPERSED")
+                continue;
+
+            move_diagonally_knight_towards_point(point, move_order, i);
+        }
+    });
+}
+
+
+bool GameState::princess_cm_reached(pair<int, int> &cm_point) {
+
+    // When ORDER_MOVE_TO_PRINCESS_CENTER_OF_MASS is issued all
+    // knights should move towards it. It is enough to check
+    // just one.
+    // This function should be executed only durring ORDER_MOVE_TO_PRINCESS_CENTER_OF_MASS
+    if (f_current_global_order_name != "ORDER_MOVE_TO_PRINCESS_CENTER_OF_MASS") {
+        cerr << "princess_cm_reached executed not durring ORDER_MOVE_TO_PRINCESS_CENTER_OF_MASS" << endl;
+        assert(false);
+    }
+
+    for(int i = 0; i < f_n_knights; i++) {
+
+        if (f_knights[i]->f_order == "ORDER_MOVE_TO_PRINCESS_CENTER_OF_MASS") {
+
+            if (cm_point.first != f_knights[i]->f_x || cm_point.second != f_knights[i]->f_y) {
+                return false;
+            }
+
+        }
+    }
+
+    return true;
+}
+
+
+bool GameState::check_if_knight_reached_princess_cm(pair<int, int> &cm_point, int &id) {
+
+    if (cm_point.first == f_knights[id]->f_x && cm_point.second == f_knights[id]->f_y) {
+        return true;
+    } else {
+        return false;
+    }
+}
+
+
+bool GameState::check_if_all_knights_reached_princess_cm(pair<int, int> &cm_point) {
+
+    for(int i = 0; i < f_n_knights; i++) {
+        // Dead knights do not move any more.
+        if (f_knights[i]->f_n_p < 0)
+            continue;
+
+        if (cm_point.first != f_knights[i]->f_x || cm_point.second != f_knights[i]->f_y) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+
+void GameState::send_global_order(string &order) {
+    f_current_global_order_name = order;
+
+    #if LOG_LEVEL >= 1
+    event(EVENT_GLOBAL_ORDER, order_id(order));
+    #endif
+    f_routes.f_valid = false;
+
+}
+
+
+void GameState::send_order_to_all_knights(string &order) {
+
+    for(int i = 0; i < f_n_knights; i++)
+        f_knights[i]->f_order = order;
+
+
+}
+
+
+void GameState::send_order_to_a_fraction_of_knights(string &order) {
+
+    int n = int(f_disperse_fraction*f_n_knights);
+
+    for(int i = f_n_knights - 1; i > f_n_knights - 1 - n; i--) {
+
+        if (f_knights[i]->f_n_p < 0)
+            continue;
+
+        f_knights[i]->f_order = order;
+    }
+}
+
+
+void GameState::random_disperse_the_ith_knight(string &move_order, int &i) {
+
+    CounterRng rng = knight_rng(i);
+    int move_id = rng.next() % 4;
+
+    move_order[i] = f_moves[move_id];
+    // NEWS
+    if (move_id == 0) {
+
+        if (f_knights[i]->f_y > 0) {
+            f_knights[i]->f_y = f_knights[i]->f_y - 1;
+        }
+    } else if (move_id == 1) {
+
+        if (f_knights[i]->f_x < f_S - 1) {
+            f_knights[i]->f_x = f_knights[i]->f_x + 1;
+        }
+    } else if (move_id == 2) {
+
+        if (f_knights[i]->f_x > 0) {
+            f_knights[i]->f_x = f_knights[i]->f_x - 1;
+        }
+    } else if (move_id == 3) {
+
+        if (f_knights[i]->f_y < f_S - 1) {
+            f_knights[i]->f_y = f_knights[i]->f_y + 1;
+        }
+    }
+}
+
+
+// Away from the assembly point, taken in take_walks.
+void GameState::repulsive_random_disperse_the_ith_knight(string &move_order, int &i) {
+
+    f_walk_kind[i] = WALK_REPULSIVE;
+    f_walk_x[i] = f_global_assembly_point.first;
+    f_walk_y[i] = f_global_assembly_point.second;
+}
+
+
+// Around point, taken in take_walks.
+void GameState::attractive_random_disperse_the_ith_knight(pair<int, int> &point, string &move_order, int &i) {
+
+    f_walk_kind[i] = WALK_ATTRACTIVE;
+    f_walk_x[i] = point.first;
+    f_walk_y[i] = point.second;
+}
+
+
+void GameState::atractive_disperse(string &move_order) {
+
+    // The princesses drift on, so knights look again a few frames
+    // after arriving. Claims are shared, that is done in queue order.
+    for(int k = 0; k < f_deployment.f_head; k++) {
+
+        int i = f_deployment.f_queue[k];
+        if (f_knights[i]->f_n_p < 0 || f_knights[i]->f_order != "ORDER_INITIALLY_DISPERSED")
+            continue;
+
+        if (f_turn > f_interception.f_knight_turn[i] + 4*f_interception.f_dt)
+            f_interception.intercept(i, f_knights[i]->f_x, f_knights[i]->f_y, f_turn);
+    }
+
+    // Walk to the block and wander around its center.
+    for_each_part(pool(), f_deployment.f_head, [&] (int, int begin, int end) {
+        for(int k = begin; k < end; k++) {
+
+            int i = f_deployment.f_queue[k];
+            if (f_knights[i]->f_n_p < 0 || f_knights[i]->f_order != "ORDER_INITIALLY_DISPERSED")
+                continue;
+
+            pair<int, int> block = f_interception.center(f_interception.f_knight_block[i]);
+            if (_manhatan_distance_from_point(block, f_knights[i]->f_x, f_knights[i]->f_y) > 2)
+                move_knight_towards_point(block, move_order, i);
+            else
+                attractive_random_disperse_the_ith_knight(block, move_order, i);
+        }
+    });
+}
+
+
+
+// Adds the steps recorded this turn to walks, in knight order.
+void GameState::collect_walks(DispersalWalks &walks) {
+
+    for(int i = 0; i < f_n_knights; i++) {
+        if (f_walk_kind[i] == WALK_NONE)
+            continue;
+
+        double stay = f_walk_kind[i] == WALK_REPULSIVE ? f_controller.f_stay_probability :
+                                                         f_parameters.f_attractive_stay_probability;
+        walks.add(knight_rng(i).f_key, f_S, f_knights[i]->f_x, f_knights[i]->f_y, f_walk_x[i], f_walk_y[i],
+                  f_walk_kind[i], stay);
+    }
+}
+
+
+// Moves the knights by the steps walks drew for collect_walks, from
+// step k on, and leaves k after the last one.
+void GameState::apply_walks(DispersalWalks &walks, int &k, string &move_order) {
+
+    for(int i = 0; i < f_n_knights; i++) {
+        if (f_walk_kind[i] == WALK_NONE)
+            continue;
+
+        f_walk_kind[i] = WALK_NONE;
+        int m = walks.f_move[k++];
+        if (m < 0)
+            continue;
+
+        move_order[i] = f_moves[m];
+        apply_move(move_order[i], i);
+    }
+}
+
+
+// A knight's step only depends on its own cell, so the steps recorded
+// by the per knight loops are taken once they are done.
+void GameState::take_walks(string &move_order) {
+
+    f_walks.clear();
+    collect_walks(f_walks);
+    if (f_walks.size() == 0)
+        return;
+
+    f_walks.walk();
+    int k = 0;
+    apply_walks(f_walks, k, move_order);
+}
+
+
+// Runs on the knight parts: a search step only touches its own knight
+// and the sector that knight owns.
+template<class SearchStep>
+void GameState::check_and_set_princess_escort_during_random_disperse(string &move_order, SearchStep search_step) {
+
+    for_each_part(pool(), f_n_knights, [&] (int, int begin, int end) {
+        for(int i = begin; i < end; i++) {
+
+            if (f_knights[i]->f_n_p < 0)
+                continue;
+
+            // Returning knights move in convoys, see move_convoys.
+            if (f_knights[i]->f_order == "ORDER_RETURN_TO_GLOBAL_ASSEMBLY_POINT") {
+                continue;
+
+            } else if (f_knights[i]->f_n_p > 0 && f_knights[i]->f_order == "ORDER_RANDOM_PRINCESS_SEARCH") {
+                f_knights[i]->f_order = "ORDER_RETURN_TO_GLOBAL_ASSEMBLY_POINT";
+                continue;
+
+            } else if (f_knights[i]->f_n_p == 0 && f_knights[i]->f_order == "ORDER_RANDOM_PRINCESS_SEARCH") {
+                search_step(i);
+                continue;
+
+            } else if (f_knights[i]->f_order == "ORDER_MOVE_TO_PRINCESS_CENTER_OF_MASS") {
+                // The knights waiting at the assembly point follow it.
+                move_knight_towards_point(f_global_assembly_point, move_order, i);
+                continue;
+            }
+        }
+    });
+}
+
+
+// Knights only move during the search, so the cells can be looked up
+// for all of them at once, a batch per knight part.
+//
+// Cells are only ever added to the visited ones (until the board is
+// cleared, which drops the cells found). A knight that moved m cells
+// since its cell was found at distance d got no closer than d - m to
+// any unexplored cell, so its cell is still a nearest one if it is
+// still unexplored and at most d - m away. Only the others are looked
+// up, a knight walking to its cell is looked up once. Knights gather on
+// a few cells (the assembly point, the convoys), so the knights on a
+// cell share one lookup.
+void GameState::find_frontier_cells() {
+
+    if ((int)f_frontier_turn.size() != f_n_knights) {
+        f_frontier_x.assign(f_n_knights, -1);
+        f_frontier_y.assign(f_n_knights, -1);
+        f_frontier_turn.assign(f_n_knights, -1);
+        f_frontier_from_x.assign(f_n_knights, 0);
+        f_frontier_from_y.assign(f_n_knights, 0);
+        f_frontier_d.assign(f_n_knights, -1);
+    }
+
+    f_frontier_keys.clear();
+    for(int i = 0; i < f_n_knights; i++) {
+        if (f_knights[i]->f_n_p != 0 || f_assignment.f_knight_target[i] >= 0 ||
+            f_knights[i]->f_order != "ORDER_RANDOM_PRINCESS_SEARCH")
+            continue;
+
+        f_frontier_turn[i] = f_turn;
+
+        int x = f_knights[i]->f_x;
+        int y = f_knights[i]->f_y;
+        if (f_frontier_d[i] >= 0) {
+            int moved = abs(x - f_frontier_from_x[i]) + abs(y - f_frontier_from_y[i]);
+            int d = abs(x - f_frontier_x[i]) + abs(y - f_frontier_y[i]);
+            if (d <= f_frontier_d[i] - moved && f_coverage->is_visited(f_frontier_x[i], f_frontier_y[i]) == false) {
+
+                #if CHECK_INVARIANTS == 1
+                int rx, ry;
+                assert(f_coverage->nearest_unexplored(x, y, rx, ry) == true && abs(rx - x) + abs(ry - y) == d);
+                #endif
+
+                f_frontier_from_x[i] = x;
+                f_frontier_from_y[i] = y;
+                f_frontier_d[i] = d;
+                continue;
+            }
+        }
+
+        f_frontier_keys.push_back((uint64_t)(y*f_S + x) << 32 | i);
+    }
+
+    // The first knight of every cell is looked up.
+    sort(f_frontier_keys.begin(), f_frontier_keys.end());
+    f_frontier_ids.clear();
+    int n = f_frontier_keys.size();
+    for(int k = 0; k < n; k++) {
+        if (k == 0 || (f_frontier_keys[k] >> 32) != (f_frontier_keys[k - 1] >> 32))
+            f_frontier_ids.push_back(f_frontier_keys[k] & 0xffffffff);
+    }
+
+    for_each_part(pool(), f_frontier_ids.size(), [&] (int, int begin, int end) {
+        f_coverage->nearest_unexplored_cells(f_knights, &f_frontier_ids[begin], end - begin,
+                                             f_frontier_x.data(), f_frontier_y.data());
+        for(int k = begin; k < end; k++) {
+            int i = f_frontier_ids[k];
+            f_frontier_from_x[i] = f_knights[i]->f_x;
+            f_frontier_from_y[i] = f_knights[i]->f_y;
+            f_frontier_d[i] = f_frontier_x[i] < 0 ? -1 :
+                abs(f_frontier_x[i] - f_knights[i]->f_x) + abs(f_frontier_y[i] - f_knights[i]->f_y);
+        }
+    });
+
+    int first = -1;
+    for(int k = 0; k < n; k++) {
+        int i = f_frontier_keys[k] & 0xffffffff;
+        if (k == 0 || (f_frontier_keys[k] >> 32) != (f_frontier_keys[k - 1] >> 32)) {
+            first = i;
+            continue;
+        }
+        f_frontier_x[i] = f_frontier_x[first];
+        f_frontier_y[i] = f_frontier_y[first];
+        f_frontier_from_x[i] = f_frontier_from_x[first];
+        f_frontier_from_y[i] = f_frontier_from_y[first];
+        f_frontier_d[i] = f_frontier_d[first];
+    }
+}
+
+
+void GameState::search_sector_or_frontier(string &move_order, int &i) {
+
+    int t = f_assignment.f_knight_target[i];
+    if (t < 0) {
+        pair<int, int> cell;
+        bool found;
+        if (i < (int)f_frontier_turn.size() && f_frontier_turn[i] == f_turn) {
+            cell = make_pair(f_frontier_x[i], f_frontier_y[i]);
+            found = cell.first >= 0;
+        } else {
+            found = f_coverage->nearest_unexplored(f_knights[i]->f_x, f_knights[i]->f_y, cell.first, cell.second);
+        }
+
+        if (found == true)
+            move_knight_towards_point(cell, move_order, i);
+        else
+            repulsive_random_disperse_the_ith_knight(move_order, i);
+        return;
+    }
+
+    pair<int, int> sector = make_pair(f_assignment.f_target_x[t], f_assignment.f_target_y[t]);
+    move_knight_towards_point(sector, move_order, i);
+
+    // The sector is searched once a knight walked through its center.
+    if (check_if_knight_reached_princess_cm(sector, i) == true)
+        f_assignment.remove_target(t);
+}
+
+
+// Knights a convoy escorting n_princesses needs to walk distance cells
+// and lose less than CONVOY_MAX_LOSS princesses on average, k knights
+// die on a cell with more than k monsters. Monsters are taken as spread
+// evenly, a cell holds Poisson(M/S^2) of them.
+int GameState::convoy_size(int &distance, int &n_princesses, int &M) {
+
+    double rho = (double)M/((double)f_S*f_S);
+    double p = exp(-rho); // P(j monsters) for j = 0, 1, ...
+    double at_most = p;
+
+    int k = 0;
+    for(int j = 1; j <= MAX_CONVOY_SIZE; j++) {
+        p = p*rho/j;
+        at_most = at_most + p;
+        k = j;
+        if (n_princesses*distance*(1 - at_most) < CONVOY_MAX_LOSS)
+            break;
+    }
+
+    return k;
+}
+
+
+void GameState::make_convoys(int &M) {
+
+    f_knight_convoy.assign(f_n_knights, -1);
+    if ((int)f_guard_target.size() != f_n_knights)
+        f_guard_target.assign(f_n_knights, -1);
+
+    // A guard that reached its knight returns with it, one whose
+    // knight died or arrived goes back to the search.
+    for(int i = 0; i < f_n_knights; i++) {
+        int j = f_guard_target[i];
+        if (j < 0)
+            continue;
+
+        if (f_knights[i]->f_n_p < 0 || f_knights[j]->f_n_p < 0 ||
+            f_knights[j]->f_order != "ORDER_RETURN_TO_GLOBAL_ASSEMBLY_POINT") {
+            if (f_knights[i]->f_n_p >= 0)
+                f_knights[i]->f_order = "ORDER_RANDOM_PRINCESS_SEARCH";
+            f_guard_target[i] = -1;
+        } else if (f_knights[i]->f_x == f_knights[j]->f_x && f_knights[i]->f_y == f_knights[j]->f_y) {
+            f_knights[i]->f_order = "ORDER_RETURN_TO_GLOBAL_ASSEMBLY_POINT";
+            f_guard_target[i] = -1;
+        }
+    }
+
+    // One convoy per cell, nearest to the assembly point first.
+    vector<pair<int, int>> cells;
+    for(int i = 0; i < f_n_knights; i++) {
+        if (f_knights[i]->f_n_p >= 0 && f_knights[i]->f_order == "ORDER_RETURN_TO_GLOBAL_ASSEMBLY_POINT")
+            cells.push_back(make_pair(f_knights[i]->f_y*f_S + f_knights[i]->f_x, i));
+    }
+    sort(cells.begin(), cells.end());
+
+    f_convoys.clear();
+    int n = cells.size();
+    for(int k = 0; k < n; k++) {
+        if (k == 0 || cells[k].first != cells[k - 1].first) {
+            f_convoys.push_back(Convoy());
+            Convoy &c = f_convoys.back();
+            c.f_x = cells[k].first % f_S;
+            c.f_y = cells[k].first/f_S;
+            c.f_distance = _manhatan_distance_from_point(f_global_assembly_point, c.f_x, c.f_y);
+        }
+        f_convoys.back().f_members.push_back(cells[k].second);
+        f_convoys.back().f_n_princesses += f_knights[cells[k].second]->f_n_p;
+    }
+    sort(f_convoys.begin(), f_convoys.end(), [] (const Convoy &a, const Convoy &b) {return a.f_distance < b.f_distance;});
+
+    int n_convoys = f_convoys.size();
+    for(int c = 0; c < n_convoys; c++) {
+        for(int i : f_convoys[c].f_members)
+            f_knight_convoy[i] = c;
+    }
+
+    for(int i = 0; i < f_n_knights; i++) {
+        if (f_guard_target[i] >= 0 && f_knight_convoy[f_guard_target[i]] >= 0) {
+            Convoy &c = f_convoys[f_knight_convoy[f_guard_target[i]]];
+            c.f_incoming++;
+            c.f_hold = true;
+        }
+    }
+
+    // A convoy short of knights walks to the nearest convoy closer to
+    // the assembly point that stands still, or else calls the nearest
+    // searching knight as a guard. Both are looked up in buckets, the
+    // searching knights only once a guard is needed.
+    int radius = max(2, f_S/10);
+    CellBuckets convoy_buckets;
+    CellBuckets guard_buckets;
+    bool guards_bucketed = false;
+    for(int c = 0; c < n_convoys; c++) {
+
+        check_cancel();
+        Convoy &convoy = f_convoys[c];
+        int size = convoy.f_members.size() + convoy.f_incoming;
+        if (convoy.f_hold == true || convoy.f_distance == 0 ||
+            size >= convoy_size(convoy.f_distance, convoy.f_n_princesses, M))
+            continue;
+
+        if (convoy_buckets.f_side == 0) {
+            vector<int> ids(n_convoys), x(n_convoys), y(n_convoys);
+            for(int o = 0; o < n_convoys; o++) {
+                ids[o] = o;
+                x[o] = f_convoys[o].f_x;
+                y[o] = f_convoys[o].f_y;
+            }
+            convoy_buckets.build(f_S, ids, x, y);
+        }
+
+        int best = convoy_buckets.nearest(convoy.f_x, convoy.f_y, radius + 1, [&] (int o) {
+            return o < c && f_convoys[o].f_target < 0;
+        });
+
+        if (best >= 0) {
+            convoy.f_target = best;
+            f_convoys[best].f_hold = true;
+            continue;
+        }
+
+        if (guards_bucketed == false) {
+            vector<int> ids, x, y;
+            for(int i = 0; i < f_n_knights; i++) {
+                if (f_knights[i]->f_n_p != 0 || f_knights[i]->f_order != "ORDER_RANDOM_PRINCESS_SEARCH")
+                    continue;
+                ids.push_back(i);
+                x.push_back(f_knights[i]->f_x);
+                y.push_back(f_knights[i]->f_y);
+            }
+            guard_buckets.build(f_S, ids, x, y);
+            guards_bucketed = true;
+        }
+
+        // A knight called as a guard leaves the search.
+        int guard = guard_buckets.nearest(convoy.f_x, convoy.f_y, radius + 1, [&] (int i) {
+            return f_knights[i]->f_order == "ORDER_RANDOM_PRINCESS_SEARCH";
+        });
+
+        if (guard >= 0) {
+            f_knights[guard]->f_order = "ORDER_GUARD_CONVOY";
+            f_guard_target[guard] = convoy.f_members[0];
+            convoy.f_incoming++;
+            convoy.f_hold = true;
+        }
+    }
+}
+
+
+// One route step per convoy, copied to all of its knights.
+void GameState::move_convoys(string &move_order, int &M) {
+
+    make_convoys(M);
+
+    int n_convoys = f_convoys.size();
+    for(int c = 0; c < n_convoys; c++) {
+
+        Convoy &convoy = f_convoys[c];
+        int lead = convoy.f_members[0];
+        pair<int, int> target = convoy.f_target >= 0 ?
+            make_pair(f_convoys[convoy.f_target].f_x, f_convoys[convoy.f_target].f_y) : f_global_assembly_point;
+        if (convoy.f_hold == false)
+            move_knight_towards_point(target, move_order, lead);
+
+        int n = convoy.f_members.size();
+        for(int k = 1; k < n; k++) {
+            int i = convoy.f_members[k];
+            move_order[i] = move_order[lead];
+            apply_move(move_order[i], i);
+        }
+
+        // All members started on the convoy's cell.
+        #if CHECK_INVARIANTS == 1
+        for(int i : convoy.f_members) {
+            if (convoy.f_hold == true)
+                assert(move_order[i] == 'X' && f_knights[i]->f_x == convoy.f_x && f_knights[i]->f_y == convoy.f_y);
+            else
+                check_move_towards(target, move_order, i, convoy.f_x, convoy.f_y);
+        }
+        #endif
+
+        if (check_if_knight_reached_princess_cm(f_global_assembly_point, lead) == true) {
+            for(int i : convoy.f_members)
+                f_knights[i]->f_order = "ORDER_RANDOM_PRINCESS_SEARCH";
+        }
+    }
+
+    // A guard called this turn already made its search move, unless
+    // it stood still.
+    for(int i = 0; i < f_n_knights; i++) {
+        if (f_guard_target[i] >= 0 && move_order[i] == 'X') {
+            pair<int, int> target = make_pair(f_knights[f_guard_target[i]]->f_x, f_knights[f_guard_target[i]]->f_y);
+            move_knight_towards_point(target, move_order, i);
+        }
+    }
+}
+
+
+void GameState::make_search_sectors() {
+
+    int n_searching = 0;
+    for(int i = 0; i < f_n_knights; i++) {
+        if (f_knights[i]->f_order == "ORDER_RANDOM_PRINCESS_SEARCH")
+            n_searching++;
+    }
+
+    // About one sector per searching knight. A bid costs one pass
+    // over the sectors, so large armies share sectors and the
+    // knights left without one search the frontier.
+    int n_side = int(ceil(sqrt((double)n_searching)));
+    n_side = min(n_side, min(f_S, MAX_SEARCH_SECTORS_PER_SIDE));
+    if (n_side < 1)
+        n_side = 1;
+
+    // Bids are limited to about 2^24 distances per turn, which
+    // contest sized armies never reach.
+    int n_sectors = n_side*n_side;
+    int n_targets = n_sectors + f_interception.f_n*f_interception.f_n;
+    f_assignment = KnightAssignment(f_n_knights, 2*f_S, max(2*n_targets, (1 << 24)/n_targets));
+    for(int i = 0; i < n_side; i++) {
+        for(int j = 0; j < n_side; j++) {
+            int x = int((j + 0.5)*f_S/n_side);
+            int y = int((i + 0.5)*f_S/n_side);
+            f_assignment.add_target(x, y);
+        }
+    }
+    f_n_search_sectors = n_sectors;
+    add_suspected_princess_targets();
+
+    #if LOG_LEVEL >= 1
+    event(EVENT_SEARCH_SECTORS, n_side);
+    #endif
+}
+
+
+// The blocks the interception planner still expects a princess in are
+// auctioned with the sectors, from their centers, and picked again at
+// every sweep. Hunting lanes are not targets: they are taken by whole
+// squads once the search is over (select_hunting_lane).
+void GameState::add_suspected_princess_targets() {
+
+    vector<double> &remaining = f_interception.remaining(f_turn);
+    int n_blocks = remaining.size();
+    for(int b = 0; b < n_blocks; b++) {
+        if (remaining[b] < SUSPECTED_PRINCESSES)
+            continue;
+
+        pair<int, int> c = f_interception.center(b);
+        f_assignment.add_target(c.first, c.second);
+    }
+}
+
+
+void GameState::adapt_dispersal(int &P) {
+
+    int escorted = 0;
+    for(int i = 0; i < f_n_knights; i++) {
+        if (f_knights[i]->f_n_p > 0)
+            escorted = escorted + f_knights[i]->f_n_p;
+    }
+
+    f_controller.observe(escorted, P, knights_alive());
+
+    if (f_turn < f_controller.f_next_update_turn)
+        return;
+    f_controller.f_period = f_S;
+    f_controller.f_next_update_turn = f_turn + f_controller.f_period;
+
+    if (f_controller.f_loss_rate > f_controller.f_pickup_rate) {
+
+        // Searching costs more knights than it brings princesses.
+        f_controller.f_stay_probability = min(0.3, f_controller.f_stay_probability + 0.05);
+
+    } else if (f_controller.f_pickup_rate < 0.5*f_controller.f_best_pickup_rate) {
+
+        // The search stalled, spread further and send some of
+        // the knights waiting at the assembly point out as well.
+        f_controller.f_stay_probability = max(0.0, f_controller.f_stay_probability - 0.02);
+
+        int n_waiting = 0;
+        for(int i = 0; i < f_n_knights; i++) {
+            if (f_knights[i]->f_n_p == 0 && f_knights[i]->f_order == "ORDER_MOVE_TO_PRINCESS_CENTER_OF_MASS")
+                n_waiting++;
+        }
+
+        int n = min(n_waiting - f_n_knights/20, max(1, f_n_knights/10));
+        for(int i = 0; i < f_n_knights && n > 0; i++) {
+            if (f_knights[i]->f_n_p == 0 && f_knights[i]->f_order == "ORDER_MOVE_TO_PRINCESS_CENTER_OF_MASS") {
+                f_knights[i]->f_order = "ORDER_RANDOM_PRINCESS_SEARCH";
+                n--;
+            }
+        }
+    }
+
+    int n_searching = 0;
+    for(int i = 0; i < f_n_knights; i++) {
+        if (f_knights[i]->f_order == "ORDER_RANDOM_PRINCESS_SEARCH" || f_knights[i]->f_order == "ORDER_RETURN_TO_GLOBAL_ASSEMBLY_POINT" ||
+            f_knights[i]->f_order == "ORDER_GUARD_CONVOY")
+            n_searching++;
+    }
+    f_disperse_fraction = (double)n_searching/f_n_knights;
+
+    #if LOG_LEVEL >= 1
+    event(EVENT_DISPERSAL, f_controller.f_pickup_rate, f_controller.f_best_pickup_rate, f_controller.f_loss_rate,
+          f_controller.f_stay_probability, f_disperse_fraction);
+    #endif
+}
+
 
-        move_order[id] = 'W'; // move left
-        if (f_knights[id]->f_x > 0) 
-            f_knights[id]->f_x = f_knights[id]->f_x - 1;
+void GameState::assign_knights_to_search_sectors() {
 
-    } else if (point.second > f_knights[id]->f_y) {
+    // Start a new sweep once every sector was searched.
+    if (f_assignment.number_of_active_targets() == 0) {
+        f_assignment.remove_targets_from(f_n_search_sectors);
+        add_suspected_princess_targets();
+        f_assignment.activate_all_targets();
+    }
 
-        move_order[id] = 'S'; // move left
-        if (f_knights[id]->f_y < f_S - 1) 
-            f_knights[id]->f_y = f_knights[id]->f_y + 1;
+    // Princesses keep walking, so the board is searched again
+    // once every cell was visited.
+    f_coverage->set_occupied(f_knights);
+    if (f_coverage->number_of_visited() == f_S*f_S) {
+        f_coverage->clear_visited();
+        f_frontier_d.assign(f_frontier_d.size(), -1);
+    }
 
-    } else if (point.second < f_knights[id]->f_y) {
+    // Only the count the sweep needs anyway, the frontier would cost
+    // a pass over the board every turn.
+    #if LOG_LEVEL >= 1
+    event(EVENT_COVERAGE, f_coverage->number_of_visited());
+    #endif
 
-        move_order[id] = 'N'; // move left
-        if (f_knights[id]->f_y > 0) 
-            f_knights[id]->f_y = f_knights[id]->f_y - 1;
+    vector<int> bidders;
+    for(int i = 0; i < f_n_knights; i++) {
+
+        if (f_knights[i]->f_n_p != 0 || f_knights[i]->f_order != "ORDER_RANDOM_PRINCESS_SEARCH") {
+            f_assignment.release_knight(i);
+            continue;
+        }
 
+        if (f_assignment.f_knight_target[i] < 0)
+            bidders.push_back(i);
     }
 
+    f_assignment.assign(f_knights, bidders, pool(), f_cancel);
 }
 
 
-void GameState::move_diagonally_knight_towards_point(pair<int, int> &point,
-                                                     string &move_order,
-                                                     int &id) {
+void GameState::make_deployment_schedule() {
 
+    f_deployment = DeploymentScheduler();
 
-    if (point.first == f_knights[id]->f_x && point.second == f_knights[id]->f_y)
-        return;
+    int n = f_max_number_of_dispersed_knights;
+    f_interception.set_princesses(f_S, f_princesses, f_n_knights, n);
 
-    int x0 = f_knights[id]->f_x;
-    int y0 = f_knights[id]->f_y - 1;
+    int e = closest_corner(f_global_assembly_point.first, f_global_assembly_point.second);
+    int d = _manhatan_distance_from_point(f_corners[e], f_global_assembly_point.first, f_global_assembly_point.second);
 
-    if (y0 < 0)
-        y0 = 0;
+    // A knight sent ahead has a block of its own. Blocks are planned
+    // from the assembly point, each knight with the claims of those
+    // before it. A knight whose block is closer to another corner than
+    // the army's enters there and leaves with the first wave, the
+    // others walk with the army. Knights intercept again when they
+    // leave, the plan only picks the entrances.
+    vector<int> with_army;
+    for(int i = f_n_knights - 1; i >= f_n_knights - n; i--) {
+        if (f_S <= f_parameters.f_large_board) {
+            with_army.push_back(i);
+            continue;
+        }
 
-    int x1 = f_knights[id]->f_x + 1;
-    int y1 = f_knights[id]->f_y;
+        int b = f_interception.intercept(i, f_global_assembly_point.first, f_global_assembly_point.second, d);
+        pair<int, int> c = f_interception.center(b);
+        int own = closest_corner(c.first, c.second);
+        if (own == e) {
+            with_army.push_back(i);
+            continue;
+        }
 
-    if (x1 > f_S - 1)
-        x1 = f_S - 1;
+        f_knights[i]->f_e = own;
+        f_knights[i]->f_x = f_corners[own].first;
+        f_knights[i]->f_y = f_corners[own].second;
+        f_deployment.f_queue.push_back(i);
+    }
+    for(int i = f_n_knights - 1; i >= f_n_knights - n; i--)
+        f_interception.release(i);
+
+    int n_ahead = f_deployment.f_queue.size();
+    f_deployment.f_queue.insert(f_deployment.f_queue.end(), with_army.begin(), with_army.end());
+
+    // Spread the waves of the others over the walk from the entrance
+    // to the assembly point, the last one leaves before the army arrives.
+    int n_waves = max(1, min(n - n_ahead, d/2));
+    f_deployment.f_wave_size = (n - n_ahead + n_waves - 1)/n_waves;
+    f_deployment.f_first_wave_size = n_ahead + f_deployment.f_wave_size;
+    f_deployment.f_wave_interval = max(1, d/n_waves);
+    f_deployment.f_next_wave_turn = 1;
+
+    #if LOG_LEVEL >= 1
+    event(EVENT_DEPLOYMENT, n, f_interception.f_n, n_waves, f_deployment.f_wave_size, f_deployment.f_wave_interval);
+    #endif
+}
 
-    int x2 = f_knights[id]->f_x - 1;
-    int y2 = f_knights[id]->f_y;
 
-    if (x2 < 0)
-        x2 = 0;
+void GameState::deploy_next_wave() {
 
-    int x3 = f_knights[id]->f_x;
-    int y3 = f_knights[id]->f_y + 1;
+    if (f_deployment.wave_due(f_turn) == false)
+        return;
 
-    if (y3 > f_S - 1)
-        y3 = f_S - 1;
+    int head = f_deployment.f_head;
+    f_deployment.release(f_turn);
 
-    double x0d = _euclidean_distance_from_point(point, x0, y0);
-    double x1d = _euclidean_distance_from_point(point, x1, y1);
-    double x2d = _euclidean_distance_from_point(point, x2, y2);
-    double x3d = _euclidean_distance_from_point(point, x3, y3);
-    
-    // Find smallest distance to point.
-    vector<double> vec{x0d, x1d, x2d, x3d};
-    vector<double>::iterator result = min_element(begin(vec), end(vec));
-    int move_id = distance(begin(vec), result);
+    for(int k = head; k < f_deployment.f_head; k++) {
+        int i = f_deployment.f_queue[k];
+        if (f_knights[i]->f_n_p < 0)
+            continue;
 
-    #if PRINT_DEBUG == 1
-    fprintf(stderr, "x0 %d; y0 %d; x1 %d; y1 %d; x2 %d; y2 %d; x3 %d; y3 %d;\n", x0, y0, x1, y1, x2, y2, x3, y3);    
-    fprintf(stderr, "point.x %d; point.y: %d; x0d: %f; x1d: %f; x2d: %f; x3d: %f\n", point.first, point.second, x0d, x1d, x2d, x3d);
-    fprintf(stderr, "move_id: %d\n", move_id);
+        f_knights[i]->f_order = "ORDER_INITIALLY_DISPERSED";
+        f_interception.intercept(i, f_knights[i]->f_x, f_knights[i]->f_y, f_turn);
+        f_total_dispersed++;
+    }
+
+    #if LOG_LEVEL >= 1
+    event(EVENT_WAVE, f_total_dispersed, f_max_number_of_dispersed_knights);
     #endif
+}
 
-    move_order[id] = f_moves[move_id];
-    if (move_id == 0) {
 
-        if (f_knights[id]->f_y > 0) {
-            f_knights[id]->f_y = f_knights[id]->f_y - 1;
+void GameState::estimate_column_monsters(int &M) {
 
-        }
-    } else if (move_id == 1) {
+    if (f_column_monsters.empty() == true) {
 
-        if (f_knights[id]->f_x < f_S - 1) {
-            f_knights[id]->f_x = f_knights[id]->f_x + 1;
+        // Start from the columns the monsters were seen in and blend
+        // towards uniform, a random walk mixes in about f_S^2 turns.
+        f_column_monsters.resize(f_S, 0.0);
+        for(int i = 0; i < f_n_monsters; i++)
+            f_column_monsters[f_monsters[i].f_last_x] += 1.0;
 
-        }
-    } else if (move_id == 2) {
+        double w = min(1.0, (double)f_turn/(f_S*f_S));
+        for(int x = 0; x < f_S; x++)
+            f_column_monsters[x] = (1.0 - w)*f_column_monsters[x] + w*f_n_monsters/f_S;
+    }
 
-        if (f_knights[id]->f_x > 0) {
-            f_knights[id]->f_x = f_knights[id]->f_x - 1;
+    // Monsters keep diffusing, so hunted lanes slowly fill up again.
+    double alpha = 1.0/f_S;
+    double total = 0.0;
+    for(int x = 0; x < f_S; x++) {
+        f_column_monsters[x] = (1.0 - alpha)*f_column_monsters[x] + alpha*M/f_S;
+        total = total + f_column_monsters[x];
+    }
 
-        }
-    } else if (move_id == 3) {
+    if (total < EPSILON)
+        return;
 
-        if (f_knights[id]->f_y < f_S - 1) {
-            f_knights[id]->f_y = f_knights[id]->f_y + 1;
+    for(int x = 0; x < f_S; x++)
+        f_column_monsters[x] = f_column_monsters[x]*M/total;
+}
 
-        }
-    }
 
+double GameState::expected_lane_kill_rate(int &x0, int &width) {
 
+    // A row moving one cell per turn meets the monsters of one row of
+    // its lane and about as many walk into it.
+    double lane_monsters = 0.0;
+    for(int x = x0; x < x0 + width; x++)
+        lane_monsters = lane_monsters + f_column_monsters[x];
 
+    return 2.0*lane_monsters/f_S;
 }
 
 
-void GameState::move_towards_point(pair<int, int> &point, string &move_order) {
+int GameState::lane_strength(int &x0, int &width) {
 
-    //fprintf(stderr, "Moving towards (%d, %d)\n", point.first, point.second);
-    for(int i = 0; i < f_n_knights; i++) {
-        //
-        if (f_knights[i]->f_order == "ORDER_INITIALLY_DISPERSED")
-            continue;
+    // Enough knights per cell to beat what a cell of the densest
+    // column of the lane usually holds.
+    double column_monsters = 0.0;
+    for(int x = x0; x < x0 + width; x++)
+        column_monsters = max(column_monsters, f_column_monsters[x]);
 
-        move_knight_towards_point(point, move_order, i);
-    }
+    double lambda = column_monsters/f_S;
+    return 1 + int(ceil(lambda + 2.0*sqrt(lambda)));
 }
 
 
+int GameState::alive_squad_members(int &s) {
 
-void GameState::move_diagonally_towards_point(pair<int, int> &point, string &move_order) {
-
-    //fprintf(stderr, "Moving towards (%d, %d)\n", point.first, point.second);
-    for(int i = 0; i < f_n_knights; i++) {
-        //move_knight_towards_point(point, move_order, i);
-        if (f_knights[i]->f_order == "ORDER_INITIALLY_DISPERSED")
-            continue;
-
-        move_diagonally_knight_towards_point(point, move_order, i);
+    int n_alive = 0;
+    int n = f_squads[s].f_members.size();
+    for(int k = 0; k < n; k++) {
+        if (f_knights[f_squads[s].f_members[k]]->f_n_p >= 0)
+            n_alive++;
     }
+
+    return n_alive;
 }
 
 
-bool GameState::princess_cm_reached(pair<int, int> &cm_point) {
+bool GameState::select_hunting_lane(int &s) {
 
-    // When ORDER_MOVE_TO_PRINCESS_CENTER_OF_MASS is issued all
-    // knights should move towards it. It is enough to check
-    // just one.
-    // This function should be executed only durring ORDER_MOVE_TO_PRINCESS_CENTER_OF_MASS
-    if (f_current_global_order_name != "ORDER_MOVE_TO_PRINCESS_CENTER_OF_MASS") {
-        cerr << "princess_cm_reached executed not durring ORDER_MOVE_TO_PRINCESS_CENTER_OF_MASS" << endl;
-        assert(false);
+    HuntingSquad &squad = f_squads[s];
+
+    if (squad.f_x0 >= 0) {
+        for(int x = squad.f_x0; x < squad.f_x0 + squad.f_width; x++) {
+            f_lane_owner[x] = -1;
+            f_column_monsters[x] = 0.5*f_column_monsters[x];
+        }
     }
 
-    for(int i = 0; i < f_n_knights; i++) {
+    // Staying costs the squad's share of the knights we lose, but never
+    // less than one monster per two crossings of the board.
+    int n_alive = knights_alive();
+    double share = n_alive > 0 ? (double)alive_squad_members(s)/n_alive : 0.0;
+    double cost_of_staying = max(f_knight_loss_rate*share, 1.0/(2*f_S));
 
-        if (f_knights[i]->f_order == "ORDER_MOVE_TO_PRINCESS_CENTER_OF_MASS") {
+    int best_x0 = -1;
+    double best_rate = 0.0;
+    for(int x0 = 0; x0 < f_S; x0 += squad.f_width) {
 
-            if (cm_point.first != f_knights[i]->f_x || cm_point.second != f_knights[i]->f_y) {
-                return false;
-            }
+        int lane_x0 = min(x0, f_S - squad.f_width);
 
+        bool taken = false;
+        for(int x = lane_x0; x < lane_x0 + squad.f_width; x++) {
+            if (f_lane_owner[x] >= 0)
+                taken = true;
         }
-    }
-
-    return true;
-}
+        if (taken == true)
+            continue;
 
+        double rate = expected_lane_kill_rate(lane_x0, squad.f_width);
+        if (rate > best_rate) {
+            best_rate = rate;
+            best_x0 = lane_x0;
+        }
+    }
 
-bool GameState::check_if_knight_reached_princess_cm(pair<int, int> &cm_point, int &id) {
+    if (best_x0 < 0 || best_rate < cost_of_staying) {
+        #if LOG_LEVEL >= 1
+        event(EVENT_SQUAD, s, best_x0, 0, best_rate, cost_of_staying);
+        #endif
 
-    if (cm_point.first == f_knights[id]->f_x && cm_point.second == f_knights[id]->f_y) {
-        return true;
-    } else {
+        squad.f_x0 = -1;
         return false;
     }
-}
 
+    squad.f_x0 = best_x0;
+    squad.f_rate = best_rate;
+    squad.f_strength = lane_strength(best_x0, squad.f_width);
+    for(int x = best_x0; x < best_x0 + squad.f_width; x++)
+        f_lane_owner[x] = s;
+    f_split_squads = true;
 
-bool GameState::check_if_all_knights_reached_princess_cm(pair<int, int> &cm_point) {
+    #if LOG_LEVEL >= 1
+    event(EVENT_SQUAD, s, best_x0, squad.f_strength, best_rate, cost_of_staying);
+    #endif
 
-    for(int i = 0; i < f_n_knights; i++) {
-        if (cm_point.first != f_knights[i]->f_x || cm_point.second != f_knights[i]->f_y) {
-            return false;
-        }
+    // Start the sweep from the edge closer to the squad.
+    int y = f_knights[squad.f_members[0]]->f_y;
+    if (y < f_S/2) {
+        squad.f_y = 0;
+        squad.f_dy = 1;
+    } else {
+        squad.f_y = f_S - 1;
+        squad.f_dy = -1;
     }
 
     return true;
 }
 
 
+void GameState::retire_hunting_squad(int &s) {
 
-void GameState::send_global_order(string &order) {
-    #if PRINT_DEBUG == 1
-    cerr << "Sending order: " << order << endl;
-    #endif    
-    f_current_global_order_name = order;
+    HuntingSquad &squad = f_squads[s];
+    squad.f_active = false;
+
+    if (squad.f_x0 >= 0) {
+        for(int x = squad.f_x0; x < squad.f_x0 + squad.f_width; x++)
+            f_lane_owner[x] = -1;
+    }
 
+    int n = squad.f_members.size();
+    for(int k = 0; k < n; k++) {
+        Knight *kp = f_knights[squad.f_members[k]];
+        kp->f_order = "ORDER_GO_TO_EXIT";
+        kp->f_e = closest_corner(kp->f_x, kp->f_y);
+    }
 }
 
 
-void GameState::send_order_to_all_knights(string &order) {
+// Every squad keeps as many of its knights as its lane needs (strength
+// times width), the squads of the best lanes take the rest first, and
+// the knights nobody needs stay where they were.
+void GameState::split_hunting_squads() {
 
-    for(int i = 0; i < f_n_knights; i++)
-        f_knights[i]->f_order = order;
+    vector<int> order;
+    vector<int> spare; // knight ids
+    vector<int> spare_squad;
+    int n_squads = f_squads.size();
+    for(int s = 0; s < n_squads; s++) {
+        HuntingSquad &squad = f_squads[s];
+        if (squad.f_active == false)
+            continue;
 
+        order.push_back(s);
+        int need = squad.f_strength*squad.f_width;
+        vector<int> members;
+        int n = squad.f_members.size();
+        for(int k = 0; k < n; k++) {
+            int i = squad.f_members[k];
+            if (f_knights[i]->f_n_p < 0)
+                continue;
+
+            if ((int)members.size() < need) {
+                members.push_back(i);
+            } else {
+                spare.push_back(i);
+                spare_squad.push_back(s);
+            }
+        }
+        squad.f_members.swap(members);
+    }
+
+    stable_sort(order.begin(), order.end(), [this](int a, int b) {
+        return f_squads[a].f_rate > f_squads[b].f_rate;
+    });
+
+    int next = 0;
+    int n_spare = spare.size();
+    int n_order = order.size();
+    for(int k = 0; k < n_order && next < n_spare; k++) {
+        HuntingSquad &squad = f_squads[order[k]];
+        int need = squad.f_strength*squad.f_width;
+        while ((int)squad.f_members.size() < need && next < n_spare) {
+            squad.f_members.push_back(spare[next]);
+            next++;
+        }
+    }
 
+    for(; next < n_spare; next++)
+        f_squads[spare_squad[next]].f_members.push_back(spare[next]);
+
+    f_split_squads = false;
 }
 
 
-void GameState::send_order_to_a_fraction_of_knights(string &order) {
+int GameState::make_hunting_squads(int &M) {
 
-    int n = int(f_disperse_fraction*f_n_knights);
+    estimate_column_monsters(M);
+    f_last_knights_alive = knights_alive();
+    f_knight_loss_rate = 0.0;
+    f_lane_owner.assign(f_S, -1);
+    f_squads.clear();
+    f_split_squads = false;
 
-    for(int i = f_n_knights - 1; i >= f_n_knights - 1 - n; i--) {
+    // Knights escorting princesses wait in the corners.
+    set_knights_exits();
 
+    vector<int> hunters;
+    for(int i = 0; i < f_n_knights; i++) {
         if (f_knights[i]->f_n_p < 0)
             continue;
 
-        f_knights[i]->f_order = order;
+        if (f_knights[i]->f_n_p == 0)
+            hunters.push_back(i);
+        else
+            f_knights[i]->f_order = "ORDER_GO_TO_EXIT";
     }
-}
 
+    // The number of squads assumes the strength of an average lane,
+    // each squad then takes the strength of its own lane.
+    double lambda = (double)M/(f_S*f_S);
+    int strength = 1 + int(ceil(lambda + 2.0*sqrt(lambda)));
+
+    int n_hunters = hunters.size();
+    int n_cells = n_hunters/strength;
+    if (n_cells == 0) {
+        for(int k = 0; k < n_hunters; k++)
+            f_knights[hunters[k]]->f_order = "ORDER_GO_TO_EXIT";
+        return 0;
+    }
 
-void GameState::random_disperse_the_ith_knight(string &move_order, int &i) {
+    int width = min(min(n_cells, f_S), 10);
+    int n_squads = min(n_cells/width, (f_S + width - 1)/width);
 
-    //int move_id = rand() % 4;
-    int move_id = f_uniform_int(f_gen);
+    f_squads.resize(n_squads);
+    for(int k = 0; k < n_hunters; k++) {
+        f_squads[k % n_squads].f_members.push_back(hunters[k]);
+        f_knights[hunters[k]]->f_order = "ORDER_KILL_MONSTERS";
+    }
 
-    move_order[i] = f_moves[move_id];
-    // NEWS
-    if (move_id == 0) {
+    int n_active = 0;
+    for(int s = 0; s < n_squads; s++) {
+        f_squads[s].f_strength = strength;
+        f_squads[s].f_width = width;
 
-        if (f_knights[i]->f_y > 0) {
-            f_knights[i]->f_y = f_knights[i]->f_y - 1;
-        }
-    } else if (move_id == 1) {
+        if (select_hunting_lane(s) == true)
+            n_active++;
+        else
+            retire_hunting_squad(s);
+    }
 
-        if (f_knights[i]->f_x < f_S - 1) {
-            f_knights[i]->f_x = f_knights[i]->f_x + 1;
-        }
-    } else if (move_id == 2) {
+    split_hunting_squads();
 
-        if (f_knights[i]->f_x > 0) {
-            f_knights[i]->f_x = f_knights[i]->f_x - 1;
-        }
-    } else if (move_id == 3) {
+    #if LOG_LEVEL >= 1
+    event(EVENT_HUNT, n_squads, n_active, strength, width);
+    #endif
 
-        if (f_knights[i]->f_y < f_S - 1) {
-            f_knights[i]->f_y = f_knights[i]->f_y + 1;
-        }
-    }
+    return n_active;
 }
 
 
-void GameState::random_disperse_all_knights_to_the_same_point(string &move_order) {
-    int move_id = f_uniform_int(f_gen);
-    char s = f_moves[move_id];
+void GameState::move_hunting_squad(string &move_order, int &s) {
 
-    for(int i = 0; i < f_n_knights; i++) {
-
-        move_order[i] = s;
+    HuntingSquad &squad = f_squads[s];
 
-        if (move_id == 0) {
-
-            if (f_knights[i]->f_y > 0) {
-                f_knights[i]->f_y = f_knights[i]->f_y - 1;
-            }
-        } else if (move_id == 1) {
+    vector<int> alive;
+    int n = squad.f_members.size();
+    for(int k = 0; k < n; k++) {
+        if (f_knights[squad.f_members[k]]->f_n_p >= 0)
+            alive.push_back(squad.f_members[k]);
+    }
 
-            if (f_knights[i]->f_x < f_S - 1) {
-                f_knights[i]->f_x = f_knights[i]->f_x + 1;
-            }
-        } else if (move_id == 2) {
+    int n_alive = alive.size();
+    int width = min(squad.f_width, n_alive/squad.f_strength);
+    if (width == 0) {
+        retire_hunting_squad(s);
+        return;
+    }
 
-            if (f_knights[i]->f_x > 0) {
-                f_knights[i]->f_x = f_knights[i]->f_x - 1;
-            }
-        } else if (move_id == 3) {
+    // The row advances only once every knight stands in its cell.
+    bool in_formation = true;
+    for(int k = 0; k < n_alive; k++) {
+        Knight *kp = f_knights[alive[k]];
+        if (kp->f_x != squad.f_x0 + k % width || kp->f_y != squad.f_y)
+            in_formation = false;
+    }
 
-            if (f_knights[i]->f_y < f_S - 1) {
-                f_knights[i]->f_y = f_knights[i]->f_y + 1;
+    if (in_formation == true) {
+        int y = squad.f_y + squad.f_dy;
+        if (y < 0 || y > f_S - 1) {
+            if (select_hunting_lane(s) == false) {
+                retire_hunting_squad(s);
+                return;
             }
+        } else {
+            squad.f_y = y;
         }
-
     }
 
+    for(int k = 0; k < n_alive; k++) {
+        pair<int, int> slot = make_pair(squad.f_x0 + k % width, squad.f_y);
+        move_knight_towards_point(slot, move_order, alive[k]);
+    }
 }
 
 
+bool GameState::hunt_monsters(string &move_order, int &M) {
 
-void GameState::repulsive_random_disperse_the_ith_knight(string &move_order, int &i) {
+    estimate_column_monsters(M);
 
-    double p = f_uniform_real(f_gen);
-    double fraction_of_stay_in_place_moves = 0.05;    
-    if (p < fraction_of_stay_in_place_moves)
-        return;
-    
+    int n_alive = knights_alive();
+    f_knight_loss_rate = 0.9*f_knight_loss_rate + 0.1*(f_last_knights_alive - n_alive);
+    f_last_knights_alive = n_alive;
 
-    int x0 = f_knights[i]->f_x;
-    int y0 = f_knights[i]->f_y - 1;
+    if (f_split_squads == true && M > 0)
+        split_hunting_squads();
 
-    if (y0 < 0)
-        y0 = 0;
+    int n_active = 0;
+    int n_squads = f_squads.size();
+    for(int s = 0; s < n_squads; s++) {
+        if (f_squads[s].f_active == false)
+            continue;
 
-    int x1 = f_knights[i]->f_x + 1;
-    int y1 = f_knights[i]->f_y;
+        if (M == 0) {
+            retire_hunting_squad(s);
+            continue;
+        }
 
-    if (x1 > f_S - 1)
-        x1 = f_S - 1;
+        move_hunting_squad(move_order, s);
+        if (f_squads[s].f_active == true)
+            n_active++;
+    }
 
-    int x2 = f_knights[i]->f_x - 1;
-    int y2 = f_knights[i]->f_y;
+    for(int i = 0; i < f_n_knights; i++) {
+        if (f_knights[i]->f_n_p < 0 || f_knights[i]->f_order != "ORDER_GO_TO_EXIT")
+            continue;
 
-    if (x2 < 0)
-        x2 = 0;
+        move_knight_towards_point(f_corners[f_knights[i]->f_e], move_order, i);
+    }
 
-    int x3 = f_knights[i]->f_x;
-    int y3 = f_knights[i]->f_y + 1;
+    return n_active > 0;
+}
 
-    if (y3 > f_S - 1)
-        y3 = f_S - 1;
 
 
-    int d0 = _manhatan_distance_from_point(f_global_assembly_point, x0, y0);
-    int d1 = _manhatan_distance_from_point(f_global_assembly_point, x1, y1);
-    int d2 = _manhatan_distance_from_point(f_global_assembly_point, x2, y2);
-    int d3 = _manhatan_distance_from_point(f_global_assembly_point, x3, y3);
+// --------------------------------------------
+// -------------  Order Policy  ---------------
+// --------------------------------------------
 
-    double s_sum = d0 + d1 + d2 + d3;
-    
-    double d0p = (double)d0/s_sum;
-    double d1p = (double)d1/s_sum;
-    double d2p = (double)d2/s_sum;
-    double d3p = (double)d3/s_sum;
 
-    discrete_distribution<> d_nonuniform({d0p, d1p, d2p, d3p});
+// A policy plays a turn: it follows the global order through the
+// phases and moves the knights. OrderPolicy holds the standard phases.
+// A policy derives from it and hides the phases it does differently,
+// the calls go through policy() and are bound at compile time.
+//
+// The random steps of the dispersing knights are taken between
+// begin_turn and end_turn (GameState::take_walks), end_turn goes on
+// with the phase begin_turn played.
+enum TurnStage {STAGE_NONE, STAGE_APPROACH, STAGE_SEARCH};
 
-    int move_id = d_nonuniform(f_gen);
+template<class Policy>
+class OrderPolicy {
+    public:
+        TurnStage f_stage; // of the turn begun
 
-    move_order[i] = f_moves[move_id];
+        OrderPolicy(): f_stage(STAGE_NONE) {}
 
-    // NEWS
-    if (move_id == 0) {
+        Policy &policy() {return static_cast<Policy&>(*this);}
 
-        if (f_knights[i]->f_y > 0) {
-            f_knights[i]->f_y = f_knights[i]->f_y - 1;
-        }
-    } else if (move_id == 1) {
+        void play_turn(GameState &gs, string &move_order, int &P, int &M, int &n_escorted_princesses);
+        void begin_turn(GameState &gs, string &move_order, int &P, int &M, int &n_escorted_princesses);
+        void end_turn(GameState &gs, string &move_order, int &M);
 
-        if (f_knights[i]->f_x < f_S - 1) {
-            f_knights[i]->f_x = f_knights[i]->f_x + 1;
-        }
-    } else if (move_id == 2) {
+        void approach(GameState &gs, string &move_order);
+        void finish_approach(GameState &gs, string &move_order);
+        void search(GameState &gs, string &move_order);
+        void search_knight(GameState &gs, string &move_order, int &i);
+        void final_return(GameState &gs, string &move_order, int &M);
+        void hunt(GameState &gs, string &move_order, int &M);
+        void go_to_exit(GameState &gs, string &move_order);
+};
 
-        if (f_knights[i]->f_x > 0) {
-            f_knights[i]->f_x = f_knights[i]->f_x - 1;
-        }
-    } else if (move_id == 3) {
 
-        if (f_knights[i]->f_y < f_S - 1) {
-            f_knights[i]->f_y = f_knights[i]->f_y + 1;
-        }
-    }
+template<class Policy>
+void OrderPolicy<Policy>::play_turn(GameState &gs, string &move_order, int &P, int &M, int &n_escorted_princesses) {
+
+    begin_turn(gs, move_order, P, M, n_escorted_princesses);
+    gs.take_walks(move_order);
+    end_turn(gs, move_order, M);
 }
 
 
-void GameState::attractive_random_disperse_the_ith_knight(string &move_order, int &i) {
+template<class Policy>
+void OrderPolicy<Policy>::begin_turn(GameState &gs, string &move_order, int &P, int &M, int &n_escorted_princesses) {
 
-    double p = f_uniform_real(f_gen);
-    double fraction_of_stay_in_place_moves = 0.05;    
-    if (p < fraction_of_stay_in_place_moves)
+    f_stage = STAGE_NONE;
+
+    if (gs.f_current_global_order_name == "ORDER_GO_TO_EXIT") {
+
+        policy().go_to_exit(gs, move_order);
         return;
-    
+    }
 
-    int x0 = f_knights[i]->f_x;
-    int y0 = f_knights[i]->f_y - 1;
+    if (gs.f_current_global_order_name == "ORDER_KILL_MONSTERS") {
 
-    if (y0 < 0)
-        y0 = 0;
+        policy().hunt(gs, move_order, M);
+        return;
+    }
 
-    int x1 = f_knights[i]->f_x + 1;
-    int y1 = f_knights[i]->f_y;
 
-    if (x1 > f_S - 1)
-        x1 = f_S - 1;
+    if (P == n_escorted_princesses && 
+        gs.f_current_global_order_name != "ORDER_FINAL_RETURN_TO_GLOBAL_ASSEMBLY_POINT") {
+        string global_order = "ORDER_FINAL_RETURN_TO_GLOBAL_ASSEMBLY_POINT";
+        gs.send_global_order(global_order);
+        gs.send_order_to_all_knights(global_order);
+    }
 
-    int x2 = f_knights[i]->f_x - 1;
-    int y2 = f_knights[i]->f_y;
 
-    if (x2 < 0)
-        x2 = 0;
+    if (gs.f_current_global_order_name == "ORDER_MOVE_TO_PRINCESS_CENTER_OF_MASS") {
 
-    int x3 = f_knights[i]->f_x;
-    int y3 = f_knights[i]->f_y + 1;
+        policy().approach(gs, move_order);
+        f_stage = STAGE_APPROACH;
 
-    if (y3 > f_S - 1)
-        y3 = f_S - 1;
+    } else if (gs.f_current_global_order_name == "ORDER_RANDOM_PRINCESS_SEARCH") {
 
+        gs.adapt_dispersal(P);
+        gs.recenter_assembly_point();
+        gs.check_cancel();
+        policy().search(gs, move_order);
+        f_stage = STAGE_SEARCH;
 
-    double d0 = 1.0/_manhatan_distance_from_point(f_global_assembly_point, x0, y0);
-    double d1 = 1.0/_manhatan_distance_from_point(f_global_assembly_point, x1, y1);
-    double d2 = 1.0/_manhatan_distance_from_point(f_global_assembly_point, x2, y2);
-    double d3 = 1.0/_manhatan_distance_from_point(f_global_assembly_point, x3, y3);
+    } else if (gs.f_current_global_order_name == "ORDER_FINAL_RETURN_TO_GLOBAL_ASSEMBLY_POINT") {
 
-    double s_sum = d0 + d1 + d2 + d3;
-    
-    double d0p = (double)d0/s_sum;
-    double d1p = (double)d1/s_sum;
-    double d2p = (double)d2/s_sum;
-    double d3p = (double)d3/s_sum;
+        policy().final_return(gs, move_order, M);
 
-    discrete_distribution<> d_nonuniform({d0p, d1p, d2p, d3p});
+    }
+}
 
-    int move_id = d_nonuniform(f_gen);
 
-    move_order[i] = f_moves[move_id];
+template<class Policy>
+void OrderPolicy<Policy>::end_turn(GameState &gs, string &move_order, int &M) {
 
-    // NEWS
-    if (move_id == 0) {
+    if (f_stage == STAGE_APPROACH) {
+        policy().finish_approach(gs, move_order);
+    } else if (f_stage == STAGE_SEARCH) {
+        gs.check_cancel();
+        gs.move_convoys(move_order, M);
+    }
 
-        if (f_knights[i]->f_y > 0) {
-            f_knights[i]->f_y = f_knights[i]->f_y - 1;
-        }
-    } else if (move_id == 1) {
+    f_stage = STAGE_NONE;
+}
 
-        if (f_knights[i]->f_x < f_S - 1) {
-            f_knights[i]->f_x = f_knights[i]->f_x + 1;
-        }
-    } else if (move_id == 2) {
 
-        if (f_knights[i]->f_x > 0) {
-            f_knights[i]->f_x = f_knights[i]->f_x - 1;
-        }
-    } else if (move_id == 3) {
+template<class Policy>
+void OrderPolicy<Policy>::approach(GameState &gs, string &move_order) {
 
-        if (f_knights[i]->f_y < f_S - 1) {
-            f_knights[i]->f_y = f_knights[i]->f_y + 1;
-        }
+    if (gs.f_S > gs.f_parameters.f_large_board) {
+        gs.deploy_next_wave();
+        gs.atractive_disperse(move_order);
     }
 }
 
 
-void GameState::atractive_disperse(string &move_order) {
-
-    int n = int(f_disperse_fraction*f_n_knights);
+template<class Policy>
+void OrderPolicy<Policy>::finish_approach(GameState &gs, string &move_order) {
 
-    for(int i = f_n_knights - 1; i >= f_n_knights - 1 - n; i--) {
+    gs.move_diagonally_towards_point(gs.f_global_assembly_point, move_order);    
 
-        if (f_knights[i]->f_order == "ORDER_INITIALLY_DISPERSED")
-            attractive_random_disperse_the_ith_knight(move_order, i);
+    bool cm_reached = gs.princess_cm_reached(gs.f_global_assembly_point);
+    if (cm_reached == true) {
+        string order = "ORDER_RANDOM_PRINCESS_SEARCH";
+        gs.send_global_order(order);
+        // Fraction of knights that will search for princesses.            
+        gs.send_order_to_a_fraction_of_knights(order);
+        gs.make_search_sectors();
     }
 }
 
 
+template<class Policy>
+void OrderPolicy<Policy>::search(GameState &gs, string &move_order) {
 
-void GameState::check_and_set_princess_escort_during_random_disperse(string &move_order) {
+    gs.assign_knights_to_search_sectors();
+    gs.check_cancel();
+    gs.find_frontier_cells();
+    gs.check_cancel();
+    gs.check_and_set_princess_escort_during_random_disperse(move_order, [&] (int &i) {
+        policy().search_knight(gs, move_order, i);
+    });
+}
 
-    for(int i = 0; i < f_n_knights; i++) {
 
-        if (f_knights[i]->f_n_p < 0)
-            continue;
+template<class Policy>
+void OrderPolicy<Policy>::search_knight(GameState &gs, string &move_order, int &i) {
+    gs.search_sector_or_frontier(move_order, i);
+}
 
-        if (f_knights[i]->f_order == "ORDER_RETURN_TO_GLOBAL_ASSEMBLY_POINT") {
-            move_knight_towards_point(f_global_assembly_point, move_order, i);
 
-            bool reached_cm = check_if_knight_reached_princess_cm(f_global_assembly_point, i)  ;          
-            if (reached_cm == true)
-                f_knights[i]->f_order = "ORDER_RANDOM_PRINCESS_SEARCH";
-            continue;
+template<class Policy>
+void OrderPolicy<Policy>::final_return(GameState &gs, string &move_order, int &M) {
 
-        } else if (f_knights[i]->f_n_p > 0 && f_knights[i]->f_order == "ORDER_RANDOM_PRINCESS_SEARCH") {
-            f_knights[i]->f_order = "ORDER_RETURN_TO_GLOBAL_ASSEMBLY_POINT";
-            move_knight_towards_point(f_global_assembly_point, move_order, i);
+    gs.move_towards_global_assembly_point(move_order);
 
-            bool reached_cm = check_if_knight_reached_princess_cm(f_global_assembly_point, i)  ;          
-            if (reached_cm == true)
-                f_knights[i]->f_order = "ORDER_RANDOM_PRINCESS_SEARCH";
-            continue;
+    bool cm_reached = gs.check_if_all_knights_reached_princess_cm(gs.f_global_assembly_point);
+    if (cm_reached == false)
+        return;
 
-        } else if (f_knights[i]->f_n_p == 0 && f_knights[i]->f_order == "ORDER_RANDOM_PRINCESS_SEARCH") {
-            repulsive_random_disperse_the_ith_knight(move_order, i);
-            continue;
-        }
+    // Hunting squads set the orders of their own knights.
+    if (M > 0 && gs.f_S > gs.f_parameters.f_large_board && gs.make_hunting_squads(M) > 0) {
+        string global_order = "ORDER_KILL_MONSTERS";
+        gs.send_global_order(global_order);
+    } else {
+        string global_order = "ORDER_GO_TO_EXIT";
+        gs.send_global_order(global_order);
+        gs.send_order_to_all_knights(global_order);
+        gs.set_knights_exits();
     }
 }
 
 
-void GameState::max_forward_disperse() {
-
-    #if PRINT_DEBUG == 1
-    fprintf(stderr, "f_total_dispersed: %d\n", f_total_dispersed);
-    fprintf(stderr, "f_max_number_of_dispersed_knights: %d\n", f_max_number_of_dispersed_knights);
-    #endif
-
-    if (f_total_dispersed >= f_max_number_of_dispersed_knights)
-        return;
+template<class Policy>
+void OrderPolicy<Policy>::hunt(GameState &gs, string &move_order, int &M) {
 
-    int x = 0;
-    int y = 0;
-    for(int i = 0; i < f_n_knights; i++) {
+    bool hunting = gs.hunt_monsters(move_order, M);
 
-        if (f_knights[i]->f_n_p >=0) {
-            x = f_knights[i]->f_x;
-            y = f_knights[i]->f_y;
-            break;
-        }
+    if (hunting == false || gs.f_turn > 0.5*gs.f_S*gs.f_S*gs.f_S) {
+        string global_order = "ORDER_GO_TO_EXIT";
+        gs.send_global_order(global_order);
+        gs.send_order_to_all_knights(global_order);
+        gs.set_knights_exits();
     }
+}
 
-    int d = _manhatan_distance_from_point(f_global_assembly_point, x, y);
-
-    if (d > f_S/4)
-        return;
 
-    int n = int(f_disperse_fraction*f_n_knights);
+template<class Policy>
+void OrderPolicy<Policy>::go_to_exit(GameState &gs, string &move_order) {
+    gs.move_towards_exits(move_order);
+}
 
-    uniform_int_distribution<> uniform_int_fraction(f_n_knights - 1 - n, f_n_knights - 1);
 
-    for(int i = 0; i < n; i++) {
-        int inititally_dispersed_id = uniform_int_fraction(f_gen);
+// Searchers are auctioned onto sectors, the rest go to unexplored cells.
+class SectorSearchPolicy : public OrderPolicy<SectorSearchPolicy> {};
 
-        #if PRINT_DEBUG == 1
-        fprintf(stderr, "inititally_dispersed_id: %d\n", inititally_dispersed_id);
-        #endif
 
-        if (f_total_dispersed >= f_max_number_of_dispersed_knights)
-            return;
+// Searchers only do the repulsive random walk.
+class RandomSearchPolicy : public OrderPolicy<RandomSearchPolicy> {
+    public:
+        void search(GameState &gs, string &move_order) {
+            gs.check_and_set_princess_escort_during_random_disperse(move_order, [&] (int &i) {
+                gs.repulsive_random_disperse_the_ith_knight(move_order, i);
+            });
+        }
+};
 
-        f_knights[inititally_dispersed_id]->f_order = "ORDER_INITIALLY_DISPERSED";
-        f_total_dispersed++;
-    }
 
-}
+// Policies selectable by name, policy_names[id] is the name of policy
+// id, which PrincessesAndMonsters::make_move switches on.
+enum PolicyId {POLICY_SECTOR_SEARCH, POLICY_RANDOM_SEARCH, N_POLICIES};
 
+const vector<string> policy_names = {"sector_search", "random_search"};
 
 
 // --------------------------------------------
@@ -1066,11 +4515,44 @@ public:
     int f_n_knights_pam;
     vector<Knight> f_knights_pam;
     GameState f_gs;
+    string f_move_order;
+    vector<Knight> f_before; // knights before the turn, checked by end_move
+
+    PolicyId f_policy_id;
+    SectorSearchPolicy f_sector_search;
+    RandomSearchPolicy f_random_search;
+
+    // Telemetry, every f_frame_period turns f_frame_sink gets a frame
+    // (layout in Telemetry.h) without its grid of visited cells, and the
+    // visited rows to encode it from. The sink may swap the buffers for
+    // others. Copies of the solver do not report.
+    function<void(string &, int, vector<uint64_t> &)> f_frame_sink;
+    int f_frame_period;
+    string f_frame;
+    vector<uint64_t> f_frame_visited;
 
 
     PrincessesAndMonsters();
+    PrincessesAndMonsters(const PrincessesAndMonsters &other);
+    PrincessesAndMonsters &operator=(const PrincessesAndMonsters &other);
+    void swap(PrincessesAndMonsters &other);
 
     void set_knights(int &k);
+    bool set_policy(const string &name);
+    void set_threads(int n_threads);
+
+    // In-process interface, the caller owns all buffers and
+    // entrances/moves have room for K characters.
+    void initialize(int S, const int *princesses, int n_princesses,
+                    const int *monsters, int n_monsters, int K, char *entrances);
+    void move(const int *status, int P, int M, int timeLeft, char *moves);
+    void make_move(const int *status, int P, int M, int timeLeft);
+    void begin_move(const int *status, int P, int M);
+    void end_move(int P, int M);
+    void check_move(const vector<Knight> &before);
+    void log_knights();
+    void encode_frame(string &frame, vector<uint64_t> &visited, int P, int M);
+    void write_frame(int P, int M);
 
     string initialize(int S, vector<int> princesses, vector<int> monsters, int K);
     string move(vector<int> status, int P, int M, int timeLeft);
@@ -1090,15 +4572,78 @@ void PrincessesAndMonsters::set_knights(int &k) {
 PrincessesAndMonsters::PrincessesAndMonsters() {
         this->f_turn = 0;
         this->f_gs = GameState();
+        this->f_policy_id = POLICY_SECTOR_SEARCH;
+        this->f_frame_period = 1;
 };
 
 
+// Copies are independent games, used to try a turn without playing it.
+PrincessesAndMonsters::PrincessesAndMonsters(const PrincessesAndMonsters &other) {
+    f_frame_period = 1;
+    *this = other;
+}
 
-string PrincessesAndMonsters::initialize(int S, vector<int> princesses, vector<int> monsters, int K) {
 
-    #if PRINT_DEBUG == 1
-    fprintf(stderr, "Total number of turns: %d\n", S*S*S);
-    #endif
+PrincessesAndMonsters &PrincessesAndMonsters::operator=(const PrincessesAndMonsters &other) {
+
+    if (this == &other)
+        return *this;
+
+    f_t = other.f_t;
+    f_turn = other.f_turn;
+    f_n_knights_pam = other.f_n_knights_pam;
+    f_knights_pam = other.f_knights_pam;
+    f_gs = other.f_gs;
+    f_move_order = other.f_move_order;
+    f_policy_id = other.f_policy_id;
+
+    f_gs.rebind_knights(f_knights_pam, other.f_knights_pam);
+    return *this;
+}
+
+
+// Exchanges the games, as operator= without the telemetry. The knights
+// keep their addresses, so the pointers of f_gs stay valid.
+void PrincessesAndMonsters::swap(PrincessesAndMonsters &other) {
+
+    std::swap(f_t, other.f_t);
+    std::swap(f_turn, other.f_turn);
+    std::swap(f_n_knights_pam, other.f_n_knights_pam);
+    f_knights_pam.swap(other.f_knights_pam);
+    std::swap(f_gs, other.f_gs);
+    f_move_order.swap(other.f_move_order);
+    std::swap(f_policy_id, other.f_policy_id);
+}
+
+
+// Knight loops of a turn run on n_threads threads, the moves are the
+// same on any number.
+void PrincessesAndMonsters::set_threads(int n_threads) {
+
+    if (n_threads > 1)
+        f_gs.f_pool = make_shared<TurnPool>(n_threads);
+    else
+        f_gs.f_pool.reset();
+}
+
+
+bool PrincessesAndMonsters::set_policy(const string &name) {
+
+    for(int i = 0; i < N_POLICIES; i++) {
+        if (policy_names[i] == name) {
+            f_policy_id = (PolicyId)i;
+            return true;
+        }
+    }
+
+    cerr << "Unknown policy: " << name << endl;
+    return false;
+}
+
+
+
+void PrincessesAndMonsters::initialize(int S, const int *princesses, int n_princesses,
+                                       const int *monsters, int n_monsters, int K, char *entrances) {
 
     //for (auto p : princesses)
     //    fprintf(stderr, "princesses content: %d\n", p);
@@ -1106,48 +4651,32 @@ string PrincessesAndMonsters::initialize(int S, vector<int> princesses, vector<i
     set_knights(K);
 
     f_gs.set_S(S);
+    f_gs.set_corners();
 
-    f_gs.set_princesses(princesses);
-    f_gs.print_princesses();
+    f_gs.set_princesses(princesses, n_princesses);
+    f_gs.set_monsters(monsters, n_monsters);
 
-    f_gs.set_monsters(monsters);
-    f_gs.print_monsters();
+    #if LOG_LEVEL >= 1
+    f_gs.event(EVENT_INIT, S, n_princesses/2, n_monsters/2, K);
+    #endif
+    f_gs.log_princesses();
+    f_gs.log_monsters();
 
     //f_gs.set_knights(K);
     f_gs.set_knights(f_knights_pam);    
-    f_gs.print_knights();
 
     f_gs.make_groups();
-    f_gs.print_groups();
+    f_gs.log_groups();
 
-    double disperse_fraction = 0.9;
-    double initial_disperse_fraction = 0.5;
+    double disperse_fraction = f_gs.f_parameters.f_disperse_fraction;
+    double initial_disperse_fraction = f_gs.f_parameters.f_initial_disperse_fraction;
     f_gs.set_fractions(disperse_fraction, initial_disperse_fraction);
+    f_gs.f_controller.f_stay_probability = f_gs.f_parameters.f_stay_probability;
 
 
     f_gs.f_global_assembly_point = f_gs.princess_center_of_mass();
-    char closest_entrence_index = f_gs.princess_cm_closest_entrence(f_gs.f_global_assembly_point);
-
-
-    f_gs.f_entrance_exit = make_pair(0, 0); // initial knights position
-    if (closest_entrence_index == '0') {
-        f_gs.f_entrance_exit.first = 0;
-        f_gs.f_entrance_exit.second = 0;
-    } else if (closest_entrence_index == '1') {
-        f_gs.f_entrance_exit.first = S - 1;
-        f_gs.f_entrance_exit.second = 0;
-    } else if (closest_entrence_index == '2') {
-        f_gs.f_entrance_exit.first = S - 1;
-        f_gs.f_entrance_exit.second = S - 1;
-    } else if (closest_entrence_index == '3') {
-        f_gs.f_entrance_exit.first = 0;
-        f_gs.f_entrance_exit.second = S - 1;
-    } else {
-        cerr << "Unknown entrance!" << endl;
-        assert(false);
-    }
-
-    f_gs.update_initial_knight_positions(f_gs.f_entrance_exit);
+    f_gs.set_knights_entrances(f_gs.f_global_assembly_point);
+    f_gs.make_deployment_schedule();
     // f_gs.current_order_name = "PRINCESS_CENTER_OF_MASS";
 
     string order = "ORDER_MOVE_TO_PRINCESS_CENTER_OF_MASS";    
@@ -1157,151 +4686,209 @@ string PrincessesAndMonsters::initialize(int S, vector<int> princesses, vector<i
 
     srand(1234);
     f_t = -1;
-    // all knights start in top left corner
+    for(int i = 0; i < K; i++)
+        entrances[i] = '0' + f_knights_pam[i].f_e;
+
+    log_knights();
+}
 
-    string s = string(K, closest_entrence_index);
 
-    #if PRINT_DEBUG == 1
-    cerr << "Knight entrences: " << s << endl;
-    #endif
-    
+string PrincessesAndMonsters::initialize(int S, vector<int> princesses, vector<int> monsters, int K) {
+
+    string s = string(K, '0');
+    initialize(S, princesses.data(), princesses.size(), monsters.data(), monsters.size(), K, &s[0]);
+
     return s;
 }
 
 
 
-string PrincessesAndMonsters::move(vector<int> status, int P, int M, int timeLeft) {
+void PrincessesAndMonsters::make_move(const int *status, int P, int M, int timeLeft) {
+
+    begin_move(status, P, M);
+    f_gs.take_walks(f_move_order);
+    end_move(P, M);
+}
+
+
+// The turn up to the random steps of the dispersing knights, which
+// end_move expects taken.
+void PrincessesAndMonsters::begin_move(const int *status, int P, int M) {
     f_t++;
 
     f_turn++;
-    int n_knights = status.size();
+    f_gs.f_turn = f_turn;
+    int n_knights = f_n_knights_pam;
 
-    #if PRINT_DEBUG == 1
-    fprintf(stderr, "Turn: %d\n", f_turn);
-    #endif
-    
     f_gs.update_knights_number_of_princesses(status);
-    f_gs.print_knights();
 
     int n_escorted_princesses = f_gs.get_number_of_escorted_princesses_at_cm(f_gs.f_global_assembly_point);
 
-    #if PRINT_DEBUG == 1
-    cerr << "Total number of princesses: " << P << "; Escorted princesses at cm: " << n_escorted_princesses << endl;
+    #if LOG_LEVEL >= 1
+    f_gs.event(EVENT_TURN, P, M, n_escorted_princesses);
     #endif
 
-    string move_order = string(n_knights, 'X');
-    if (f_gs.f_current_global_order_name == "ORDER_GO_TO_EXIT") {
+    f_move_order.assign(n_knights, 'X');
 
-        #if PRINT_DEBUG == 1
-        cerr << "ORDER_GO_TO_EXIT - Current move order: " << move_order << endl;
-        cerr << "Exit at: (" << f_gs.f_entrance_exit.first << "," << f_gs.f_entrance_exit.second << ")" << endl;
-        #endif
+    #if CHECK_INVARIANTS == 1
+    f_before = f_knights_pam;
+    #endif
 
-        f_gs.move_towards_point(f_gs.f_entrance_exit, move_order);
-        return move_order;
+    switch (f_policy_id) {
+        case POLICY_RANDOM_SEARCH:
+            f_random_search.begin_turn(f_gs, f_move_order, P, M, n_escorted_princesses);
+            break;
+        case POLICY_SECTOR_SEARCH:
+        default:
+            f_sector_search.begin_turn(f_gs, f_move_order, P, M, n_escorted_princesses);
+            break;
     }
+}
 
-    if (f_gs.f_current_global_order_name == "ORDER_KILL_MONSTERS") {
 
-        if (f_turn > f_gs.f_S*f_gs.f_S*f_gs.f_S*0.5) {
-            string global_order = "ORDER_GO_TO_EXIT";
-            f_gs.send_global_order(global_order);
-            f_gs.send_order_to_all_knights(global_order);
-        }
+void PrincessesAndMonsters::end_move(int P, int M) {
 
-        #if PRINT_DEBUG == 1
-        cerr << "ORDER_KILL_MONSTERS - Current move order: " << move_order << endl;
-        #endif
-        f_gs.random_disperse_all_knights_to_the_same_point(move_order);
-        return move_order;
+    switch (f_policy_id) {
+        case POLICY_RANDOM_SEARCH:
+            f_random_search.end_turn(f_gs, f_move_order, M);
+            break;
+        case POLICY_SECTOR_SEARCH:
+        default:
+            f_sector_search.end_turn(f_gs, f_move_order, M);
+            break;
     }
 
+    #if CHECK_INVARIANTS == 1
+    check_move(f_before);
+    #endif
 
-    if (P == n_escorted_princesses && 
-        f_gs.f_current_global_order_name != "ORDER_FINAL_RETURN_TO_GLOBAL_ASSEMBLY_POINT") {
-        string global_order = "ORDER_FINAL_RETURN_TO_GLOBAL_ASSEMBLY_POINT";
-        f_gs.send_global_order(global_order);
-        f_gs.send_order_to_all_knights(global_order);
+    log_knights();
+    write_frame(P, M);
+}
+
+
+// After the turn, with the move each knight was given (0 before the
+// first turn).
+void PrincessesAndMonsters::log_knights() {
+
+    #if LOG_LEVEL >= 2
+    for(int i = 0; i < f_n_knights_pam; i++) {
+        Knight &k = f_knights_pam[i];
+        f_gs.event(EVENT_KNIGHT, i, k.f_x, k.f_y, k.f_n_p, order_id(k.f_order), i < (int)f_move_order.size() ? (int)f_move_order[i] : 0);
     }
+    #endif
+}
 
 
-    if (f_gs.f_current_global_order_name == "ORDER_MOVE_TO_PRINCESS_CENTER_OF_MASS") {
+void PrincessesAndMonsters::write_frame(int P, int M) {
 
-        if (f_gs.f_S > 40) {     
-            f_gs.max_forward_disperse();
-            f_gs.atractive_disperse(move_order);
+    if (f_frame_sink && f_turn % f_frame_period == 0) {
+        encode_frame(f_frame, f_frame_visited, P, M);
+        f_frame_sink(f_frame, f_gs.f_S, f_frame_visited);
+    }
+}
 
-        } //else {
 
-        //    f_gs.move_towards_point(f_gs.f_global_assembly_point, move_order);
-        //}
-        f_gs.move_diagonally_towards_point(f_gs.f_global_assembly_point, move_order);    
+template<class T> void append_value(string &s, T value) {
+    s.append((const char*)&value, sizeof(T));
+}
 
 
-        #if PRINT_DEBUG == 1
-        cerr << "ORDER_MOVE_TO_PRINCESS_CENTER_OF_MASS - Current move order: " << move_order << endl;
-        #endif
+// Grid of side*side values scaled to 0..255 of the largest one, which
+// is stored as a float in front of them.
+void append_grid(string &s, uint8_t kind, int side, const vector<double> &values) {
 
+    double largest = 0;
+    for(double v : values)
+        largest = max(largest, v);
 
-        bool cm_reached = f_gs.princess_cm_reached(f_gs.f_global_assembly_point);
-        if (cm_reached == true) {
-            //cerr << "---> CENTER OF MASS REACHED <---" << endl;
-            string order = "ORDER_RANDOM_PRINCESS_SEARCH";
-            f_gs.send_global_order(order);
-            //f_gs.send_order_to_all_knights(order);
-            // Fraction of knights that will search for princesses.            
-            f_gs.send_order_to_a_fraction_of_knights(order);
-            return move_order;
-        }
-        return move_order;
+    append_value<uint8_t>(s, kind);
+    append_value<uint8_t>(s, 0);
+    append_value<uint16_t>(s, side);
+    append_value<float>(s, largest);
+    for(double v : values)
+        append_value<uint8_t>(s, largest > 0 ? uint8_t(255*v/largest + 0.5) : 0);
+}
 
 
-    } else if (f_gs.f_current_global_order_name == "ORDER_RANDOM_PRINCESS_SEARCH") {
-        f_gs.check_and_set_princess_escort_during_random_disperse(move_order);
-        //f_gs.random_disperse(move_order);
-        
-        #if PRINT_DEBUG == 1
-        cerr << "ORDER_RANDOM_PRINCESS_SEARCH - Current move order: " << move_order << endl;
-        #endif
-        return move_order;
+// The visited grid is left to the sink, which encodes it from visited
+// off the turn (finish_telemetry_frame in Telemetry.h).
+void PrincessesAndMonsters::encode_frame(string &frame, vector<uint64_t> &visited, int P, int M) {
+
+    GameState &gs = f_gs;
+
+    frame.clear();
+    append_value<uint32_t>(frame, 0); // size, filled in by finish_telemetry_frame
+    append_value<int32_t>(frame, f_turn);
+    append_value<int32_t>(frame, gs.f_S);
+    append_value<int32_t>(frame, f_n_knights_pam);
+    append_value<int32_t>(frame, P);
+    append_value<int32_t>(frame, M);
+    append_value<int32_t>(frame, gs.f_global_assembly_point.first);
+    append_value<int32_t>(frame, gs.f_global_assembly_point.second);
+
+    append_value<uint8_t>(frame, order_id(gs.f_current_global_order_name));
+    append_value<uint8_t>(frame, 2);
+    append_value<uint16_t>(frame, 0);
+
+    for(int i = 0; i < f_n_knights_pam; i++) {
+        Knight &k = f_knights_pam[i];
+        append_value<uint16_t>(frame, k.f_x);
+        append_value<uint16_t>(frame, k.f_y);
+        append_value<int8_t>(frame, min(k.f_n_p, 127));
+        append_value<uint8_t>(frame, order_id(k.f_order));
+    }
 
+    // Grid 0, expected princesses on the board per planner block.
+    append_grid(frame, 0, gs.f_interception.f_n, gs.f_interception.remaining(f_turn));
 
-    } else if (f_gs.f_current_global_order_name == "ORDER_FINAL_RETURN_TO_GLOBAL_ASSEMBLY_POINT") {
-        
-        f_gs.move_towards_point(f_gs.f_global_assembly_point, move_order);
+    // Grid 1, share of visited cells in blocks of at most 64 x 64.
+    gs.f_coverage->copy_visited(visited);
+}
 
-        #if PRINT_DEBUG == 1
-        cerr << "ORDER_FINAL_RETURN_TO_GLOBAL_ASSEMBLY_POINT - Current move order: " << move_order << endl;
-        #endif
 
+// The reply has one NEWSX move per knight, the tracked knights moved
+// as the judge will move them and dead knights stay where they died.
+void PrincessesAndMonsters::check_move(const vector<Knight> &before) {
 
-        bool cm_reached = f_gs.check_if_all_knights_reached_princess_cm(f_gs.f_global_assembly_point);
-        if (cm_reached == true) {
+    int S = f_gs.f_S;
+    assert((int)f_move_order.size() == f_n_knights_pam);
 
-            string global_order = "";
-            double n_knights_alive = (double)f_gs.knights_alive();
+    for(int i = 0; i < f_n_knights_pam; i++) {
+        const Knight &k = f_knights_pam[i];
+        char c = f_move_order[i];
+        assert(c == 'N' || c == 'E' || c == 'W' || c == 'S' || c == 'X');
+        assert(k.f_x >= 0 && k.f_x < S && k.f_y >= 0 && k.f_y < S);
 
-            if (n_knights_alive < (double)n_knights_alive/f_gs.f_S && f_gs.f_S > 40)
-                global_order = "ORDER_KILL_MONSTERS";
-            else
-                global_order = "ORDER_GO_TO_EXIT";
+        if (before[i].f_n_p < 0) {
+            assert(c == 'X' && k.f_x == before[i].f_x && k.f_y == before[i].f_y);
+            continue;
+        }
 
-            f_gs.send_global_order(global_order);
-            f_gs.send_order_to_all_knights(global_order);
+        int x = before[i].f_x + (c == 'E') - (c == 'W');
+        int y = before[i].f_y + (c == 'S') - (c == 'N');
+        x = min(max(x, 0), S - 1);
+        y = min(max(y, 0), S - 1);
+        if (k.f_x != x || k.f_y != y) {
+            cerr << "Knight " << i << " tracked at (" << k.f_x << "," << k.f_y << ") but moved '" << c << "' from ("
+                 << before[i].f_x << "," << before[i].f_y << ")" << endl;
+            assert(false);
         }
+    }
+}
 
-        return move_order;
-    } else if (f_gs.f_current_global_order_name == "ORDER_DO_NOTHING") {
 
-        #if PRINT_DEBUG == 1
-        cerr << "ORDER_DO_NOTHING - Current move order: " << move_order << endl;
-        #endif
+void PrincessesAndMonsters::move(const int *status, int P, int M, int timeLeft, char *moves) {
 
-    }
+    make_move(status, P, M, timeLeft);
+    memcpy(moves, f_move_order.data(), f_n_knights_pam);
+}
 
 
+string PrincessesAndMonsters::move(vector<int> status, int P, int M, int timeLeft) {
 
-    return move_order;
+    make_move(status.data(), P, M, timeLeft);
+    return f_move_order;
 }
 
 
@@ -1310,14 +4897,329 @@ string PrincessesAndMonsters::move(vector<int> status, int P, int M, int timeLef
 
 // -------8<------- end of solution submitted to the website -------8<-------
 
+#ifdef PAM_LIBRARY
+
+#include "PrincessesAndMonsters.h"
+#include "Telemetry.h"
+
+
+PrincessesAndMonstersSolver::PrincessesAndMonstersSolver() {
+    f_pam = new PrincessesAndMonsters();
+    f_telemetry = nullptr;
+}
+
+
+PrincessesAndMonstersSolver::~PrincessesAndMonstersSolver() {
+    delete f_pam;
+    delete f_telemetry;
+}
+
+
+bool PrincessesAndMonstersSolver::set_telemetry(const char *path, int period) {
+
+    TelemetryWriter *writer = new TelemetryWriter();
+    if (writer->open(path) == false) {
+        delete writer;
+        return false;
+    }
+
+    delete f_telemetry;
+    f_telemetry = writer;
+    f_pam->f_frame_period = max(1, period);
+    f_pam->f_frame_sink = [writer] (string &frame, int S, vector<uint64_t> &visited) {writer->write(frame, S, visited);};
+    return true;
+}
+
+
+bool PrincessesAndMonstersSolver::set_policy(const char *name) {
+    return f_pam->set_policy(name);
+}
+
+
+bool PrincessesAndMonstersSolver::set_parameter(const char *name, double value) {
+    return f_pam->f_gs.f_parameters.set(name, value);
+}
+
+
+void PrincessesAndMonstersSolver::set_seed(unsigned seed) {
+    f_pam->f_gs.f_stream_seed = seed;
+}
+
+
+void PrincessesAndMonstersSolver::set_threads(int n_threads) {
+    f_pam->set_threads(n_threads);
+}
+
+
+bool PrincessesAndMonstersSolver::set_event_log(const char *path) {
+
+    shared_ptr<EventLog> log = make_shared<EventLog>();
+    if (log->open(path) == false)
+        return false;
+
+    f_pam->f_gs.f_events = log;
+    return true;
+}
+
+
+void PrincessesAndMonstersSolver::initialize(int S, const int *princesses, int n_princesses,
+                                             const int *monsters, int n_monsters, int K, char *entrances) {
+    f_pam->initialize(S, princesses, n_princesses, monsters, n_monsters, K, entrances);
+}
+
+
+void PrincessesAndMonstersSolver::move(const int *status, int P, int M, int timeLeft, char *moves) {
+    f_pam->move(status, P, M, timeLeft, moves);
+}
+
+
+PrincessesAndMonstersBatch::PrincessesAndMonstersBatch() {
+    f_walks = new DispersalWalks();
+}
+
+
+PrincessesAndMonstersBatch::~PrincessesAndMonstersBatch() {
+    delete f_walks;
+}
+
+
+void PrincessesAndMonstersBatch::move(PrincessesAndMonstersSolver *const *solvers, int n, const int *status,
+                                      const int *P, const int *M, int stride, char *moves) {
+
+    for(int g = 0; g < n; g++)
+        solvers[g]->f_pam->begin_move(status + g*stride, P[g], M[g]);
+
+    f_walks->clear();
+    for(int g = 0; g < n; g++)
+        solvers[g]->f_pam->f_gs.collect_walks(*f_walks);
+    f_walks->walk();
+
+    int k = 0;
+    for(int g = 0; g < n; g++) {
+        PrincessesAndMonsters *pam = solvers[g]->f_pam;
+        pam->f_gs.apply_walks(*f_walks, k, pam->f_move_order);
+        pam->end_move(P[g], M[g]);
+        memcpy(moves + g*stride, pam->f_move_order.data(), pam->f_n_knights_pam);
+    }
+}
+
+
+PrincessesAndMonstersPool::PrincessesAndMonstersPool(int n_threads) {
+    f_pool = new TurnPool(max(1, n_threads));
+}
+
+
+PrincessesAndMonstersPool::~PrincessesAndMonstersPool() {
+    delete f_pool;
+}
+
+
+void PrincessesAndMonstersPool::run(int n_jobs, const function<void(int)> &job) {
+    f_pool->run(n_jobs, job);
+}
+
+#else
+
+#include <sstream>
+
+#include "Telemetry.h"
+
 template<class T> void getVector(vector<T>& v) {
     for (int i = 0; i < v.size(); ++i)
         cin >> v[i];
 }
 
+
+// Plans the next turn while main() waits for the judge. Every guess of
+// the coming status is played on a copy of the solver by a background
+// thread; if the judge sends one of the guessed statuses the copy, one
+// turn ahead, replaces the solver and its moves are sent at once.
+//
+// Copies carry the random generator along, so a hit plays exactly the
+// turn the solver would have played itself. Guess g logs its events as
+// source g + 1, an EVENT_SPECULATION of the solver tells which guess
+// (if any) was played.
+//
+// Handing a turn over from the thread costs some 5-10 us, more than a
+// whole turn of a contest sized game. Turns shorter than
+// SPECULATION_MIN_TURN_US, the last one played, are not planned ahead.
+const double SPECULATION_MIN_TURN_US = 100;
+
+class SpeculativePlanner {
+    public:
+        struct Guess {
+            vector<int> f_status;
+            int f_P;
+            int f_M;
+            bool f_done;
+            double f_us; // duration of its turn
+            PrincessesAndMonsters f_pam;
+            string f_moves;
+        };
+
+        vector<Guess> f_guesses;
+        bool f_planned;
+        thread f_thread;
+        atomic<bool> f_cancel;
+        int f_hits;
+        int f_misses;
+        double f_turn_us; // duration of the last turn played
+
+        SpeculativePlanner(): f_planned(false), f_cancel(false), f_hits(0), f_misses(0), f_turn_us(0) {}
+        ~SpeculativePlanner() {finish();}
+
+        void start(PrincessesAndMonsters &pam, vector<int> &status, int P, int M);
+        void finish();
+        bool take(PrincessesAndMonsters &pam, vector<int> &status, int P, int M, string &moves);
+
+    private:
+        void plan(PrincessesAndMonsters &pam);
+};
+
+
+// Most turns nothing is picked up and nothing dies, so the first guess
+// is the last status again. While hunting monsters die without
+// changing the status, the second guess has one monster less.
+void SpeculativePlanner::start(PrincessesAndMonsters &pam, vector<int> &status, int P, int M) {
+
+    finish();
+
+    f_planned = f_turn_us >= SPECULATION_MIN_TURN_US;
+    if (f_planned == false)
+        return;
+
+    f_guesses.resize(M > 0 ? 2 : 1);
+    for(int g = 0; g < (int)f_guesses.size(); g++) {
+        f_guesses[g].f_status = status;
+        f_guesses[g].f_P = P;
+        f_guesses[g].f_M = M - g;
+        f_guesses[g].f_done = false;
+    }
+
+    f_cancel = false;
+    f_thread = thread(&SpeculativePlanner::plan, this, ref(pam));
+}
+
+
+// pam is not touched by main() until finish() returns. A guess plays
+// on a copy of pam, copied into the game the guess held before, which
+// take() left there, so its buffers are reused.
+void SpeculativePlanner::plan(PrincessesAndMonsters &pam) {
+
+    int n = f_guesses.size();
+    for(int g = 0; g < n && f_cancel == false; g++) {
+        Guess &guess = f_guesses[g];
+        guess.f_pam = pam;
+        guess.f_pam.f_gs.f_event_source = g + 1;
+        guess.f_pam.f_gs.f_cancel = &f_cancel;
+        auto t0 = chrono::steady_clock::now();
+        try {
+            guess.f_moves = guess.f_pam.move(guess.f_status, guess.f_P, guess.f_M, 0);
+        } catch (TurnCancelled &) {
+            return;
+        }
+        guess.f_us = chrono::duration<double, micro>(chrono::steady_clock::now() - t0).count();
+        guess.f_done = true;
+    }
+}
+
+
+// Stops planning, the guess in progress stops within its turn.
+void SpeculativePlanner::finish() {
+
+    f_cancel = true;
+    if (f_thread.joinable())
+        f_thread.join();
+}
+
+
+// False if the turn was not planned or no guess was right, main()
+// then plays it and sets f_turn_us.
+bool SpeculativePlanner::take(PrincessesAndMonsters &pam, vector<int> &status, int P, int M, string &moves) {
+
+    finish();
+    if (f_planned == false)
+        return false;
+    f_planned = false;
+
+    int n = f_guesses.size();
+    for(int g = 0; g < n; g++) {
+        Guess &guess = f_guesses[g];
+        if (guess.f_done == true && guess.f_P == P && guess.f_M == M && guess.f_status == status) {
+            f_hits++;
+
+            #if LOG_LEVEL >= 1
+            pam.f_gs.event(EVENT_SPECULATION, g, f_hits, f_misses);
+            #endif
+
+            pam.swap(guess.f_pam);
+            pam.f_gs.f_event_source = 0;
+            pam.f_gs.f_cancel = nullptr;
+            moves.swap(guess.f_moves);
+            f_turn_us = guess.f_us;
+            return true;
+        }
+    }
+
+    f_misses++;
+
+    #if LOG_LEVEL >= 1
+    pam.f_gs.event(EVENT_SPECULATION, -1, f_hits, f_misses);
+    #endif
+    return false;
+}
+
+
 int main() {
     PrincessesAndMonsters pam;
 
+    // Policies are picked by name, e.g. PAM_POLICY=random_search.
+    if (getenv("PAM_POLICY") != nullptr && pam.set_policy(getenv("PAM_POLICY")) == false)
+        return 1;
+
+    // PAM_PARAMETERS=disperse_fraction=0.8,large_board=30 replaces
+    // constants of the strategy, names as in Parameters::set.
+    if (getenv("PAM_PARAMETERS") != nullptr) {
+        istringstream in(getenv("PAM_PARAMETERS"));
+        string assignment;
+        while (getline(in, assignment, ',')) {
+            size_t eq = assignment.find('=');
+            if (eq == string::npos || pam.f_gs.f_parameters.set(assignment.substr(0, eq), atof(assignment.c_str() + eq + 1)) == false)
+                return 1;
+        }
+    }
+
+    // PAM_THREADS=<n> runs the knight loops of a turn on n threads.
+    if (getenv("PAM_THREADS") != nullptr)
+        pam.set_threads(atoi(getenv("PAM_THREADS")));
+
+    // PAM_SEED=<n> replaces the random seed, so a game repeats.
+    if (getenv("PAM_SEED") != nullptr)
+        pam.f_gs.f_stream_seed = strtoul(getenv("PAM_SEED"), nullptr, 10);
+
+    // PAM_SPECULATE=0 plans every turn after the status arrives. On one
+    // core the planner would only slow down reading the status.
+    bool speculate = getenv("PAM_SPECULATE") == nullptr ? thread::hardware_concurrency() > 1 : atoi(getenv("PAM_SPECULATE")) != 0;
+    SpeculativePlanner planner;
+
+    // PAM_TELEMETRY=<file> records a frame every PAM_TELEMETRY_PERIOD
+    // turns, see Telemetry.h.
+    TelemetryWriter telemetry;
+    if (getenv("PAM_TELEMETRY") != nullptr) {
+        if (telemetry.open(getenv("PAM_TELEMETRY")) == false)
+            return 1;
+        pam.f_frame_period = getenv("PAM_TELEMETRY_PERIOD") != nullptr ? max(1, atoi(getenv("PAM_TELEMETRY_PERIOD"))) : 1;
+        pam.f_frame_sink = [&telemetry] (string &frame, int S, vector<uint64_t> &visited) {telemetry.write(frame, S, visited);};
+    }
+
+    // PAM_EVENT_LOG=<file> records the events of a build with
+    // -DLOG_LEVEL=1 or 2, see EventLogDump.cpp.
+    if (getenv("PAM_EVENT_LOG") != nullptr) {
+        pam.f_gs.f_events = make_shared<EventLog>();
+        if (pam.f_gs.f_events->open(getenv("PAM_EVENT_LOG")) == false)
+            return 1;
+    }
+
     int S, P, M, K;
     cin >> S >> P;
     vector<int> princesses(P);
@@ -1333,7 +5235,8 @@ int main() {
 
     for (int st = 0; ; ++st) {
         int nK;
-        cin >> nK;
+        if (!(cin >> nK))
+            break;
         vector<int> status(K);
         getVector(status);
         int nP, nM;
@@ -1341,8 +5244,29 @@ int main() {
         int timeLeft;
         cin >> timeLeft;
 
-        string ret = pam.move(status, nP, nM, timeLeft);
+        // A speculated turn was played by a copy, which does not report.
+        string ret;
+        if (planner.take(pam, status, nP, nM, ret) == true) {
+            pam.write_frame(nP, nM);
+        } else {
+            auto t0 = chrono::steady_clock::now();
+            ret = pam.move(status, nP, nM, timeLeft);
+            planner.f_turn_us = chrono::duration<double, micro>(chrono::steady_clock::now() - t0).count();
+        }
         cout << ret << endl;
         cout.flush();
+
+        if (speculate == true)
+            planner.start(pam, status, nP, nM);
     }
+
+    planner.finish();
+
+    // The log thread drains the ring before the file is closed.
+    if (pam.f_gs.f_events)
+        pam.f_gs.f_events->close();
+
+    return 0;
 }
+
+#endif
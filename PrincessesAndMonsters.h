@@ -0,0 +1,112 @@
+#ifndef PRINCESSES_AND_MONSTERS_H
+#define PRINCESSES_AND_MONSTERS_H
+
+// In-process interface of the solver, for harnesses that drive many
+// turns without the text protocol. The solver without main() is built
+// as a static library and linked with -lPrincessesAndMonsters:
+//
+//     make libPrincessesAndMonsters.a
+//
+// All buffers belong to the caller. Coordinates are given as in the
+// judge protocol (row, column pairs), status holds K entries and
+// entrances/moves need room for K characters (no terminating zero).
+
+#include <functional>
+
+class PrincessesAndMonsters;
+class TelemetryWriter;
+class TurnPool;
+class DispersalWalks;
+
+
+class PrincessesAndMonstersSolver {
+    public:
+        PrincessesAndMonstersSolver();
+        ~PrincessesAndMonstersSolver();
+
+        // Picks one of the compiled in policies ("sector_search", the
+        // default, or "random_search") before initialize.
+        bool set_policy(const char *name);
+
+        // Replaces a constant of the strategy before initialize:
+        // disperse_fraction, initial_disperse_fraction, large_board
+        // (smallest S that disperses in waves and hunts, exclusive),
+        // stay_probability (of the searchers' walk, adapted during the
+        // game from there) or attractive_stay_probability (of the walk
+        // around an interception block). False for an unknown name.
+        bool set_parameter(const char *name, double value);
+
+        // Replaces the random seed, for runs that must repeat.
+        void set_seed(unsigned seed);
+
+        // Runs the per knight loops of a turn on n_threads threads (1,
+        // the default, runs them on the calling thread). The moves do
+        // not depend on the number of threads.
+        void set_threads(int n_threads);
+
+        // Writes a telemetry frame (Telemetry.h) to path every period
+        // turns from a background thread. False if path cannot be opened.
+        bool set_telemetry(const char *path, int period);
+
+        // Writes the events of a build with -DLOG_LEVEL=1 or 2 to path
+        // (see EventLogDump.cpp) from a background thread. False if path
+        // cannot be opened.
+        bool set_event_log(const char *path);
+
+        void initialize(int S, const int *princesses, int n_princesses,
+                        const int *monsters, int n_monsters, int K, char *entrances);
+        void move(const int *status, int P, int M, int timeLeft, char *moves);
+
+    private:
+        PrincessesAndMonsters *f_pam;
+        TelemetryWriter *f_telemetry;
+
+        PrincessesAndMonstersSolver(const PrincessesAndMonstersSolver &);
+        PrincessesAndMonstersSolver &operator=(const PrincessesAndMonstersSolver &);
+
+        friend class PrincessesAndMonstersBatch;
+};
+
+
+// Plays a turn of many games in lockstep: every game up to the random
+// steps of its dispersing knights, the steps of all games in one pass,
+// then the rest of every turn. The moves are those move gives.
+class PrincessesAndMonstersBatch {
+    public:
+        PrincessesAndMonstersBatch();
+        ~PrincessesAndMonstersBatch();
+
+        // Game g is solvers[g] with the status at status + g*stride,
+        // P[g] and M[g], its moves go to moves + g*stride.
+        void move(PrincessesAndMonstersSolver *const *solvers, int n, const int *status, const int *P, const int *M,
+                  int stride, char *moves);
+
+    private:
+        DispersalWalks *f_walks;
+
+        PrincessesAndMonstersBatch(const PrincessesAndMonstersBatch &);
+        PrincessesAndMonstersBatch &operator=(const PrincessesAndMonstersBatch &);
+};
+
+
+
+// The thread pool the solver runs its turns on (set_threads), for
+// harnesses that play many games at once. run calls job(0) ...
+// job(n_jobs - 1) on n_threads threads, the calling one included, and
+// returns when all of them are done; one run at a time. A job must not
+// throw.
+class PrincessesAndMonstersPool {
+    public:
+        explicit PrincessesAndMonstersPool(int n_threads);
+        ~PrincessesAndMonstersPool();
+
+        void run(int n_jobs, const std::function<void(int)> &job);
+
+    private:
+        TurnPool *f_pool;
+
+        PrincessesAndMonstersPool(const PrincessesAndMonstersPool &);
+        PrincessesAndMonstersPool &operator=(const PrincessesAndMonstersPool &);
+};
+
+#endif
@@ -0,0 +1,559 @@
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <thread>
+#include <new>
+
+#include "PrincessesAndMonsters.h"
+
+using namespace std;
+
+// Hosts many games in one process. Messages arrive on stdin, one per
+// line, each one addressed to a game id:
+//
+//     INIT <id> <S> <P> <p_1> ... <p_P> <M> <m_1> ... <m_M> <K> [<seed>]
+//     MOVE <id> <K> <status_1> ... <status_K> <P> <M> <timeLeft>
+//     END <id>
+//
+// The numbers follow the judge protocol, the optional seed (an unsigned
+// 32 bit number) makes the game repeat, as set_seed does. Messages are collected until
+// an empty line (or end of input) and then processed as one batch on
+// the thread pool, every game on one thread and in arrival order.
+// Replies are written in the order of the messages and the batch is
+// closed with an empty line:
+//
+//     <id> <entrances>      for INIT
+//     <id> <moves>          for MOVE
+//     <id> ERROR <reason>   for anything that cannot be served
+//
+// Messages take effect in their order, also within a batch: END frees
+// the game and has no reply, a later MOVE of that id is an error. INIT
+// of a running game id starts a new game under that id, the messages
+// before it still go to the old one.
+//
+// INIT is checked before it reaches the solver: 1 <= S <= MAX_S,
+// 1 <= K <= MAX_K, the princesses and monsters come in whole (row,
+// column) pairs on the board. MOVE needs the K of the game, statuses
+// of at least -1 and P, M >= 0. A message that fails gets an ERROR
+// reply and changes nothing, the other games go on.
+//
+// Every game owns its solver and an arena (see Game Arena) its solver
+// allocates from. The games of a batch run on the solver's thread pool
+// (PrincessesAndMonstersPool).
+//
+// Build:
+//     make PrincessesAndMonstersServer
+
+
+// --------------------------------------------
+// --------------  Game Arena  ----------------
+// --------------------------------------------
+
+
+// Every game allocates from its own arena. The replaced global
+// operator new below hands out blocks of the arena of the game being
+// served on the thread (t_arena, set by ArenaScope), so the solver's
+// containers land there whatever their allocator. Blocks of up to
+// ARENA_MAX_BLOCK bytes are cut from chunks of ARENA_CHUNK bytes by a
+// bump pointer and recycled through one free list per size class,
+// larger ones come from malloc. Games share no chunks, and ending a
+// game returns its chunks at once. A game is served on one thread at a
+// time, so its arena takes no lock.
+//
+// Every block, of an arena or not, starts with a BlockHeader naming its
+// arena, so operator delete finds it from any thread.
+const size_t ARENA_ALIGN = 16;
+const size_t ARENA_MAX_BLOCK = 4096;
+const size_t ARENA_CHUNK = 1 << 20;
+const int ARENA_CLASSES = ARENA_MAX_BLOCK/ARENA_ALIGN + 1;
+
+class GameArena;
+
+struct BlockHeader {
+    GameArena *f_arena; // nullptr for a block of malloc
+    size_t f_size; // with the header, a multiple of ARENA_ALIGN
+};
+static_assert(sizeof(BlockHeader) == ARENA_ALIGN, "blocks keep the alignment of malloc");
+
+
+// The arena keeps its lists inside its own chunks and blocks, it never
+// calls operator new.
+class GameArena {
+    public:
+        void *f_chunks; // each one starts with the pointer to the next
+        char *f_top; // bump pointer in the newest chunk
+        char *f_end;
+        void *f_free[ARENA_CLASSES]; // by f_size/ARENA_ALIGN
+        long long f_live; // blocks handed out and not freed
+        bool f_retired; // its game ended, freed with the last block
+
+        GameArena(): f_chunks(nullptr), f_top(nullptr), f_end(nullptr), f_live(0), f_retired(false) {
+            for(int c = 0; c < ARENA_CLASSES; c++)
+                f_free[c] = nullptr;
+        }
+
+        ~GameArena() {
+            while (f_chunks != nullptr) {
+                void *next = *(void**)f_chunks;
+                free(f_chunks);
+                f_chunks = next;
+            }
+        }
+
+        BlockHeader *allocate(size_t size);
+        void deallocate(BlockHeader *h);
+        void retire();
+};
+
+
+BlockHeader *GameArena::allocate(size_t size) {
+
+    size_t n = (size + sizeof(BlockHeader) + ARENA_ALIGN - 1)/ARENA_ALIGN*ARENA_ALIGN;
+    BlockHeader *h;
+    if (n > ARENA_MAX_BLOCK) {
+        h = (BlockHeader*)malloc(n);
+    } else if (f_free[n/ARENA_ALIGN] != nullptr) {
+        h = (BlockHeader*)f_free[n/ARENA_ALIGN];
+        f_free[n/ARENA_ALIGN] = *(void**)h;
+    } else {
+        if (f_top == nullptr || f_top + n > f_end) {
+            void *chunk = malloc(ARENA_CHUNK);
+            if (chunk == nullptr)
+                return nullptr;
+            *(void**)chunk = f_chunks;
+            f_chunks = chunk;
+            f_top = (char*)chunk + ARENA_ALIGN;
+            f_end = (char*)chunk + ARENA_CHUNK;
+        }
+        h = (BlockHeader*)f_top;
+        f_top += n;
+    }
+
+    if (h == nullptr)
+        return nullptr;
+    h->f_arena = this;
+    h->f_size = n;
+    f_live++;
+    return h;
+}
+
+
+void GameArena::deallocate(BlockHeader *h) {
+
+    if (h->f_size > ARENA_MAX_BLOCK) {
+        free(h);
+    } else {
+        *(void**)h = f_free[h->f_size/ARENA_ALIGN];
+        f_free[h->f_size/ARENA_ALIGN] = h;
+    }
+
+    if (--f_live == 0 && f_retired == true)
+        delete this;
+}
+
+
+// Called when the game ended. Blocks still handed out (nothing of the
+// solver should outlive it) keep the chunks until they are freed.
+void GameArena::retire() {
+
+    f_retired = true;
+    if (f_live == 0)
+        delete this;
+}
+
+
+thread_local GameArena *t_arena = nullptr;
+
+
+// Allocations of the thread go to arena while it lives.
+class ArenaScope {
+    public:
+        GameArena *f_last;
+
+        ArenaScope(GameArena *arena): f_last(t_arena) {t_arena = arena;}
+        ~ArenaScope() {t_arena = f_last;}
+};
+
+
+void *allocate_block(size_t size) {
+
+    GameArena *arena = t_arena;
+    BlockHeader *h;
+    if (arena != nullptr) {
+        h = arena->allocate(size);
+    } else {
+        h = (BlockHeader*)malloc(size + sizeof(BlockHeader));
+        if (h != nullptr)
+            h->f_arena = nullptr;
+    }
+
+    return h != nullptr ? h + 1 : nullptr;
+}
+
+
+// Not inlined into operator delete, where the compiler would take the
+// free of a block of operator new for a mismatch.
+__attribute__((noinline)) void free_block(void *p) {
+
+    if (p == nullptr)
+        return;
+
+    BlockHeader *h = (BlockHeader*)p - 1;
+    if (h->f_arena != nullptr)
+        h->f_arena->deallocate(h);
+    else
+        free(h);
+}
+
+
+void *operator new(size_t size) {
+    void *p = allocate_block(size);
+    if (p == nullptr)
+        throw bad_alloc();
+    return p;
+}
+
+
+void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+
+void *operator new(size_t size, const nothrow_t &) noexcept {
+    return allocate_block(size);
+}
+
+
+void *operator new[](size_t size, const nothrow_t &) noexcept {
+    return allocate_block(size);
+}
+
+
+void operator delete(void *p) noexcept {
+    free_block(p);
+}
+
+
+void operator delete[](void *p) noexcept {
+    free_block(p);
+}
+
+
+void operator delete(void *p, const nothrow_t &) noexcept {
+    free_block(p);
+}
+
+
+void operator delete[](void *p, const nothrow_t &) noexcept {
+    free_block(p);
+}
+
+
+#if __cplusplus >= 201402L
+void operator delete(void *p, size_t) noexcept {
+    free_block(p);
+}
+
+
+void operator delete[](void *p, size_t) noexcept {
+    free_block(p);
+}
+#endif
+
+
+// --------------------------------------------
+// -------------  Game Server  ----------------
+// --------------------------------------------
+
+
+class Message {
+    public:
+        string f_type;
+        long long f_game_id;
+        int f_S;
+        int f_K;
+        int f_P;
+        int f_M;
+        int f_time_left;
+        bool f_seeded;
+        unsigned f_seed;
+        vector<int> f_princesses;
+        vector<int> f_monsters;
+        vector<int> f_status;
+        string f_reply;
+        string f_error; // why parse failed
+
+        Message(): f_game_id(-1), f_S(0), f_K(0), f_P(0), f_M(0), f_time_left(0), f_seeded(false), f_seed(0) {}
+};
+
+
+// The solver is made, played and destroyed in its arena.
+class Game {
+    public:
+        GameArena *f_arena;
+        PrincessesAndMonstersSolver *f_solver;
+        int f_K;
+
+        Game(): f_arena(new GameArena()), f_K(0) {
+            ArenaScope scope(f_arena);
+            f_solver = new PrincessesAndMonstersSolver();
+        }
+
+        ~Game() {
+            delete f_solver;
+            f_arena->retire();
+        }
+
+    private:
+        Game(const Game &);
+        Game &operator=(const Game &);
+};
+
+
+class GameServer {
+    public:
+        map<long long, unique_ptr<Game>> f_games;
+        PrincessesAndMonstersPool f_pool;
+
+        GameServer(int n_threads): f_pool(n_threads) {}
+
+        bool parse(string &line, Message &m);
+        void serve(Message &m, Game *game);
+        void process(vector<Message> &batch);
+};
+
+
+// Limits of INIT, the largest boards and armies the solver is known
+// to play (see StressBenchmark.cpp).
+const int MAX_S = 2000;
+const int MAX_K = 100000;
+
+
+// The values are read one at a time, a count larger than the line
+// does not allocate.
+template<class T> bool read_vector(istringstream &in, vector<T> &v, int n) {
+
+    if (n < 0)
+        return false;
+
+    v.clear();
+    T value;
+    for(int i = 0; i < n; i++) {
+        if (!(in >> value))
+            return false;
+        v.push_back(value);
+    }
+
+    return true;
+}
+
+
+// (row, column) pairs on a board of side S.
+bool on_board(const vector<int> &coordinates, int S) {
+
+    if (coordinates.size() % 2 != 0)
+        return false;
+    for(int c : coordinates) {
+        if (c < 0 || c >= S)
+            return false;
+    }
+
+    return true;
+}
+
+
+// False with m.f_error set if the message cannot be served.
+bool GameServer::parse(string &line, Message &m) {
+
+    istringstream in(line);
+    m.f_error = "cannot parse message";
+    if (!(in >> m.f_type >> m.f_game_id))
+        return false;
+
+    if (m.f_type == "INIT") {
+        int n_p, n_m;
+        if (!(in >> m.f_S >> n_p) || read_vector(in, m.f_princesses, n_p) == false)
+            return false;
+        if (!(in >> n_m) || read_vector(in, m.f_monsters, n_m) == false)
+            return false;
+        if (!(in >> m.f_K))
+            return false;
+
+        string seed;
+        if (in >> seed) {
+            char *end;
+            m.f_seed = strtoul(seed.c_str(), &end, 10);
+            m.f_seeded = true;
+            if (*end != '\0')
+                return false;
+        }
+
+        if (m.f_S < 1 || m.f_S > MAX_S) {
+            m.f_error = "S must be in [1, " + to_string(MAX_S) + "]";
+            return false;
+        }
+        if (m.f_K < 1 || m.f_K > MAX_K) {
+            m.f_error = "K must be in [1, " + to_string(MAX_K) + "]";
+            return false;
+        }
+        if (on_board(m.f_princesses, m.f_S) == false || on_board(m.f_monsters, m.f_S) == false) {
+            m.f_error = "princesses and monsters must be (row, column) pairs in [0, S)";
+            return false;
+        }
+        return true;
+
+    } else if (m.f_type == "MOVE") {
+        if (!(in >> m.f_K) || m.f_K < 0 || m.f_K > MAX_K || read_vector(in, m.f_status, m.f_K) == false)
+            return false;
+        if (!(in >> m.f_P >> m.f_M >> m.f_time_left))
+            return false;
+
+        for(int status : m.f_status) {
+            if (status < -1) {
+                m.f_error = "a status must be -1 or more";
+                return false;
+            }
+        }
+        if (m.f_P < 0 || m.f_M < 0) {
+            m.f_error = "P and M must not be negative";
+            return false;
+        }
+        return true;
+
+    } else if (m.f_type == "END") {
+        return true;
+    }
+
+    return false;
+}
+
+
+void GameServer::serve(Message &m, Game *game) {
+
+    string id = to_string(m.f_game_id);
+
+    if (m.f_type == "INIT") {
+        string entrances(m.f_K, '0');
+        {
+            ArenaScope scope(game->f_arena);
+            if (m.f_seeded == true)
+                game->f_solver->set_seed(m.f_seed);
+            game->f_solver->initialize(m.f_S, m.f_princesses.data(), m.f_princesses.size(),
+                                       m.f_monsters.data(), m.f_monsters.size(), m.f_K, &entrances[0]);
+        }
+        game->f_K = m.f_K;
+        m.f_reply = id + " " + entrances;
+
+    } else if (m.f_type == "MOVE") {
+        if (game == nullptr || m.f_K != game->f_K) {
+            m.f_reply = id + " ERROR no game with " + to_string(m.f_K) + " knights";
+            return;
+        }
+
+        string moves(m.f_K, 'X');
+        {
+            ArenaScope scope(game->f_arena);
+            game->f_solver->move(m.f_status.data(), m.f_P, m.f_M, m.f_time_left, &moves[0]);
+        }
+        m.f_reply = id + " " + moves;
+    }
+}
+
+
+void GameServer::process(vector<Message> &batch) {
+
+    // Games are created, looked up and ended here in message order, the
+    // workers never touch the game table. Each game of the batch gets
+    // one job, so its messages keep their order. Ended and replaced
+    // games are only freed after their jobs ran.
+    map<long long, int> job_of_game;
+    vector<Game*> job_game;
+    vector<vector<int>> job_messages;
+    vector<unique_ptr<Game>> retired;
+
+    int n = batch.size();
+    for(int k = 0; k < n; k++) {
+
+        Message &m = batch[k];
+        if (m.f_type == "ERROR")
+            continue;
+
+        if (m.f_type == "END" || m.f_type == "INIT") {
+            auto g = f_games.find(m.f_game_id);
+            if (g != f_games.end()) {
+                retired.push_back(move(g->second));
+                f_games.erase(g);
+            }
+            job_of_game.erase(m.f_game_id);
+            if (m.f_type == "END")
+                continue;
+
+            f_games[m.f_game_id].reset(new Game());
+        }
+
+        auto j = job_of_game.find(m.f_game_id);
+        if (j == job_of_game.end()) {
+            auto g = f_games.find(m.f_game_id);
+            j = job_of_game.insert(make_pair(m.f_game_id, (int)job_game.size())).first;
+            job_game.push_back(g == f_games.end() ? nullptr : g->second.get());
+            job_messages.push_back(vector<int>());
+        }
+
+        job_messages[j->second].push_back(k);
+    }
+
+    f_pool.run(job_game.size(), [&] (int j) {
+        for(int k : job_messages[j])
+            serve(batch[k], job_game[j]);
+    });
+}
+
+
+int main(int argc, char **argv) {
+
+    int n_threads = thread::hardware_concurrency();
+    for(int i = 1; i + 1 < argc; i++) {
+        if (string(argv[i]) == "-t")
+            n_threads = atoi(argv[i + 1]);
+    }
+
+    ios::sync_with_stdio(false);
+    GameServer server(n_threads);
+
+    vector<Message> batch;
+    string line;
+    while (true) {
+
+        bool more = bool(getline(cin, line));
+
+        if (more == true && line.empty() == false) {
+            batch.push_back(Message());
+            if (server.parse(line, batch.back()) == false) {
+                batch.back().f_reply = to_string(batch.back().f_game_id) + " ERROR " + batch.back().f_error;
+                batch.back().f_type = "ERROR";
+            }
+            continue;
+        }
+
+        if (batch.empty() == false) {
+            server.process(batch);
+            for(auto &m : batch) {
+                if (m.f_reply.empty() == false)
+                    cout << m.f_reply << "\n";
+            }
+            cout << "\n";
+            cout.flush();
+            batch.clear();
+        }
+
+        if (more == false)
+            break;
+    }
+
+    return 0;
+}
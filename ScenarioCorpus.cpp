@@ -0,0 +1,78 @@
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <chrono>
+
+#include "PrincessesAndMonsters.h"
+#include "ScenarioCorpus.h"
+
+using namespace std;
+
+// Writes and inspects scenario corpora (format in ScenarioCorpus.h).
+//
+//     ScenarioCorpus generate <file> <n> <seed>
+//     ScenarioCorpus list <file>
+//
+// list maps the corpus, prints one line per scenario and runs the
+// solver's initialize on each of them straight from the mapping.
+//
+// Build:
+//     make ScenarioCorpus
+
+
+int list_corpus(const string &path) {
+
+    auto t0 = chrono::steady_clock::now();
+
+    ScenarioCorpus corpus;
+    if (corpus.open(path) == false) {
+        fprintf(stderr, "Cannot open %s\n", path.c_str());
+        return 1;
+    }
+
+    auto t1 = chrono::steady_clock::now();
+
+    for(int i = 0; i < corpus.size(); i++) {
+        Scenario s = corpus.scenario(i);
+
+        string entrances(s.K, '0');
+        PrincessesAndMonstersSolver solver;
+        solver.initialize(s.S, s.princesses, s.n_princess_values,
+                          s.monsters, s.n_monster_values, s.K, &entrances[0]);
+
+        printf("%d S=%d P=%d M=%d K=%d seed=%llu\n", i, s.S, s.n_princess_values/2,
+               s.n_monster_values/2, s.K, (unsigned long long)s.seed);
+    }
+
+    auto t2 = chrono::steady_clock::now();
+    fprintf(stderr, "%d scenarios, open %.3f ms, initialize %.3f ms\n", corpus.size(),
+            chrono::duration<double, milli>(t1 - t0).count(),
+            chrono::duration<double, milli>(t2 - t1).count());
+
+    return 0;
+}
+
+
+int main(int argc, char **argv) {
+
+    string command = argc > 1 ? argv[1] : "";
+
+    if (command == "generate" && argc == 5) {
+        string path = argv[2];
+        uint32_t n = strtoul(argv[3], nullptr, 10);
+        uint64_t seed = strtoull(argv[4], nullptr, 10);
+
+        if (write_scenario_corpus(path, n, seed) == false) {
+            fprintf(stderr, "Cannot write %s\n", path.c_str());
+            return 1;
+        }
+        return 0;
+
+    } else if (command == "list" && argc == 3) {
+        return list_corpus(argv[2]);
+    }
+
+    fprintf(stderr, "Usage: %s generate <file> <n> <seed>\n", argv[0]);
+    fprintf(stderr, "       %s list <file>\n", argv[0]);
+    return 1;
+}
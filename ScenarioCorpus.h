@@ -0,0 +1,266 @@
+#ifndef SCENARIO_CORPUS_H
+#define SCENARIO_CORPUS_H
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Binary corpus of test scenarios. The file is read through mmap and
+// a scenario is handed out as pointers into the mapping, laid out as
+// the arguments of the in-process initialize, so nothing is parsed.
+//
+// Layout (native byte order, every block 8 byte aligned):
+//
+//     CorpusHeader
+//     uint64_t offsets[n_scenarios]         from the start of the file
+//     per scenario: ScenarioRecord, int32_t princesses[n_princess_values],
+//                   int32_t monsters[n_monster_values], padding
+//
+// Coordinates are (row, column) pairs as in the judge protocol.
+
+
+const uint32_t CORPUS_MAGIC = 0x434d4150; // "PAMC"
+const uint32_t CORPUS_VERSION = 1;
+
+
+struct CorpusHeader {
+    uint32_t f_magic;
+    uint32_t f_version;
+    uint32_t f_n_scenarios;
+    uint32_t f_reserved;
+    uint64_t f_seed; // seed the corpus was generated from
+};
+
+
+struct ScenarioRecord {
+    int32_t f_S;
+    int32_t f_K;
+    int32_t f_n_princess_values;
+    int32_t f_n_monster_values;
+    uint64_t f_seed; // for the random walks of a simulation of this scenario
+};
+
+
+struct Scenario {
+    int S;
+    int K;
+    const int *princesses;
+    int n_princess_values;
+    const int *monsters;
+    int n_monster_values;
+    uint64_t seed;
+};
+
+
+// --------------------------------------------
+// ----------  Scenario Generator  ------------
+// --------------------------------------------
+
+
+// Ranges follow the problem statement: 10 <= S <= 50, between S and
+// S*S/10 princesses and monsters and between 2 and S knights. Princesses
+// and monsters start anywhere but on the border ring of width S/10.
+// A larger max_S draws boards beyond the statement, for harnesses that
+// must reach the code of boards wider than 64.
+class ScenarioGenerator {
+    public:
+        std::mt19937_64 f_gen;
+        int f_max_S;
+
+        ScenarioGenerator(uint64_t seed, int max_S = 50): f_gen(seed), f_max_S(max_S) {}
+
+        int uniform(int lo, int hi) {return std::uniform_int_distribution<int>(lo, hi)(f_gen);}
+
+        void generate(int &S, int &K, std::vector<int> &princesses, std::vector<int> &monsters, uint64_t &seed) {
+            S = uniform(10, f_max_S);
+            int P = uniform(S, S*S/10);
+            int M = uniform(S, S*S/10);
+            K = uniform(2, S);
+
+            int lo = S/10;
+            int hi = S - 1 - S/10;
+            princesses.resize(2*P);
+            for(int i = 0; i < 2*P; i++)
+                princesses[i] = uniform(lo, hi);
+            monsters.resize(2*M);
+            for(int i = 0; i < 2*M; i++)
+                monsters[i] = uniform(lo, hi);
+
+            seed = f_gen();
+        }
+};
+
+
+inline size_t corpus_align(size_t n) {return (n + 7) & ~size_t(7);}
+
+
+// Writes n scenarios drawn from seed to path, returns false on I/O errors.
+inline bool write_scenario_corpus(const std::string &path, uint32_t n, uint64_t seed) {
+
+    FILE *f = fopen(path.c_str(), "wb");
+    if (f == nullptr)
+        return false;
+
+    CorpusHeader header = {CORPUS_MAGIC, CORPUS_VERSION, n, 0, seed};
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+
+    // Offsets are known only once the records are laid out, so the
+    // table is written as a placeholder and filled in at the end.
+    std::vector<uint64_t> offsets(n, 0);
+    ok = ok && fwrite(offsets.data(), sizeof(uint64_t), n, f) == n;
+
+    ScenarioGenerator generator(seed);
+    uint64_t offset = sizeof(header) + n*sizeof(uint64_t);
+    std::vector<int> princesses, monsters;
+    const char zeros[8] = {0};
+
+    for(uint32_t i = 0; i < n && ok == true; i++) {
+
+        ScenarioRecord record;
+        int S, K;
+        uint64_t scenario_seed;
+        generator.generate(S, K, princesses, monsters, scenario_seed);
+        record.f_S = S;
+        record.f_K = K;
+        record.f_n_princess_values = princesses.size();
+        record.f_n_monster_values = monsters.size();
+        record.f_seed = scenario_seed;
+
+        size_t size = sizeof(record) + (princesses.size() + monsters.size())*sizeof(int32_t);
+        offsets[i] = offset;
+        ok = fwrite(&record, sizeof(record), 1, f) == 1 &&
+             fwrite(princesses.data(), sizeof(int32_t), princesses.size(), f) == princesses.size() &&
+             fwrite(monsters.data(), sizeof(int32_t), monsters.size(), f) == monsters.size() &&
+             fwrite(zeros, 1, corpus_align(size) - size, f) == corpus_align(size) - size;
+        offset = offset + corpus_align(size);
+    }
+
+    ok = ok && fseek(f, sizeof(header), SEEK_SET) == 0 &&
+         fwrite(offsets.data(), sizeof(uint64_t), n, f) == n;
+
+    // fclose flushes the buffer, so it can fail as well.
+    bool closed = fclose(f) == 0;
+    return ok == true && closed == true;
+}
+
+
+// --------------------------------------------
+// -----------  Scenario Corpus  --------------
+// --------------------------------------------
+
+
+class ScenarioCorpus {
+    public:
+        const char *f_data;
+        size_t f_size;
+        const CorpusHeader *f_header;
+        const uint64_t *f_offsets;
+
+        ScenarioCorpus(): f_data(nullptr), f_size(0), f_header(nullptr), f_offsets(nullptr) {}
+        ~ScenarioCorpus() {close();}
+
+        bool open(const std::string &path);
+        void close();
+
+        int size() const {return f_header == nullptr ? 0 : f_header->f_n_scenarios;}
+        Scenario scenario(int i) const;
+
+    private:
+        ScenarioCorpus(const ScenarioCorpus &);
+        ScenarioCorpus &operator=(const ScenarioCorpus &);
+};
+
+
+inline bool ScenarioCorpus::open(const std::string &path) {
+
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(CorpusHeader)) {
+        ::close(fd);
+        return false;
+    }
+
+    void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED)
+        return false;
+
+    f_data = (const char*)data;
+    f_size = st.st_size;
+    f_header = (const CorpusHeader*)f_data;
+
+    if (f_header->f_magic != CORPUS_MAGIC || f_header->f_version != CORPUS_VERSION ||
+        sizeof(CorpusHeader) + f_header->f_n_scenarios*sizeof(uint64_t) > f_size) {
+        fprintf(stderr, "%s is not a version %u scenario corpus\n", path.c_str(), CORPUS_VERSION);
+        close();
+        return false;
+    }
+
+    f_offsets = (const uint64_t*)(f_data + sizeof(CorpusHeader));
+
+    // scenario() trusts the records, so every one must lie within the
+    // file, after the offset table and aligned.
+    uint64_t first = sizeof(CorpusHeader) + f_header->f_n_scenarios*sizeof(uint64_t);
+    for(uint32_t i = 0; i < f_header->f_n_scenarios; i++) {
+        uint64_t offset = f_offsets[i];
+        const ScenarioRecord *record = (const ScenarioRecord*)(f_data + offset);
+        bool valid = offset >= first && offset % 8 == 0 && offset + sizeof(ScenarioRecord) <= f_size;
+        valid = valid && record->f_S > 0 && record->f_K >= 0 &&
+                record->f_n_princess_values >= 0 && record->f_n_princess_values % 2 == 0 &&
+                record->f_n_monster_values >= 0 && record->f_n_monster_values % 2 == 0;
+        valid = valid && offset + sizeof(ScenarioRecord) +
+                         ((uint64_t)record->f_n_princess_values + record->f_n_monster_values)*sizeof(int32_t) <= f_size;
+        if (valid == false) {
+            fprintf(stderr, "%s: scenario %u does not fit the file\n", path.c_str(), i);
+            close();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+inline void ScenarioCorpus::close() {
+
+    if (f_data != nullptr)
+        munmap((void*)f_data, f_size);
+
+    f_data = nullptr;
+    f_size = 0;
+    f_header = nullptr;
+    f_offsets = nullptr;
+}
+
+
+inline Scenario ScenarioCorpus::scenario(int i) const {
+
+    const ScenarioRecord *record = (const ScenarioRecord*)(f_data + f_offsets[i]);
+    const int *values = (const int*)(record + 1);
+
+    Scenario s;
+    s.S = record->f_S;
+    s.K = record->f_K;
+    s.princesses = values;
+    s.n_princess_values = record->f_n_princess_values;
+    s.monsters = values + record->f_n_princess_values;
+    s.n_monster_values = record->f_n_monster_values;
+    s.seed = record->f_seed;
+
+    return s;
+}
+
+#endif
@@ -0,0 +1,140 @@
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <sys/wait.h>
+
+using namespace std;
+
+// Sends malformed messages between valid ones to a server speaking the
+// protocol of PrincessesAndMonstersServer.cpp and checks every reply,
+// and that the server keeps serving and exits cleanly:
+//
+//     ServerTest "./PrincessesAndMonstersServer -t 2"
+//
+// Build:
+//     make ServerTest
+
+
+// A reply matches if it has the length of the expected one and equals
+// it wherever the expected one is not '?'.
+struct Exchange {
+    const char *message;
+    const char *reply; // nullptr for none (END)
+};
+
+const Exchange exchanges[] = {
+    {"INIT 1 10 2 3 4 2 5 5 3 7", "1 ???"},
+
+    // INIT of a running id that fails leaves the game running.
+    {"INIT 1 0 0 0 3", "1 ERROR S must be in [1, 2000]"},
+    {"INIT 2 -4 0 0 3", "2 ERROR S must be in [1, 2000]"},
+    {"INIT 3 2001 0 0 3", "3 ERROR S must be in [1, 2000]"},
+    {"INIT 4 10 0 0 -1", "4 ERROR K must be in [1, 100000]"},
+    {"INIT 5 10 0 0 0", "5 ERROR K must be in [1, 100000]"},
+    {"INIT 6 10 0 0 100001", "6 ERROR K must be in [1, 100000]"},
+    {"INIT 7 10 3 1 2 3 0 3", "7 ERROR princesses and monsters must be (row, column) pairs in [0, S)"},
+    {"INIT 8 10 2 1 10 0 3", "8 ERROR princesses and monsters must be (row, column) pairs in [0, S)"},
+    {"INIT 9 10 2 -1 1 0 3", "9 ERROR princesses and monsters must be (row, column) pairs in [0, S)"},
+    {"INIT 10 10 0 2 5 10 3", "10 ERROR princesses and monsters must be (row, column) pairs in [0, S)"},
+    {"INIT 11 10 2000000000 1 2", "11 ERROR cannot parse message"},
+    {"INIT 12 10 2 1 2 0", "12 ERROR cannot parse message"},
+    {"INIT 13 10 0 0 3 seed", "13 ERROR cannot parse message"},
+    {"INIT 14", "14 ERROR cannot parse message"},
+    {"MOVE 2 3 0 0 0 1 1 10000", "2 ERROR no game with 3 knights"},
+
+    {"MOVE 1 3 0 0 0 1 1 10000", "1 ???"},
+    {"MOVE 1 3 0 -2 0 1 1 10000", "1 ERROR a status must be -1 or more"},
+    {"MOVE 1 3 0 0 0 -1 1 10000", "1 ERROR P and M must not be negative"},
+    {"MOVE 1 2 0 0 1 1 10000", "1 ERROR no game with 2 knights"},
+    {"MOVE 1 3 0 0 0 1 1 10000", "1 ???"},
+    {"END 1", nullptr},
+    {"MOVE 1 3 0 0 0 1 1 10000", "1 ERROR no game with 3 knights"},
+
+    {"INIT 15 1 2 0 0 0 1 1", "15 ?"},
+    {"MOVE 15 1 0 1 0 10000", "15 ?"},
+};
+const int N_EXCHANGES = sizeof(exchanges)/sizeof(exchanges[0]);
+
+
+bool matches(const string &reply, const char *expected) {
+
+    string e = expected;
+    if (reply.size() != e.size())
+        return false;
+    for(size_t i = 0; i < e.size(); i++) {
+        if (e[i] != '?' && e[i] != reply[i])
+            return false;
+    }
+
+    return true;
+}
+
+
+int main(int argc, char **argv) {
+
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s <server command>\n", argv[0]);
+        return 1;
+    }
+
+    // One message per batch, so every reply is followed by an empty line.
+    char path[] = "/tmp/ServerTestXXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        fprintf(stderr, "Cannot create %s\n", path);
+        return 1;
+    }
+    string input;
+    for(int k = 0; k < N_EXCHANGES; k++)
+        input += string(exchanges[k].message) + "\n\n";
+    bool written = write(fd, input.data(), input.size()) == (ssize_t)input.size();
+    close(fd);
+
+    FILE *server = written == true ? popen((string(argv[1]) + " < " + path).c_str(), "r") : nullptr;
+    if (server == nullptr) {
+        fprintf(stderr, "Cannot run %s\n", argv[1]);
+        unlink(path);
+        return 1;
+    }
+
+    // The replies of a batch, one per line, end at an empty line.
+    vector<string> batches;
+    string line, batch;
+    int c;
+    while ((c = fgetc(server)) != EOF) {
+        if (c != '\n') {
+            line.push_back(c);
+        } else if (line.empty() == true) {
+            batches.push_back(batch);
+            batch.clear();
+        } else {
+            batch += (batch.empty() == true ? "" : "\n") + line;
+            line.clear();
+        }
+    }
+    int status = pclose(server);
+    unlink(path);
+
+    // Batch k holds the reply to message k.
+    int n_failed = 0;
+    for(int k = 0; k < N_EXCHANGES; k++) {
+        string reply = k < (int)batches.size() ? batches[k] : "(no batch)";
+        bool ok = exchanges[k].reply == nullptr ? reply.empty() == true : matches(reply, exchanges[k].reply);
+        if (ok == true)
+            continue;
+
+        printf("%s\n    expected: %s\n    got:      %s\n", exchanges[k].message,
+               exchanges[k].reply != nullptr ? exchanges[k].reply : "", reply.c_str());
+        n_failed++;
+    }
+
+    if (WIFEXITED(status) == false || WEXITSTATUS(status) != 0) {
+        printf("the server did not exit cleanly (status %d)\n", status);
+        n_failed++;
+    }
+
+    printf("%d of %d exchanges failed\n", n_failed, N_EXCHANGES);
+    return n_failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,331 @@
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+#include "PrincessesAndMonsters.h"
+#include "ScenarioCorpus.h"
+#include "BatchSimulator.h"
+
+using namespace std;
+
+// Learns the spatial prior of the solver (its Spatial Prior section)
+// from games of a corpus (see ScenarioCorpus.h) played on the rules
+// engine (see BatchSimulator.h):
+//
+//     SpatialPrior <corpus> [first] [n_games] [-b batch_size] [-w source]
+//
+// At the last turn t of every turn bucket of every running game it
+// records, over every free princess, the variance per axis around the
+// cell she was last set free on (her first cell, or where a dying
+// knight dropped her) over half the turns since, the ratio to a random
+// walk on an open board; and, by the ring of her first cell (the
+// distance to the nearest corner, where knights come in, in quarters
+// of S), the share of the princesses picked up at least once. Prints
+// the tables, or with -w replaces them in source
+// (PrincessesAndMonsters.cpp) between the begin and end lines. A
+// bucket without games takes the value of the bucket before.
+//
+// Build:
+//     make SpatialPrior
+
+
+// The buckets of the solver: S in [10 + 10*s, 20 + 10*s), elapsed
+// turns in [t*S/4, (t + 1)*S/4), the last ones open, and rings of S/4
+// of Manhattan distance to the nearest corner.
+const int S_BUCKETS = 5;
+const int TURN_BUCKETS = 32;
+const int RINGS = 4;
+
+const char *BEGIN_LINE = "// -------8<------- begin of the spatial prior tables (SpatialPrior.cpp) -------8<-------";
+const char *END_LINE = "// -------8<------- end of the spatial prior tables -------8<-------";
+
+
+int s_bucket(int S) {
+    return max(0, min(S_BUCKETS - 1, (S - 10)/10));
+}
+
+
+int ring(int S, int x, int y) {
+    int d = min(x, S - 1 - x) + min(y, S - 1 - y);
+    return min(RINGS - 1, RINGS*d/S);
+}
+
+
+// What add_turn follows of every princess slot of a batch.
+class PrincessTracks {
+    public:
+        vector<int32_t> f_x0, f_y0, f_t0; // where and when she was last set free
+        vector<int32_t> f_owner; // her owner after the last turn
+        vector<char> f_ring; // ring of her first cell
+        vector<char> f_picked; // picked up at least once
+
+        PrincessTracks(GameBatch &batch);
+};
+
+
+PrincessTracks::PrincessTracks(GameBatch &batch): f_x0(batch.f_px), f_y0(batch.f_py), f_t0(batch.f_px.size(), 0),
+                                                  f_owner(batch.f_p_owner), f_ring(batch.f_px.size(), 0),
+                                                  f_picked(batch.f_px.size(), 0) {
+
+    int n = batch.f_n_lanes;
+    for(int g = 0; g < n; g++) {
+        for(int j = 0; j < batch.f_P[g]; j++) {
+            int k = j*n + g;
+            f_ring[k] = ring(batch.f_S[g], batch.f_px[k], batch.f_py[k]);
+        }
+    }
+}
+
+
+class PriorStatistics {
+    public:
+        double f_drift[S_BUCKETS][TURN_BUCKETS]; // sum of the variance ratios
+        long long f_n_drift[S_BUCKETS][TURN_BUCKETS]; // free princesses
+        double f_picked[S_BUCKETS][RINGS][TURN_BUCKETS]; // princesses picked up
+        long long f_n_picked[S_BUCKETS][RINGS][TURN_BUCKETS]; // princesses
+
+        PriorStatistics() {
+            for(int s = 0; s < S_BUCKETS; s++) {
+                for(int t = 0; t < TURN_BUCKETS; t++) {
+                    f_drift[s][t] = 0;
+                    f_n_drift[s][t] = 0;
+                    for(int r = 0; r < RINGS; r++) {
+                        f_picked[s][r][t] = 0;
+                        f_n_picked[s][r][t] = 0;
+                    }
+                }
+            }
+        }
+
+        void add_turn(GameBatch &batch, PrincessTracks &tracks);
+        string tables();
+};
+
+
+// After batch.step(), every turn.
+void PriorStatistics::add_turn(GameBatch &batch, PrincessTracks &tracks) {
+
+    int n = batch.f_n_lanes;
+    int t = batch.f_turn;
+    for(int g = 0; g < n; g++) {
+        if (batch.f_active[g] == 0)
+            continue;
+
+        // A princess can be picked up and rescued (-3) in one turn.
+        int P = batch.f_P[g];
+        for(int j = 0; j < P; j++) {
+            int k = j*n + g;
+            int o = batch.f_p_owner[k];
+            if (o >= 0 || o == -3)
+                tracks.f_picked[k] = 1;
+            if (o == -1 && tracks.f_owner[k] >= 0) {
+                tracks.f_x0[k] = batch.f_px[k];
+                tracks.f_y0[k] = batch.f_py[k];
+                tracks.f_t0[k] = t;
+            }
+            tracks.f_owner[k] = o;
+        }
+
+        // Sampled at the last turn of a bucket.
+        int S = batch.f_S[g];
+        int tb = 4*t/S;
+        if (tb >= TURN_BUCKETS || 4*(t + 1)/S == tb)
+            continue;
+
+        int sb = s_bucket(S);
+        for(int j = 0; j < P; j++) {
+            int k = j*n + g;
+            f_picked[sb][(int)tracks.f_ring[k]][tb] += tracks.f_picked[k];
+            f_n_picked[sb][(int)tracks.f_ring[k]][tb]++;
+            if (batch.f_p_owner[k] != -1 || tracks.f_t0[k] == t)
+                continue;
+
+            double dx = batch.f_px[k] - tracks.f_x0[k];
+            double dy = batch.f_py[k] - tracks.f_y0[k];
+            f_drift[sb][tb] += (dx*dx + dy*dy)/(t - tracks.f_t0[k]);
+            f_n_drift[sb][tb]++;
+        }
+    }
+}
+
+
+// One row of a table, the means of sum/count.
+void write_row(ostringstream &out, const double *sum, const long long *count, const char *indent) {
+
+    out << "{";
+    double last = 0;
+    for(int t = 0; t < TURN_BUCKETS; t++) {
+        if (count[t] > 0)
+            last = sum[t]/count[t];
+
+        char value[32];
+        snprintf(value, sizeof(value), "%.4ff", last);
+        out << value;
+        if (t < TURN_BUCKETS - 1)
+            out << (t % 8 == 7 ? ",\n" + string(indent) + " " : string(", "));
+    }
+    out << "}";
+}
+
+
+string PriorStatistics::tables() {
+
+    ostringstream out;
+    out << BEGIN_LINE << "\n";
+    out << "const int PRIOR_S_BUCKETS = " << S_BUCKETS << ";\n";
+    out << "const int PRIOR_TURN_BUCKETS = " << TURN_BUCKETS << ";\n";
+    out << "const int PRIOR_RINGS = " << RINGS << ";\n";
+
+    out << "constexpr float PRIOR_DRIFT[PRIOR_S_BUCKETS][PRIOR_TURN_BUCKETS] = {\n";
+    for(int s = 0; s < S_BUCKETS; s++) {
+        out << "    ";
+        write_row(out, f_drift[s], f_n_drift[s], "    ");
+        out << ",\n";
+    }
+    out << "};\n";
+
+    out << "constexpr float PRIOR_PICKED[PRIOR_S_BUCKETS][PRIOR_RINGS][PRIOR_TURN_BUCKETS] = {\n";
+    for(int s = 0; s < S_BUCKETS; s++) {
+        for(int r = 0; r < RINGS; r++) {
+            out << (r == 0 ? "    {" : "     ");
+            write_row(out, f_picked[s][r], f_n_picked[s][r], "     ");
+            out << (r < RINGS - 1 ? ",\n" : "},\n");
+        }
+    }
+    out << "};\n";
+
+    out << END_LINE << "\n";
+    return out.str();
+}
+
+
+// Replaces the lines from BEGIN_LINE to END_LINE of path.
+bool write_tables(const string &path, const string &tables) {
+
+    ifstream in(path.c_str());
+    if (!in)
+        return false;
+
+    ostringstream out;
+    string line;
+    int state = 0; // 0 before, 1 inside, 2 after the tables
+    while (getline(in, line)) {
+        if (state == 0 && line == BEGIN_LINE) {
+            out << tables;
+            state = 1;
+        } else if (state == 1) {
+            if (line == END_LINE)
+                state = 2;
+        } else {
+            out << line << "\n";
+        }
+    }
+    in.close();
+    if (state != 2)
+        return false;
+
+    string tmp = path + ".tmp";
+    ofstream f(tmp.c_str());
+    f << out.str();
+    f.close();
+    return !f.fail() && rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+
+int main(int argc, char **argv) {
+
+    vector<string> args;
+    int batch_size = 64;
+    string source;
+    for(int i = 1; i < argc; i++) {
+        string a = argv[i];
+        if (a == "-b" && i + 1 < argc)
+            batch_size = max(1, atoi(argv[++i]));
+        else if (a == "-w" && i + 1 < argc)
+            source = argv[++i];
+        else
+            args.push_back(a);
+    }
+
+    if (args.empty() == true) {
+        fprintf(stderr, "Usage: %s <corpus> [first] [n_games] [-b batch_size] [-w source]\n", argv[0]);
+        return 1;
+    }
+
+    ScenarioCorpus corpus;
+    if (corpus.open(args[0]) == false) {
+        fprintf(stderr, "Cannot open %s\n", args[0].c_str());
+        return 1;
+    }
+
+    int first = args.size() > 1 ? atoi(args[1].c_str()) : 0;
+    int n_games = args.size() > 2 ? atoi(args[2].c_str()) : corpus.size() - first;
+    n_games = max(0, min(n_games, corpus.size() - first));
+
+    vector<int> order(n_games);
+    for(int k = 0; k < n_games; k++)
+        order[k] = first + k;
+    stable_sort(order.begin(), order.end(), [&] (int a, int b) {return corpus.scenario(a).S < corpus.scenario(b).S;});
+
+    PriorStatistics statistics;
+    for(int b0 = 0; b0 < n_games; b0 += batch_size) {
+
+        int n = min(batch_size, n_games - b0);
+        int max_K = 0, max_P = 0, max_M = 0;
+        for(int g = 0; g < n; g++) {
+            Scenario s = corpus.scenario(order[b0 + g]);
+            max_K = max(max_K, s.K);
+            max_P = max(max_P, s.n_princess_values/2);
+            max_M = max(max_M, s.n_monster_values/2);
+        }
+
+        GameBatch batch(n, max_K, max_P, max_M);
+        vector<unique_ptr<PrincessesAndMonstersSolver>> solvers(n);
+        for(int g = 0; g < n; g++) {
+            Scenario s = corpus.scenario(order[b0 + g]);
+            solvers[g].reset(new PrincessesAndMonstersSolver());
+            solvers[g]->set_seed((unsigned)s.seed);
+
+            string entrances(s.K, '0');
+            solvers[g]->initialize(s.S, s.princesses, s.n_princess_values, s.monsters, s.n_monster_values, s.K, &entrances[0]);
+            batch.add_game(g, s.S, s.princesses, s.n_princess_values, s.monsters, s.n_monster_values, s.K, entrances.c_str(), s.seed);
+        }
+
+        PrincessTracks tracks(batch);
+
+        vector<int> status(max_K);
+        string moves(max_K, 'X');
+        while (batch.number_of_active_games() > 0) {
+            for(int g = 0; g < n; g++) {
+                if (batch.f_active[g] == 0)
+                    continue;
+
+                int P, M;
+                batch.status(g, status.data(), P, M);
+                solvers[g]->move(status.data(), P, M, 10000, &moves[0]);
+                batch.set_moves(g, moves.c_str());
+            }
+
+            batch.step();
+            statistics.add_turn(batch, tracks);
+        }
+
+        fprintf(stderr, "%d/%d games\r", b0 + n, n_games);
+    }
+    fprintf(stderr, "\n");
+
+    string tables = statistics.tables();
+    if (source.empty() == true) {
+        printf("%s", tables.c_str());
+    } else if (write_tables(source, tables) == false) {
+        fprintf(stderr, "Cannot replace the tables in %s\n", source.c_str());
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,146 @@
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <algorithm>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "PrincessesAndMonsters.h"
+
+using namespace std;
+
+// Drives the solver on boards and armies far beyond the contest
+// limits and reports the per-turn latency and the peak memory:
+//
+//     StressBenchmark [turns] [-t threads]            the built in grid of S and K
+//     StressBenchmark <S> <K> [turns] [-t threads]    one configuration
+//
+// The game is not simulated, the judge's replies are made up in three
+// phases of turns each:
+//
+//     play      nobody picks up a princess: the approach to the
+//               assembly point and, once the army got there, the search
+//     pickups   every turn another knight reports a princess, until all
+//               P are escorted: convoys and the return to the assembly
+//     return    all princesses rescued and all monsters gone (P = M = 0):
+//               the final return and the walk to the exits
+//
+// No knight dies. Each phase gets its own latency line. Every
+// configuration runs in its own process, ru_maxrss only grows. The
+// solver is seeded, the digest of all moves must not depend on the
+// number of threads (set_threads).
+//
+// Build:
+//     make StressBenchmark
+
+
+void run_configuration(int S, int K, int n_turns, int n_threads) {
+
+    mt19937 gen(S*1000003 + K);
+    uniform_int_distribution<int> cell(0, S - 1);
+
+    int P = S;
+    int M = S;
+    vector<int> princesses(2*P);
+    vector<int> monsters(2*M);
+    for(int i = 0; i < 2*P; i++)
+        princesses[i] = cell(gen);
+    for(int i = 0; i < 2*M; i++)
+        monsters[i] = cell(gen);
+
+    auto t0 = chrono::steady_clock::now();
+
+    PrincessesAndMonstersSolver solver;
+    solver.set_seed(S*1000003 + K);
+    solver.set_threads(n_threads);
+    string entrances(K, '0');
+    solver.initialize(S, princesses.data(), princesses.size(), monsters.data(), monsters.size(), K, &entrances[0]);
+
+    double init_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+
+    vector<int> status(K, 0);
+    string moves(K, 'X');
+    uint64_t digest = 14695981039346656037ULL;
+    int n_picked = 0;
+    const char *phases[3] = {"play", "pickups", "return"};
+
+    for(int phase = 0; phase < 3; phase++) {
+
+        if (phase == 2) {
+            fill(status.begin(), status.end(), 0);
+            P = 0;
+            M = 0;
+        }
+
+        double total_us = 0;
+        double max_us = 0;
+        for(int t = 0; t < n_turns; t++) {
+            if (phase == 1 && n_picked < P) {
+                status[(uint64_t)n_picked*2654435761ULL % K]++;
+                n_picked++;
+            }
+
+            auto t1 = chrono::steady_clock::now();
+            solver.move(status.data(), P, M, 10000, &moves[0]);
+            double us = chrono::duration<double, micro>(chrono::steady_clock::now() - t1).count();
+
+            total_us = total_us + us;
+            max_us = max(max_us, us);
+            for(int i = 0; i < K; i++)
+                digest = (digest ^ (unsigned char)moves[i])*1099511628211ULL;
+        }
+
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+
+        printf("S=%5d K=%6d %-7s init=%9.2f ms turn mean=%10.1f us max=%10.1f us peak RSS=%8.1f MB moves=%016llx\n",
+               S, K, phases[phase], init_ms, total_us/n_turns, max_us, usage.ru_maxrss/1024.0, (unsigned long long)digest);
+        fflush(stdout);
+    }
+}
+
+
+int main(int argc, char **argv) {
+
+    vector<string> args;
+    int n_threads = 1;
+    for(int i = 1; i < argc; i++) {
+        string a = argv[i];
+        if (a == "-t" && i + 1 < argc)
+            n_threads = max(1, atoi(argv[++i]));
+        else
+            args.push_back(a);
+    }
+
+    if (args.size() >= 2) {
+        int n_turns = args.size() > 2 ? atoi(args[2].c_str()) : 200;
+        run_configuration(atoi(args[0].c_str()), atoi(args[1].c_str()), n_turns, n_threads);
+        return 0;
+    }
+
+    int n_turns = args.size() > 0 ? atoi(args[0].c_str()) : 200;
+    vector<int> sizes = {50, 200, 500, 1000, 2000};
+    vector<int> armies = {100, 1000, 10000, 100000};
+
+    for(int S : sizes) {
+        for(int K : armies) {
+            pid_t pid = fork();
+            if (pid == 0) {
+                run_configuration(S, K, n_turns, n_threads);
+                _exit(0);
+            }
+
+            int status;
+            waitpid(pid, &status, 0);
+            if (WIFEXITED(status) == false || WEXITSTATUS(status) != 0)
+                printf("S=%5d K=%6d failed\n", S, K);
+        }
+    }
+
+    return 0;
+}
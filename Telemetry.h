@@ -0,0 +1,359 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Telemetry stream of one game, one frame every few turns, written by
+// PrincessesAndMonsters::encode_frame and, for the visited grid,
+// finish_telemetry_frame. Native byte order:
+//
+//     char magic[4] = "PAMT", uint32_t version
+//     frames:
+//         uint32_t size                      of the frame, this field included
+//         int32_t turn, S, K, P, M
+//         int32_t assembly_x, assembly_y
+//         uint8_t global_order, n_grids, uint16_t reserved
+//         K x {uint16_t x, uint16_t y, int8_t n_p, uint8_t order}
+//         n_grids x {uint8_t kind, uint8_t reserved, uint16_t side,
+//                    float largest, uint8_t values[side*side]}
+//
+// Orders are numbered as order_names in the solver, n_p is -1 for a
+// dead knight. Grid values are scaled so 255 is largest, the grid
+// covers the whole board row by row. Kinds: 0 expected princesses on
+// the board, 1 share of the cells visited by the search.
+
+
+const char TELEMETRY_MAGIC[4] = {'P', 'A', 'M', 'T'};
+const uint32_t TELEMETRY_VERSION = 1;
+
+
+// --------------------------------------------
+// -----------  Telemetry Writer  -------------
+// --------------------------------------------
+
+
+// A frame as the solver hands it over: everything but the grid of
+// visited cells, which the writer adds from the visited rows (S rows of
+// (S + 63)/64 words, bit x of a row is bit x%64 of word x/64).
+struct TelemetryRecord {
+    std::string frame;
+    int S;
+    std::vector<uint64_t> visited;
+};
+
+
+// Appends frames to a file from a thread of its own. The solver pays for
+// the knights and a copy of the visited words, which write() swaps into
+// the queue for buffers of frames already written. The thread encodes
+// the visited grid. With CAPACITY frames queued the frame is dropped,
+// close() reports how many were.
+class TelemetryWriter {
+    public:
+        static const size_t CAPACITY = 32; // frames
+
+        FILE *f_file;
+        std::deque<TelemetryRecord> f_queue;
+        std::vector<TelemetryRecord> f_spare; // buffers of written frames
+        uint64_t f_dropped;
+        std::mutex f_mutex;
+        std::condition_variable f_ready;
+        bool f_stop;
+        std::thread f_thread;
+
+        TelemetryWriter(): f_file(nullptr), f_dropped(0), f_stop(false) {}
+        ~TelemetryWriter() {close();}
+
+        bool open(const std::string &path);
+        void write(std::string &frame, int S, std::vector<uint64_t> &visited);
+        void close();
+
+    private:
+        void run();
+
+        TelemetryWriter(const TelemetryWriter &);
+        TelemetryWriter &operator=(const TelemetryWriter &);
+};
+
+
+inline bool TelemetryWriter::open(const std::string &path) {
+
+    close();
+
+    f_file = fopen(path.c_str(), "wb");
+    if (f_file == nullptr)
+        return false;
+
+    fwrite(TELEMETRY_MAGIC, 1, 4, f_file);
+    fwrite(&TELEMETRY_VERSION, sizeof(TELEMETRY_VERSION), 1, f_file);
+
+    f_dropped = 0;
+    f_stop = false;
+    f_thread = std::thread(&TelemetryWriter::run, this);
+    return true;
+}
+
+
+// Takes frame and visited, leaving buffers of an older frame in their
+// place.
+inline void TelemetryWriter::write(std::string &frame, int S, std::vector<uint64_t> &visited) {
+
+    std::lock_guard<std::mutex> lock(f_mutex);
+    if (f_queue.size() >= CAPACITY) {
+        f_dropped++;
+        return;
+    }
+
+    f_queue.emplace_back();
+    TelemetryRecord &record = f_queue.back();
+    if (f_spare.empty() == false) {
+        record.frame.swap(f_spare.back().frame);
+        record.visited.swap(f_spare.back().visited);
+        f_spare.pop_back();
+    }
+    record.frame.swap(frame);
+    record.S = S;
+    record.visited.swap(visited);
+    f_ready.notify_one();
+}
+
+
+// Writes what is queued and closes the file.
+inline void TelemetryWriter::close() {
+
+    if (f_file == nullptr)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(f_mutex);
+        f_stop = true;
+        f_ready.notify_one();
+    }
+    f_thread.join();
+
+    if (f_dropped > 0)
+        fprintf(stderr, "Telemetry: %llu frames dropped on a full queue\n", (unsigned long long)f_dropped);
+
+    fclose(f_file);
+    f_file = nullptr;
+}
+
+
+template<class T> void append_telemetry_value(std::string &s, T value) {
+    s.append((const char*)&value, sizeof(T));
+}
+
+
+// Appends grid 1, the share of visited cells in blocks of at most
+// 64 x 64, and fills in the size of the frame.
+inline void finish_telemetry_frame(TelemetryRecord &record) {
+
+    int S = record.S;
+    int W = (S + 63)/64;
+    int side = std::min(S, 64);
+    int block = (S + side - 1)/side;
+    side = (S + block - 1)/block;
+
+    // Visited cells per block, a block row of the board at a time.
+    std::vector<int> count(side*side, 0);
+    for(int y = 0; y < S; y++) {
+        const uint64_t *row = &record.visited[y*W];
+        int *counts = &count[(y/block)*side];
+        for(int bx = 0; bx < side; bx++) {
+            int x0 = bx*block;
+            int x1 = std::min(S, x0 + block);
+            for(int x = x0; x < x1; ) {
+                int n = std::min(x1 - x, 64 - x % 64);
+                uint64_t bits = row[x/64] >> (x % 64);
+                if (n < 64)
+                    bits &= (1ULL << n) - 1;
+                counts[bx] += __builtin_popcountll(bits);
+                x += n;
+            }
+        }
+    }
+
+    int largest = 0;
+    for(int c : count)
+        largest = std::max(largest, c);
+
+    std::string &frame = record.frame;
+    append_telemetry_value<uint8_t>(frame, 1);
+    append_telemetry_value<uint8_t>(frame, 0);
+    append_telemetry_value<uint16_t>(frame, side);
+    append_telemetry_value<float>(frame, largest/double(block*block));
+    for(int c : count)
+        append_telemetry_value<uint8_t>(frame, largest > 0 ? uint8_t(255.0*c/largest + 0.5) : 0);
+
+    uint32_t size = frame.size();
+    memcpy(&frame[0], &size, sizeof(size));
+}
+
+
+inline void TelemetryWriter::run() {
+
+    std::deque<TelemetryRecord> records;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(f_mutex);
+            while (records.empty() == false) {
+                f_spare.push_back(std::move(records.front()));
+                records.pop_front();
+            }
+            f_ready.wait(lock, [this] {return f_stop == true || f_queue.empty() == false;});
+            if (f_queue.empty() == true && f_stop == true)
+                return;
+            records.swap(f_queue);
+        }
+
+        for(TelemetryRecord &record : records) {
+            finish_telemetry_frame(record);
+            fwrite(record.frame.data(), 1, record.frame.size(), f_file);
+        }
+    }
+}
+
+
+// --------------------------------------------
+// -----------  Telemetry Reader  -------------
+// --------------------------------------------
+
+
+struct TelemetryKnight {
+    int x;
+    int y;
+    int n_p;
+    int order;
+};
+
+
+struct TelemetryGrid {
+    int kind;
+    int side;
+    float largest;
+    std::vector<uint8_t> values;
+};
+
+
+struct TelemetryFrame {
+    int turn;
+    int S;
+    int K;
+    int P;
+    int M;
+    int assembly_x;
+    int assembly_y;
+    int global_order;
+    std::vector<TelemetryKnight> knights;
+    std::vector<TelemetryGrid> grids;
+};
+
+
+class TelemetryReader {
+    public:
+        FILE *f_file;
+
+        TelemetryReader(): f_file(nullptr) {}
+        ~TelemetryReader() {if (f_file != nullptr) fclose(f_file);}
+
+        bool open(const std::string &path);
+        bool next(TelemetryFrame &frame);
+
+    private:
+        TelemetryReader(const TelemetryReader &);
+        TelemetryReader &operator=(const TelemetryReader &);
+};
+
+
+inline bool TelemetryReader::open(const std::string &path) {
+
+    f_file = fopen(path.c_str(), "rb");
+    if (f_file == nullptr)
+        return false;
+
+    char magic[4];
+    uint32_t version;
+    if (fread(magic, 1, 4, f_file) != 4 || memcmp(magic, TELEMETRY_MAGIC, 4) != 0 ||
+        fread(&version, sizeof(version), 1, f_file) != 1 || version != TELEMETRY_VERSION) {
+        fprintf(stderr, "%s is not a version %u telemetry stream\n", path.c_str(), TELEMETRY_VERSION);
+        return false;
+    }
+
+    return true;
+}
+
+
+// Returns false at the end of the stream or on a truncated frame.
+inline bool TelemetryReader::next(TelemetryFrame &frame) {
+
+    uint32_t size;
+    if (fread(&size, sizeof(size), 1, f_file) != 1 || size < 36)
+        return false;
+
+    std::string data(size - sizeof(size), '\0');
+    if (fread(&data[0], 1, data.size(), f_file) != data.size())
+        return false;
+
+    const char *p = data.data();
+    const char *end = p + data.size();
+    auto take = [&] (void *value, size_t n) {
+        if (p + n > end)
+            return false;
+        memcpy(value, p, n);
+        p += n;
+        return true;
+    };
+
+    int32_t header[7];
+    uint8_t global_order, n_grids;
+    uint16_t reserved;
+    if (take(header, sizeof(header)) == false || take(&global_order, 1) == false ||
+        take(&n_grids, 1) == false || take(&reserved, 2) == false)
+        return false;
+
+    frame.turn = header[0];
+    frame.S = header[1];
+    frame.K = header[2];
+    frame.P = header[3];
+    frame.M = header[4];
+    frame.assembly_x = header[5];
+    frame.assembly_y = header[6];
+    frame.global_order = global_order;
+
+    frame.knights.resize(frame.K);
+    for(TelemetryKnight &k : frame.knights) {
+        uint16_t x, y;
+        int8_t n_p;
+        uint8_t order;
+        if (take(&x, 2) == false || take(&y, 2) == false || take(&n_p, 1) == false || take(&order, 1) == false)
+            return false;
+        k.x = x;
+        k.y = y;
+        k.n_p = n_p;
+        k.order = order;
+    }
+
+    frame.grids.resize(n_grids);
+    for(TelemetryGrid &g : frame.grids) {
+        uint8_t kind, pad;
+        uint16_t side;
+        if (take(&kind, 1) == false || take(&pad, 1) == false || take(&side, 2) == false || take(&g.largest, 4) == false)
+            return false;
+        g.kind = kind;
+        g.side = side;
+        g.values.resize(side*side);
+        if (take(g.values.data(), g.values.size()) == false)
+            return false;
+    }
+
+    return true;
+}
+
+#endif
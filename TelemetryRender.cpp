@@ -0,0 +1,156 @@
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "Telemetry.h"
+
+using namespace std;
+
+// Renders the frames of a telemetry stream (Telemetry.h) to PPM images:
+//
+//     TelemetryRender <stream> <prefix> [first_turn] [last_turn]
+//
+// writes <prefix>_<turn>.ppm for every frame in the range. The board is
+// dark where the search has not been, the green channel shows the
+// expected princesses. Knights are drawn in the colour of their order,
+// escorts in yellow and dead knights in dark red; the white cross is
+// the assembly point.
+//
+// Build:
+//     g++ -O2 -o TelemetryRender TelemetryRender.cpp
+
+
+struct Color {
+    unsigned char r, g, b;
+};
+
+
+// Indexed as order_names in the solver.
+const Color order_colors[] = {
+    {120, 120, 255}, // move to princess center of mass
+    {0, 200, 255},   // initially dispersed
+    {255, 255, 255}, // random princess search
+    {255, 160, 0},   // return to global assembly point
+    {255, 0, 255},   // guard convoy
+    {255, 120, 120}, // final return
+    {255, 0, 0},     // kill monsters
+    {0, 255, 0},     // go to exit
+    {128, 128, 128}, // do nothing
+};
+
+
+class Image {
+    public:
+        int f_w;
+        int f_h;
+        vector<Color> f_pixels;
+
+        Image(int w, int h): f_w(w), f_h(h), f_pixels(w*h, Color{0, 0, 0}) {}
+
+        void fill(int x0, int y0, int w, int h, Color c) {
+            for(int y = max(0, y0); y < min(f_h, y0 + h); y++)
+                for(int x = max(0, x0); x < min(f_w, x0 + w); x++)
+                    f_pixels[y*f_w + x] = c;
+        }
+
+        bool save(const string &path) {
+            FILE *f = fopen(path.c_str(), "wb");
+            if (f == nullptr)
+                return false;
+            fprintf(f, "P6\n%d %d\n255\n", f_w, f_h);
+            fwrite(f_pixels.data(), sizeof(Color), f_pixels.size(), f);
+            return fclose(f) == 0;
+        }
+};
+
+
+// Value of a grid at board cell (x, y).
+int grid_value(const TelemetryGrid &g, int S, int x, int y) {
+    int gx = min(g.side - 1, x*g.side/S);
+    int gy = min(g.side - 1, y*g.side/S);
+    return g.values[gy*g.side + gx];
+}
+
+
+void render(const TelemetryFrame &frame, Image &image, int cell) {
+
+    const TelemetryGrid *princesses = nullptr;
+    const TelemetryGrid *visited = nullptr;
+    for(const TelemetryGrid &g : frame.grids) {
+        if (g.kind == 0 && g.side > 0)
+            princesses = &g;
+        else if (g.kind == 1 && g.side > 0)
+            visited = &g;
+    }
+
+    for(int y = 0; y < frame.S; y++) {
+        for(int x = 0; x < frame.S; x++) {
+            int v = visited != nullptr ? grid_value(*visited, frame.S, x, y) : 0;
+            int p = princesses != nullptr ? grid_value(*princesses, frame.S, x, y) : 0;
+            unsigned char base = 20 + v/4;
+            image.fill(x*cell, y*cell, cell, cell, Color{base, (unsigned char)max<int>(base, p*3/4), base});
+        }
+    }
+
+    for(const TelemetryKnight &k : frame.knights) {
+        Color c = {128, 128, 128};
+        if (k.n_p < 0)
+            c = Color{110, 0, 0};
+        else if (k.n_p > 0)
+            c = Color{255, 255, 0};
+        else if (k.order < (int)(sizeof(order_colors)/sizeof(order_colors[0])))
+            c = order_colors[k.order];
+
+        int pad = cell >= 4 ? 1 : 0;
+        image.fill(k.x*cell + pad, k.y*cell + pad, cell - 2*pad, cell - 2*pad, c);
+    }
+
+    int ax = frame.assembly_x*cell + cell/2;
+    int ay = frame.assembly_y*cell + cell/2;
+    image.fill(ax - 2*cell, ay, 4*cell + 1, 1, Color{255, 255, 255});
+    image.fill(ax, ay - 2*cell, 1, 4*cell + 1, Color{255, 255, 255});
+}
+
+
+int main(int argc, char **argv) {
+
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s <stream> <prefix> [first_turn] [last_turn]\n", argv[0]);
+        return 1;
+    }
+
+    string prefix = argv[2];
+    int first = argc > 3 ? atoi(argv[3]) : 0;
+    int last = argc > 4 ? atoi(argv[4]) : 2147483647;
+
+    TelemetryReader reader;
+    if (reader.open(argv[1]) == false) {
+        fprintf(stderr, "Cannot open %s\n", argv[1]);
+        return 1;
+    }
+
+    TelemetryFrame frame;
+    int n_images = 0;
+    while (reader.next(frame) == true) {
+        if (frame.turn < first || frame.turn > last || frame.S <= 0)
+            continue;
+
+        // At most about 1024 pixels a side.
+        int cell = max(1, min(16, 1024/frame.S));
+        Image image(frame.S*cell, frame.S*cell);
+        render(frame, image, cell);
+
+        char name[32];
+        snprintf(name, sizeof(name), "_%06d.ppm", frame.turn);
+        if (image.save(prefix + name) == false) {
+            fprintf(stderr, "Cannot write %s%s\n", prefix.c_str(), name);
+            return 1;
+        }
+        n_images++;
+    }
+
+    printf("%d images\n", n_images);
+    return 0;
+}
@@ -0,0 +1,626 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <cerrno>
+#include <ctime>
+#include <string>
+#include <vector>
+#include <random>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <unistd.h>
+#include <fcntl.h>
+#include <utime.h>
+#include <sys/stat.h>
+
+#include "PrincessesAndMonsters.h"
+#include "ScenarioCorpus.h"
+#include "PairedGames.h"
+
+using namespace std;
+
+// Tunes constants of the solver (set_parameter) on a corpus with many
+// workers that share nothing but a directory:
+//
+//     TuningCampaign init <dir> <corpus> [-s shards] [-g games] [-i iterations] [-r seed]
+//     TuningCampaign work <dir> [-t threads] [-c checkpoint_seconds] [-x stale_seconds]
+//     TuningCampaign status <dir>
+//
+// Every shard is an independent (1+1) evolution strategy: an iteration
+// plays a perturbed candidate against the incumbent on the same games
+// and keeps the candidate if its mean score is higher, the step grows
+// on success and shrinks on failure (1/5 rule). Shard 0 starts from the
+// solver's defaults, the others from random points. The games of an
+// iteration are fresh scenarios of the corpus and the perturbations are
+// drawn from (seed, shard, iteration) alone, so a shard always makes the
+// same decisions, however often it was interrupted.
+//
+// Files in <dir>:
+//     campaign         settings written by init
+//     shard_<k>.state  optimizer state, the games done in the current
+//                      iteration and the history, replaced atomically
+//                      (write and rename) every checkpoint_seconds and
+//                      after every iteration
+//     shard_<k>.lock   owner of a running shard, created exclusively
+//                      and touched at every checkpoint
+//     shard_<k>.failed owner and reason of a shard that could not play
+//                      a game or save its state, skipped by every
+//                      worker until removed
+//
+// work runs unfinished shards, threads at a time, until none is left
+// that it can claim, and exits with an error if one of its shards
+// failed. A lock not touched for stale_seconds belongs to a
+// dead worker and is taken over; should two workers ever run the same
+// shard they compute the same states. Start work on as many machines
+// as share the directory, and again after a crash to resume.
+//
+// Build:
+//     make TuningCampaign
+
+
+// Parameters tuned, between lo and hi, the optimizer works on [0, 1].
+// The starts are the defaults of Parameters in the solver.
+struct TunedParameter {
+    const char *name;
+    double lo;
+    double hi;
+    double start;
+};
+
+const TunedParameter tuned_parameters[] = {
+    {"disperse_fraction", 0.3, 1.0, 0.9},
+    {"initial_disperse_fraction", 0.0, 1.0, 0.5},
+    {"large_board", 10, 50, 40},
+    {"stay_probability", 0.0, 0.3, 0.05},
+};
+const int N_TUNED = sizeof(tuned_parameters)/sizeof(tuned_parameters[0]);
+
+const double INITIAL_SIGMA = 0.2;
+
+
+double parameter_value(int j, double x) {
+    return tuned_parameters[j].lo + x*(tuned_parameters[j].hi - tuned_parameters[j].lo);
+}
+
+
+// Generator of shard k at iteration i, -1 for the start.
+mt19937_64 shard_generator(uint64_t seed, int k, int i) {
+    seed_seq seq = {uint32_t(seed), uint32_t(seed >> 32), uint32_t(k), uint32_t(i + 1)};
+    return mt19937_64(seq);
+}
+
+
+// --------------------------------------------
+// --------------  Campaign  ------------------
+// --------------------------------------------
+
+
+class Campaign {
+    public:
+        string f_dir;
+        string f_corpus;
+        int f_shards;
+        int f_games; // per iteration
+        int f_iterations;
+        uint64_t f_seed;
+
+        Campaign(): f_shards(8), f_games(200), f_iterations(50), f_seed(1) {}
+
+        bool load(const string &dir);
+        bool save();
+
+        string path(int k, const char *suffix) const {return f_dir + "/shard_" + to_string(k) + suffix;}
+};
+
+
+bool Campaign::load(const string &dir) {
+
+    f_dir = dir;
+    FILE *f = fopen((dir + "/campaign").c_str(), "r");
+    if (f == nullptr)
+        return false;
+
+    char corpus[4096];
+    unsigned long long seed;
+    bool ok = fscanf(f, "corpus %4095s shards %d games %d iterations %d seed %llu",
+                     corpus, &f_shards, &f_games, &f_iterations, &seed) == 5;
+    fclose(f);
+
+    f_corpus = corpus;
+    f_seed = seed;
+    return ok;
+}
+
+
+bool Campaign::save() {
+
+    FILE *f = fopen((f_dir + "/campaign").c_str(), "w");
+    if (f == nullptr)
+        return false;
+
+    fprintf(f, "corpus %s\nshards %d\ngames %d\niterations %d\nseed %llu\n",
+            f_corpus.c_str(), f_shards, f_games, f_iterations, (unsigned long long)f_seed);
+    return fclose(f) == 0;
+}
+
+
+// --------------------------------------------
+// -------------  Shard State  ----------------
+// --------------------------------------------
+
+
+class ShardState {
+    public:
+        int f_iteration;
+        double f_sigma;
+        double f_x[N_TUNED]; // incumbent
+        int f_games; // played in the current iteration
+        double f_sum_diff; // of candidate - incumbent scores
+        double f_sum_diff2;
+        vector<string> f_history; // one line per iteration
+
+        void start(const Campaign &c, int k);
+        bool load(const string &path);
+        bool save(const string &path, const string &owner) const;
+
+        void candidate(const Campaign &c, int k, double *x) const;
+        void end_iteration(const Campaign &c, int k);
+};
+
+
+void ShardState::start(const Campaign &c, int k) {
+
+    f_iteration = 0;
+    f_sigma = INITIAL_SIGMA;
+    f_games = 0;
+    f_sum_diff = 0;
+    f_sum_diff2 = 0;
+    f_history.clear();
+
+    mt19937_64 gen = shard_generator(c.f_seed, k, -1);
+    uniform_real_distribution<double> uniform(0.0, 1.0);
+    for(int j = 0; j < N_TUNED; j++) {
+        const TunedParameter &p = tuned_parameters[j];
+        f_x[j] = k == 0 ? (p.start - p.lo)/(p.hi - p.lo) : uniform(gen);
+    }
+}
+
+
+bool ShardState::load(const string &path) {
+
+    FILE *f = fopen(path.c_str(), "r");
+    if (f == nullptr)
+        return false;
+
+    bool ok = fscanf(f, "iteration %d sigma %lf x", &f_iteration, &f_sigma) == 2;
+    for(int j = 0; j < N_TUNED && ok == true; j++)
+        ok = fscanf(f, "%lf", &f_x[j]) == 1;
+    ok = ok && fscanf(f, " games %d sum_diff %lf sum_diff2 %lf", &f_games, &f_sum_diff, &f_sum_diff2) == 3;
+
+    f_history.clear();
+    char line[1024];
+    while (ok == true && fgets(line, sizeof(line), f) != nullptr) {
+        if (strncmp(line, "history ", 8) == 0)
+            f_history.push_back(string(line + 8, strcspn(line + 8, "\n")));
+    }
+
+    fclose(f);
+    return ok;
+}
+
+
+// Written next to path and renamed over it, so a crash leaves either
+// the old or the new state. The temporary file is named after the
+// owner (host, process and thread), workers on other machines sharing
+// the directory can have the same process id.
+bool ShardState::save(const string &path, const string &owner) const {
+
+    string tmp = path + ".tmp." + owner;
+    FILE *f = fopen(tmp.c_str(), "w");
+    if (f == nullptr)
+        return false;
+
+    fprintf(f, "iteration %d\nsigma %.17g\nx", f_iteration, f_sigma);
+    for(int j = 0; j < N_TUNED; j++)
+        fprintf(f, " %.17g", f_x[j]);
+    fprintf(f, "\ngames %d\nsum_diff %.17g\nsum_diff2 %.17g\n", f_games, f_sum_diff, f_sum_diff2);
+    for(const string &h : f_history)
+        fprintf(f, "history %s\n", h.c_str());
+
+    bool ok = fflush(f) == 0 && fsync(fileno(f)) == 0;
+    ok = fclose(f) == 0 && ok;
+    if (ok == true && rename(tmp.c_str(), path.c_str()) == 0)
+        return true;
+
+    unlink(tmp.c_str());
+    return false;
+}
+
+
+// Incumbent plus a normal step of f_sigma, clamped to [0, 1].
+void ShardState::candidate(const Campaign &c, int k, double *x) const {
+
+    mt19937_64 gen = shard_generator(c.f_seed, k, f_iteration);
+    normal_distribution<double> normal(0.0, 1.0);
+    for(int j = 0; j < N_TUNED; j++)
+        x[j] = min(1.0, max(0.0, f_x[j] + f_sigma*normal(gen)));
+}
+
+
+void ShardState::end_iteration(const Campaign &c, int k) {
+
+    double mean = f_sum_diff/c.f_games;
+    double var = c.f_games > 1 ? max(0.0, (f_sum_diff2 - c.f_games*mean*mean)/(c.f_games - 1)) : 0.0;
+    bool accepted = mean > 0;
+
+    double x[N_TUNED];
+    candidate(c, k, x);
+    if (accepted == true)
+        copy(x, x + N_TUNED, f_x);
+
+    // Steady at one success in five.
+    f_sigma = min(0.5, max(0.01, accepted == true ? f_sigma*1.5 : f_sigma*pow(1.5, -0.25)));
+
+    char line[512];
+    int n = snprintf(line, sizeof(line), "%d %+.4f %.4f %d", f_iteration, mean, sqrt(var/c.f_games), accepted ? 1 : 0);
+    for(int j = 0; j < N_TUNED; j++)
+        n += snprintf(line + n, sizeof(line) - n, " %.4g", parameter_value(j, x[j]));
+    f_history.push_back(line);
+
+    f_iteration++;
+    f_games = 0;
+    f_sum_diff = 0;
+    f_sum_diff2 = 0;
+}
+
+
+// --------------------------------------------
+// ---------------  Locks  --------------------
+// --------------------------------------------
+
+
+bool read_file(const string &path, string &content) {
+
+    FILE *f = fopen(path.c_str(), "r");
+    if (f == nullptr)
+        return false;
+
+    char buffer[256];
+    size_t n = fread(buffer, 1, sizeof(buffer), f);
+    fclose(f);
+    content.assign(buffer, n);
+    return true;
+}
+
+
+// Creates path holding owner, or takes it over if it was not touched
+// for stale_seconds.
+bool claim_lock(const string &path, const string &owner, int stale_seconds) {
+
+    for(int attempt = 0; attempt < 2; attempt++) {
+        int fd = open(path.c_str(), O_CREAT | O_EXCL | O_WRONLY, 0644);
+        if (fd >= 0) {
+            bool ok = write(fd, owner.data(), owner.size()) == (ssize_t)owner.size();
+            close(fd);
+            return ok;
+        }
+
+        struct stat st;
+        if (errno != EEXIST || stat(path.c_str(), &st) != 0 || time(nullptr) - st.st_mtime < stale_seconds)
+            return false;
+        unlink(path.c_str());
+    }
+
+    return false;
+}
+
+
+bool owns_lock(const string &path, const string &owner) {
+    string content;
+    return read_file(path, content) == true && content == owner;
+}
+
+
+// --------------------------------------------
+// ---------------  Workers  ------------------
+// --------------------------------------------
+
+
+class Worker {
+    public:
+        const Campaign &f_campaign;
+        const ScenarioCorpus &f_corpus;
+        string f_owner;
+        int f_checkpoint_seconds;
+        int f_stale_seconds;
+        vector<char> f_failed; // shards this worker gave up on
+
+        Worker(const Campaign &campaign, const ScenarioCorpus &corpus, const string &owner, int checkpoint_seconds, int stale_seconds):
+            f_campaign(campaign), f_corpus(corpus), f_owner(owner), f_checkpoint_seconds(checkpoint_seconds), f_stale_seconds(stale_seconds),
+            f_failed(campaign.f_shards, 0) {}
+
+        void run();
+        bool run_shard(int k);
+        bool fail(int k, const char *reason);
+        bool failed() const {return count(f_failed.begin(), f_failed.end(), 1) > 0;}
+};
+
+
+// Runs shards until none is left to claim.
+void Worker::run() {
+
+    while (true) {
+        bool claimed = false;
+        for(int k = 0; k < f_campaign.f_shards; k++) {
+            struct stat st;
+            if (f_failed[k] != 0 || stat(f_campaign.path(k, ".failed").c_str(), &st) == 0)
+                continue;
+
+            ShardState state;
+            if (state.load(f_campaign.path(k, ".state")) == true && state.f_iteration >= f_campaign.f_iterations)
+                continue;
+
+            string lock = f_campaign.path(k, ".lock");
+            if (claim_lock(lock, f_owner, f_stale_seconds) == false)
+                continue;
+
+            claimed = true;
+            bool completed = run_shard(k);
+            if (owns_lock(lock, f_owner) == true)
+                unlink(lock.c_str());
+            if (completed == true)
+                printf("%s finished shard %d\n", f_owner.c_str(), k);
+        }
+
+        if (claimed == false)
+            return;
+    }
+}
+
+
+// False if the shard was lost to another worker or failed (fail).
+bool Worker::run_shard(int k) {
+
+    const Campaign &c = f_campaign;
+    string state_path = c.path(k, ".state");
+    string lock = c.path(k, ".lock");
+
+    ShardState state;
+    if (state.load(state_path) == false)
+        state.start(c, k);
+
+    LibraryPlayer candidate, incumbent;
+    candidate.f_policy = incumbent.f_policy = "sector_search";
+
+    auto last_checkpoint = chrono::steady_clock::now();
+    while (state.f_iteration < c.f_iterations) {
+
+        double x[N_TUNED];
+        state.candidate(c, k, x);
+        candidate.f_parameters.clear();
+        incumbent.f_parameters.clear();
+        for(int j = 0; j < N_TUNED; j++) {
+            candidate.f_parameters.push_back(make_pair(tuned_parameters[j].name, parameter_value(j, x[j])));
+            incumbent.f_parameters.push_back(make_pair(tuned_parameters[j].name, parameter_value(j, state.f_x[j])));
+        }
+
+        // Fresh scenarios for every shard and iteration, as far as the
+        // corpus goes.
+        uint64_t first = ((uint64_t)k*c.f_iterations + state.f_iteration)*c.f_games;
+        while (state.f_games < c.f_games) {
+            double score_candidate, score_incumbent;
+            int i = (first + state.f_games) % f_corpus.size();
+            if (play_pair(f_corpus.scenario(i), candidate, incumbent, score_candidate, score_incumbent) == false)
+                return fail(k, ("scenario " + to_string(i) + " failed").c_str());
+
+            double d = score_candidate - score_incumbent;
+            state.f_sum_diff += d;
+            state.f_sum_diff2 += d*d;
+            state.f_games++;
+
+            if (chrono::steady_clock::now() - last_checkpoint > chrono::seconds(f_checkpoint_seconds)) {
+                if (owns_lock(lock, f_owner) == false)
+                    return false;
+                if (state.save(state_path, f_owner) == false)
+                    return fail(k, "cannot save the state");
+                utime(lock.c_str(), nullptr);
+                last_checkpoint = chrono::steady_clock::now();
+            }
+        }
+
+        state.end_iteration(c, k);
+        if (owns_lock(lock, f_owner) == false)
+            return false;
+        if (state.save(state_path, f_owner) == false)
+            return fail(k, "cannot save the state");
+        utime(lock.c_str(), nullptr);
+        last_checkpoint = chrono::steady_clock::now();
+
+        printf("shard %d: %s\n", k, state.f_history.back().c_str());
+        fflush(stdout);
+    }
+
+    return true;
+}
+
+
+// Marks shard k failed, for this worker and in the directory for the
+// others. Always false.
+bool Worker::fail(int k, const char *reason) {
+
+    fprintf(stderr, "%s: shard %d failed, %s\n", f_owner.c_str(), k, reason);
+    f_failed[k] = 1;
+
+    FILE *f = fopen(f_campaign.path(k, ".failed").c_str(), "w");
+    if (f != nullptr) {
+        fprintf(f, "%s %s\n", f_owner.c_str(), reason);
+        fclose(f);
+    }
+
+    return false;
+}
+
+
+// --------------------------------------------
+// --------------  Commands  ------------------
+// --------------------------------------------
+
+
+int init(const string &dir, const string &corpus_path, Campaign &c) {
+
+    ScenarioCorpus corpus;
+    if (corpus.open(corpus_path) == false || corpus.size() == 0) {
+        fprintf(stderr, "Cannot open %s\n", corpus_path.c_str());
+        return 1;
+    }
+
+    if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "Cannot create %s\n", dir.c_str());
+        return 1;
+    }
+
+    Campaign existing;
+    if (existing.load(dir) == true) {
+        fprintf(stderr, "%s already holds a campaign\n", dir.c_str());
+        return 1;
+    }
+
+    // Workers on other machines find the corpus by this path.
+    char *real = realpath(corpus_path.c_str(), nullptr);
+    c.f_corpus = real != nullptr ? real : corpus_path;
+    free(real);
+
+    c.f_dir = dir;
+    if (c.save() == false) {
+        fprintf(stderr, "Cannot write %s/campaign\n", dir.c_str());
+        return 1;
+    }
+
+    if ((long long)c.f_shards*c.f_iterations*c.f_games > corpus.size())
+        printf("The corpus has %d scenarios for %lld games per variant, iterations will share scenarios\n",
+               corpus.size(), (long long)c.f_shards*c.f_iterations*c.f_games);
+    return 0;
+}
+
+
+int work(const Campaign &c, int n_threads, int checkpoint_seconds, int stale_seconds) {
+
+    ScenarioCorpus corpus;
+    if (corpus.open(c.f_corpus) == false || corpus.size() == 0) {
+        fprintf(stderr, "Cannot open %s\n", c.f_corpus.c_str());
+        return 1;
+    }
+
+    char host[256] = "";
+    gethostname(host, sizeof(host) - 1);
+
+    vector<thread> threads;
+    vector<char> failed(n_threads, 0);
+    for(int t = 0; t < n_threads; t++) {
+        string owner = string(host) + ":" + to_string(getpid()) + ":" + to_string(t);
+        threads.push_back(thread([&, owner, t] {
+            Worker worker(c, corpus, owner, checkpoint_seconds, stale_seconds);
+            worker.run();
+            failed[t] = worker.failed();
+        }));
+    }
+    for(thread &t : threads)
+        t.join();
+
+    return count(failed.begin(), failed.end(), 1) > 0 ? 1 : 0;
+}
+
+
+int status(const Campaign &c) {
+
+    printf("corpus %s, %d shards of %d iterations of %d games\n", c.f_corpus.c_str(), c.f_shards, c.f_iterations, c.f_games);
+
+    int n_done = 0;
+    for(int k = 0; k < c.f_shards; k++) {
+        ShardState state;
+        if (state.load(c.path(k, ".state")) == false)
+            state.start(c, k);
+
+        string owner;
+        struct stat st;
+        string failure;
+        if (read_file(c.path(k, ".lock"), owner) == true && stat(c.path(k, ".lock").c_str(), &st) == 0)
+            owner += " " + to_string((long long)(time(nullptr) - st.st_mtime)) + " s ago";
+        else
+            owner = "-";
+        if (read_file(c.path(k, ".failed"), failure) == true)
+            owner += ", failed: " + failure.substr(0, failure.find('\n'));
+
+        int accepted = 0;
+        for(const string &h : state.f_history) {
+            int iteration, success = 0;
+            double mean, se;
+            sscanf(h.c_str(), "%d %lf %lf %d", &iteration, &mean, &se, &success);
+            accepted += success;
+        }
+
+        string variant = "sector_search:";
+        for(int j = 0; j < N_TUNED; j++) {
+            char value[64];
+            snprintf(value, sizeof(value), "%s=%.4g", tuned_parameters[j].name, parameter_value(j, state.f_x[j]));
+            variant += string(j > 0 ? "," : "") + value;
+        }
+
+        printf("shard %d: iteration %d/%d (+%d games) accepted %d sigma %.3f owner %s\n    %s\n", k, state.f_iteration,
+               c.f_iterations, state.f_games, accepted, state.f_sigma, owner.c_str(), variant.c_str());
+        n_done += state.f_iteration >= c.f_iterations;
+    }
+
+    // Incumbents only won against their predecessors, compare them with
+    // ABCompare before taking one.
+    printf("%d of %d shards done\n", n_done, c.f_shards);
+    return 0;
+}
+
+
+int main(int argc, char **argv) {
+
+    vector<string> args;
+    Campaign c;
+    int n_threads = thread::hardware_concurrency();
+    int checkpoint_seconds = 30;
+    int stale_seconds = 600;
+    for(int i = 1; i < argc; i++) {
+        string a = argv[i];
+        if (a == "-s" && i + 1 < argc)
+            c.f_shards = max(1, atoi(argv[++i]));
+        else if (a == "-g" && i + 1 < argc)
+            c.f_games = max(2, atoi(argv[++i]));
+        else if (a == "-i" && i + 1 < argc)
+            c.f_iterations = max(1, atoi(argv[++i]));
+        else if (a == "-r" && i + 1 < argc)
+            c.f_seed = strtoull(argv[++i], nullptr, 10);
+        else if (a == "-t" && i + 1 < argc)
+            n_threads = max(1, atoi(argv[++i]));
+        else if (a == "-c" && i + 1 < argc)
+            checkpoint_seconds = max(1, atoi(argv[++i]));
+        else if (a == "-x" && i + 1 < argc)
+            stale_seconds = max(1, atoi(argv[++i]));
+        else
+            args.push_back(a);
+    }
+
+    if (args.size() == 3 && args[0] == "init")
+        return init(args[1], args[2], c);
+
+    if (args.size() == 2 && (args[0] == "work" || args[0] == "status")) {
+        if (c.load(args[1]) == false) {
+            fprintf(stderr, "No campaign in %s\n", args[1].c_str());
+            return 1;
+        }
+        return args[0] == "work" ? work(c, n_threads, checkpoint_seconds, stale_seconds) : status(c);
+    }
+
+    fprintf(stderr, "Usage: %s init <dir> <corpus> [-s shards] [-g games] [-i iterations] [-r seed]\n"
+                    "       %s work <dir> [-t threads] [-c checkpoint_seconds] [-x stale_seconds]\n"
+                    "       %s status <dir>\n", argv[0], argv[0], argv[0]);
+    return 1;
+}